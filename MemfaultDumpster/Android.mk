@@ -5,8 +5,31 @@ LOCAL_MODULE := MemfaultDumpster
 LOCAL_MODULE_CLASS := EXECUTABLES
 LOCAL_SRC_FILES := \
   ContinuousLogcatConfigProto.proto \
+  DumpsterResultsProto.proto \
+  ClogEscalation.cpp \
+  ClogSegment.cpp \
+  ClogTier.cpp \
+  CommandExecutor.cpp \
   ContinuousLogcat.cpp \
+  DumpsterResults.cpp \
+  EventMetricsReport.cpp \
+  EventTagExtractors.cpp \
+  EventWatermark.cpp \
+  KernelLogReader.cpp \
+  LogRedactor.cpp \
+  LogSubscriber.cpp \
   MemfaultDumpster.cpp \
+  ProcPidScanner.cpp \
+  ProcStat.cpp \
+  ProcessNameCache.cpp \
+  ProcessSnapshotTracker.cpp \
+  PropertyTracker.cpp \
+  ResultCache.cpp \
+  SystemProperties.cpp \
+  TimerService.cpp \
+  UidFilter.cpp \
+  UploadBudget.cpp \
+  WrapIntervalEstimator.cpp \
   android-9/file.cpp
 LOCAL_C_INCLUDES += $(call local-generated-sources-dir)/proto/$(LOCAL_PATH)
 LOCAL_CFLAGS := -Werror -Wall -DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) -fstack-protector-all -Wno-unused-parameter
@@ -26,6 +49,11 @@ LOCAL_SHARED_LIBRARIES := \
   libmflt-reporting
 LOCAL_STATIC_LIBRARIES := liblog
 
+# Property types are read from the property_info area, Android 9 and up
+ifeq ($(call math_gt_or_eq, $(PLATFORM_SDK_VERSION), 28), true)
+  LOCAL_STATIC_LIBRARIES += libpropertyinfoparser
+endif
+
 # Support for storage wear info from HAL is available from 11+ on
 # devices that support it
 ifeq ($(call math_gt_or_eq, $(PLATFORM_SDK_VERSION), 30), true)
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace memfault {
+
+/**
+ * Holds an immutable snapshot of type T that can be replaced while other threads read it.
+ *
+ * Writers build a complete new T and publish it; readers never see a partially updated
+ * value. Retirement is handled by shared_ptr: a snapshot that has been replaced stays
+ * alive for as long as a reader holds it and is freed when the last reference is dropped.
+ *
+ * Readers on a hot path keep a local copy and call refresh(), which costs a single acquire
+ * load of the generation counter unless a new snapshot has been published.
+ *
+ * publish() and load() are not lock-free: the atomic shared_ptr functions are implemented
+ * with a small global pool of locks, held only while the pointer and its reference count
+ * are updated. Neither side ever waits for the other to finish using a snapshot.
+ */
+template <typename T>
+class AtomicSnapshot {
+  public:
+    explicit AtomicSnapshot(std::shared_ptr<const T> initial)
+      : current_(std::move(initial)) {}
+
+    AtomicSnapshot(const AtomicSnapshot&) = delete;
+    AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+    /**
+     * Publishes a new snapshot. Concurrent publishers must be serialized by the caller.
+     */
+    void publish(std::shared_ptr<const T> next) {
+      std::atomic_store_explicit(&current_, std::move(next), std::memory_order_release);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    std::shared_ptr<const T> load() const {
+      return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    /**
+     * Updates a reader-local snapshot if a newer one was published since it was taken.
+     *
+     * @return true if local was replaced.
+     */
+    bool refresh(std::shared_ptr<const T>& local, uint64_t& local_generation) const {
+      uint64_t generation = generation_.load(std::memory_order_acquire);
+      if (local && generation == local_generation) {
+        return false;
+      }
+      local = load();
+      local_generation = generation;
+      return true;
+    }
+
+    /**
+     * Number of snapshots published so far, as compared by refresh().
+     */
+    uint64_t generation() const {
+      return generation_.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::shared_ptr<const T> current_;
+    std::atomic<uint64_t> generation_{0};
+};
+
+}
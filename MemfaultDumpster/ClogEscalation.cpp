@@ -0,0 +1,50 @@
+#define LOG_TAG "mflt-clog"
+
+#include "ClogEscalation.h"
+
+#include <algorithm>
+
+#include <log/log.h>
+
+namespace memfault {
+
+EscalationTriggers::EscalationTriggers(const std::vector<std::string>& specs) {
+  for (auto& spec : specs) {
+    if (spec.rfind("tag:", 0) == 0 && spec.size() > 4) {
+      tags_.push_back(Trigger{spec.substr(4), spec});
+    } else if (spec.rfind("pattern:", 0) == 0 && spec.size() > 8) {
+      patterns_.push_back(Trigger{spec.substr(8), spec});
+    } else {
+      ALOGW("clog: ignoring invalid escalation trigger: %s", spec.c_str());
+    }
+  }
+}
+
+const std::string *EscalationTriggers::match(const char *tag, size_t tag_len, const char *msg,
+                                             size_t msg_len) const {
+  for (auto& trigger : tags_) {
+    if (trigger.value.size() == tag_len && memcmp(trigger.value.data(), tag, tag_len) == 0) {
+      return &trigger.spec;
+    }
+  }
+  for (auto& trigger : patterns_) {
+    if (memmem(msg, msg_len, trigger.value.data(), trigger.value.size()) != nullptr) {
+      return &trigger.spec;
+    }
+  }
+  return nullptr;
+}
+
+bool EscalationWindow::trigger(uint64_t start_ms, uint64_t duration_ms, uint64_t budget_bytes) {
+  if (bytes_left_ != 0 && start_ms >= start_ms_ && start_ms < until_ms_) {
+    until_ms_ = std::max(until_ms_, start_ms + duration_ms);
+    return false;
+  }
+  id_++;
+  start_ms_ = start_ms;
+  until_ms_ = start_ms + duration_ms;
+  bytes_left_ = budget_bytes;
+  return true;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace memfault {
+
+static constexpr uint64_t kDefaultEscalationDurationMs = 5 * 60 * 1000; // 5 minutes
+static constexpr uint64_t kDefaultEscalationBudgetBytes = 5 * 1024 * 1024; // 5 MB
+// Escalation filter used when none is configured: everything
+static constexpr const char *kDefaultEscalationFilterSpec = "*:V";
+
+/**
+ * Lines that start a verbosity escalation, compiled from specs:
+ *  - "tag:<tag>": lines of that tag, e.g. "tag:am_crash" or "tag:am_anr" for the events
+ *    buffer
+ *  - "pattern:<text>": lines whose message contains text
+ */
+class EscalationTriggers {
+  public:
+    explicit EscalationTriggers(const std::vector<std::string>& specs);
+
+    inline bool empty() const { return tags_.empty() && patterns_.empty(); }
+
+    /**
+     * The spec of the first trigger matching a line, or null.
+     */
+    const std::string *match(const char *tag, size_t tag_len, const char *msg,
+                             size_t msg_len) const;
+
+  private:
+    struct Trigger {
+      std::string value;
+      std::string spec;
+    };
+
+    std::vector<Trigger> tags_;
+    std::vector<Trigger> patterns_;
+};
+
+/**
+ * The current escalation window of the reader, in log timestamps (ms since the epoch).
+ *
+ * A trigger opens a window of duration_ms with a budget of budget_bytes. Triggers during a
+ * window extend it without adding to its budget, so that e.g. a crash loop cannot keep the
+ * escalated filter on indefinitely. The window closes once its time or budget runs out.
+ */
+class EscalationWindow {
+  public:
+    /**
+     * @return true if this opened a new window, false if it extended the current one.
+     */
+    bool trigger(uint64_t start_ms, uint64_t duration_ms, uint64_t budget_bytes);
+
+    inline bool active(uint64_t entry_ms) const {
+      return bytes_left_ != 0 && entry_ms >= start_ms_ && entry_ms < until_ms_;
+    }
+
+    inline void consume(size_t bytes) {
+      bytes_left_ = bytes >= bytes_left_ ? 0 : bytes_left_ - bytes;
+    }
+
+    // Increments with each new window, 0 before the first one
+    inline uint64_t id() const { return id_; }
+
+  private:
+    uint64_t id_ = 0;
+    uint64_t start_ms_ = 0;
+    uint64_t until_ms_ = 0;
+    uint64_t bytes_left_ = 0;
+};
+
+}
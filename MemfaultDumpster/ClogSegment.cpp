@@ -0,0 +1,175 @@
+#define LOG_TAG "mflt-clog"
+
+#include "ClogSegment.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#include <fcntl.h>
+#include <log/log.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/SystemClock.h>
+
+namespace memfault {
+
+uint64_t SegmentMetadata::lines() const {
+  uint64_t total = 0;
+  for (auto& stats : buffers) {
+    total += stats.lines;
+  }
+  return total;
+}
+
+std::string SegmentMetadata::to_header() const {
+  char buf[kSegmentHeaderSize];
+  int len = snprintf(buf, sizeof(buf),
+      CONTINUOUS_LOGCAT_HEADER_PREFIX " complete=%d lines=%" PRIu64 " bytes=%" PRIu64
+      " filters=%08" PRIx32 " config=%08" PRIx32 " redaction=%d compression=none"
+      " shed_level=%u shed_lines=%" PRIu64 " redacted_lines=%" PRIu64
+      " kernel_lost=%" PRIu64 " tier=%s upload_priority=%u budget_shed_lines=%" PRIu64
+      " budget_sampled_lines=%" PRIu64 " escalations=%" PRIu32 " escalated_lines=%" PRIu64
+      " escalated=%" PRIu32 ".%09" PRIu32 "-%" PRIu32 ".%09" PRIu32 " buffers=",
+      complete ? 1 : 0, lines(), bytes, filters_hash, config_hash, redaction ? 1 : 0,
+      (unsigned)max_shed_level, shed_lines, redacted_lines, kernel_lost_records, tier.c_str(),
+      (unsigned)upload_priority, budget_shed_lines, budget_sampled_lines, escalations,
+      escalated_lines, escalated_first_sec, escalated_first_nsec, escalated_last_sec,
+      escalated_last_nsec);
+  if (len < 0) len = 0;
+
+  bool first = true;
+  for (size_t log_id = 0; log_id < buffers.size(); log_id++) {
+    const SegmentBufferStats& stats = buffers[log_id];
+    if (stats.lines == 0 || (size_t)len >= sizeof(buf)) continue;
+    const char *name = android_log_id_to_name((log_id_t)log_id);
+    int added = snprintf(buf + len, sizeof(buf) - len,
+        "%s%s:%" PRIu32 ".%09" PRIu32 "-%" PRIu32 ".%09" PRIu32 ":%" PRIu64 ":%" PRIu64,
+        first ? "" : ",", name ? name : "unknown", stats.first_sec, stats.first_nsec,
+        stats.last_sec, stats.last_nsec, stats.lines, stats.bytes);
+    if (added < 0) break;
+    len += added;
+    first = false;
+  }
+
+  std::string header(buf, std::min((size_t)len, kSegmentHeaderSize - 1));
+  header.resize(kSegmentHeaderSize - 1, ' ');
+  header.push_back('\n');
+  return header;
+}
+
+ClogSegment::ClogSegment(std::string path) : path_(std::move(path)) {}
+
+ClogSegment::~ClogSegment() {
+  close();
+}
+
+bool ClogSegment::open() {
+  close();
+
+  fd_ = creat(path_.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (fd_ < 0) {
+    ALOGE("Failed to create continuous log segment %s", path_.c_str());
+    return false;
+  }
+  fp_ = fdopen(fd_, "w");
+  header_written_ = false;
+  bytes_written_ = 0;
+  created_uptime_ms_ = android::uptimeMillis();
+  metadata_ = SegmentMetadata();
+  metadata_.tier = tier_;
+  metadata_.upload_priority = upload_priority_;
+  metadata_.filters_hash = filters_hash_;
+  metadata_.config_hash = config_hash_;
+  metadata_.redaction = redaction_;
+  return true;
+}
+
+void ClogSegment::set_tier(const std::string& name, uint8_t upload_priority) {
+  tier_ = name.empty() ? kBaseTierName : name;
+  upload_priority_ = upload_priority;
+  metadata_.tier = tier_;
+  metadata_.upload_priority = upload_priority_;
+}
+
+void ClogSegment::set_config(uint32_t filters_hash, uint32_t config_hash, bool redaction) {
+  filters_hash_ = filters_hash;
+  config_hash_ = config_hash;
+  redaction_ = redaction;
+  metadata_.filters_hash = filters_hash;
+  metadata_.config_hash = config_hash;
+  metadata_.redaction = redaction;
+}
+
+void ClogSegment::finalize() {
+  if (!is_open()) return;
+
+  if (header_written_) {
+    fflush(fp_);
+    metadata_.complete = true;
+    metadata_.bytes = bytes_written_;
+    std::string header = metadata_.to_header();
+    if (pwrite(fd_, header.data(), header.size(), 0) != (ssize_t)header.size()) {
+      ALOGW("Failed to rewrite continuous log header");
+    }
+  }
+  fsync(fd_);
+  close();
+}
+
+void ClogSegment::close() {
+  if (fp_) {
+    fclose(fp_);
+  } else if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fp_ = nullptr;
+  fd_ = -1;
+}
+
+bool ClogSegment::ensure_header() {
+  if (header_written_) return true;
+
+  // Written with the fd directly: nothing has gone through fp_ yet.
+  std::string header = metadata_.to_header();
+  if (::write(fd_, header.data(), header.size()) != (ssize_t)header.size()) {
+    return false;
+  }
+  header_written_ = true;
+  return true;
+}
+
+bool ClogSegment::write(const char *buf, size_t len) {
+  if (!is_open() || !ensure_header()) return false;
+
+#if PLATFORM_SDK_VERSION <= 32
+  if (::write(fd_, buf, len) >= 0) {
+    bytes_written_ += len;
+    fsync(fd_);
+    return true;
+  }
+#else
+  if (fwrite(buf, 1, len, fp_) == len) {
+    bytes_written_ += len;
+    fflush(fp_);
+    fsync(fd_);
+    return true;
+  }
+#endif
+  return false;
+}
+
+size_t ClogSegment::print(AndroidLogFormat *format, uint32_t log_id,
+                          const AndroidLogEntry &entry) {
+  if (!is_open() || !ensure_header()) return 0;
+
+#if PLATFORM_SDK_VERSION <= 32
+  size_t written = android_log_printLogLine(format, fd_, &entry);
+#else
+  size_t written = android_log_printLogLine(format, fp_, &entry);
+#endif
+  bytes_written_ += written;
+  metadata_.record_line(log_id, (uint32_t)entry.tv_sec, (uint32_t)entry.tv_nsec, written);
+  return written;
+}
+
+}
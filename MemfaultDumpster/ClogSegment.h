@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <log/logprint.h>
+
+#include "ClogTier.h"
+
+namespace memfault {
+
+// Bytes reserved at the start of each segment for its metadata header. The header is
+// written when the first line goes into the segment and rewritten in place when the
+// segment is dumped.
+static constexpr size_t kSegmentHeaderSize = 1024;
+#define CONTINUOUS_LOGCAT_HEADER_PREFIX "#memfault_clog v2"
+// Log buffer ids tracked in the metadata, LOG_ID_MAX on current platforms
+static constexpr size_t kSegmentMaxBuffers = 8;
+
+/**
+ * Lines of a log buffer written to a segment.
+ */
+struct SegmentBufferStats {
+  uint64_t lines = 0;
+  uint64_t bytes = 0;
+  // Timestamps of the oldest and newest lines
+  uint32_t first_sec = 0;
+  uint32_t first_nsec = 0;
+  uint32_t last_sec = 0;
+  uint32_t last_nsec = 0;
+};
+
+/**
+ * Metadata describing the contents of a segment, serialized as its first line so that
+ * consumers can route or skip a segment without reading it:
+ *
+ *   #memfault_clog v2 complete=1 lines=1200 bytes=153600 filters=9c1e4a0b config=5d02f7e1
+ *   redaction=1 compression=none shed_level=2 shed_lines=1234 redacted_lines=5
+ *   kernel_lost=0 tier=base upload_priority=0 budget_shed_lines=0 budget_sampled_lines=0
+ *   escalations=1 escalated_lines=200
+ *   escalated=1697040100.000000000-1697040400.000000000
+ *   buffers=main:1697040000.000000000-1697040900.500000000:1000:128000,...
+ *
+ * on a single line, padded with spaces to kSegmentHeaderSize. Each buffer is listed as
+ * <name>:<first timestamp>-<last timestamp>:<lines>:<bytes>. A segment left over by a
+ * crash has complete=0: its header is the one written with its first line. Bort consumes
+ * the header (ContinuousLogcatHeader) before parsing the segment as logcat output.
+ */
+struct SegmentMetadata {
+  // Whether the header was rewritten when the segment was finalized
+  bool complete = false;
+  // Bytes of log content, buffer separators included
+  uint64_t bytes = 0;
+  // Hashes of the filter specs and of the whole configuration the segment was written with
+  uint32_t filters_hash = 0;
+  uint32_t config_hash = 0;
+  // Whether redaction rules were applied
+  bool redaction = false;
+  std::array<SegmentBufferStats, kSegmentMaxBuffers> buffers{};
+  // Highest shedding level (see ShedLevel) applied while the segment was written
+  uint8_t max_shed_level = 0;
+  // Lines that passed the filters but were shed because of storage pressure
+  uint64_t shed_lines = 0;
+  // Lines in which personal data was redacted
+  uint64_t redacted_lines = 0;
+  // Kernel records overwritten in the kernel buffer before they could be read
+  uint64_t kernel_lost_records = 0;
+  // Severity tier the segment belongs to, see ClogTierConfig
+  std::string tier = kBaseTierName;
+  uint8_t upload_priority = 0;
+  // Lines dropped, and lines kept as samples of what was dropped, to stay within the upload
+  // budget
+  uint64_t budget_shed_lines = 0;
+  uint64_t budget_sampled_lines = 0;
+  // Escalation windows (see EscalationWindow) with lines in the segment, their lines and
+  // the timestamps of the first and last of them
+  uint32_t escalations = 0;
+  uint64_t escalated_lines = 0;
+  uint32_t escalated_first_sec = 0;
+  uint32_t escalated_first_nsec = 0;
+  uint32_t escalated_last_sec = 0;
+  uint32_t escalated_last_nsec = 0;
+  // Window of the last escalated line, not serialized
+  uint64_t last_escalation_id = 0;
+
+  inline void record_escalated_line(uint64_t escalation_id, uint32_t sec, uint32_t nsec) {
+    if (escalation_id != last_escalation_id) {
+      escalations++;
+      last_escalation_id = escalation_id;
+    }
+    if (escalated_lines == 0) {
+      escalated_first_sec = sec;
+      escalated_first_nsec = nsec;
+    }
+    escalated_last_sec = sec;
+    escalated_last_nsec = nsec;
+    escalated_lines++;
+  }
+
+  inline void record_line(uint32_t log_id, uint32_t sec, uint32_t nsec, size_t line_bytes) {
+    if (log_id >= kSegmentMaxBuffers) return;
+    SegmentBufferStats& stats = buffers[log_id];
+    if (stats.lines == 0 || sec < stats.first_sec ||
+        (sec == stats.first_sec && nsec < stats.first_nsec)) {
+      stats.first_sec = sec;
+      stats.first_nsec = nsec;
+    }
+    if (stats.lines == 0 || sec > stats.last_sec ||
+        (sec == stats.last_sec && nsec > stats.last_nsec)) {
+      stats.last_sec = sec;
+      stats.last_nsec = nsec;
+    }
+    stats.lines++;
+    stats.bytes += line_bytes;
+  }
+  uint64_t lines() const;
+
+  std::string to_header() const;
+};
+
+/**
+ * A continuous log output file. Lines are appended until the segment is finalized, at
+ * which point it is handed over to DropBox and a new segment is opened in its place.
+ */
+class ClogSegment {
+  public:
+    explicit ClogSegment(std::string path);
+    ~ClogSegment();
+
+    /**
+     * Creates (or truncates) the segment file.
+     */
+    bool open();
+
+    /**
+     * Rewrites the header with the final metadata, syncs and closes the file. The file is
+     * left on disk so it can be added to DropBox.
+     */
+    void finalize();
+
+    /**
+     * Closes the file without rewriting the header.
+     */
+    void close();
+
+    /**
+     * Writes raw text (e.g. buffer separators) to the segment and syncs it.
+     */
+    bool write(const char *buf, size_t len);
+
+    /**
+     * Formats and writes a log entry of buffer log_id, returning the number of bytes written.
+     */
+    size_t print(AndroidLogFormat *format, uint32_t log_id, const AndroidLogEntry &entry);
+
+    inline const std::string& path() const { return path_; }
+    inline bool is_open() const { return fd_ >= 0; }
+    // Bytes of log content in the segment, excluding the header
+    inline size_t bytes_written() const { return bytes_written_; }
+    inline uint64_t created_uptime_ms() const { return created_uptime_ms_; }
+    inline SegmentMetadata& metadata() { return metadata_; }
+
+    /**
+     * Tier recorded in the metadata of this and the following segments.
+     */
+    void set_tier(const std::string& name, uint8_t upload_priority);
+
+    /**
+     * Configuration recorded in the metadata of this and the following segments.
+     */
+    void set_config(uint32_t filters_hash, uint32_t config_hash, bool redaction);
+
+  private:
+    bool ensure_header();
+
+    std::string path_;
+    int fd_ = -1;
+    FILE *fp_ = nullptr;
+    bool header_written_ = false;
+    size_t bytes_written_ = 0;
+    uint64_t created_uptime_ms_ = 0;
+    std::string tier_ = kBaseTierName;
+    uint8_t upload_priority_ = 0;
+    uint32_t filters_hash_ = 0;
+    uint32_t config_hash_ = 0;
+    bool redaction_ = false;
+    SegmentMetadata metadata_;
+};
+
+}
@@ -0,0 +1,109 @@
+#define LOG_TAG "mflt-clog"
+
+#include "ClogTier.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+
+#include <log/log.h>
+
+namespace memfault {
+
+bool parse_priority(const std::string& value, android_LogPriority *priority) {
+  if (value.size() != 1) return false;
+  switch (value[0]) {
+    case 'V': *priority = ANDROID_LOG_VERBOSE; return true;
+    case 'D': *priority = ANDROID_LOG_DEBUG; return true;
+    case 'I': *priority = ANDROID_LOG_INFO; return true;
+    case 'W': *priority = ANDROID_LOG_WARN; return true;
+    case 'E': *priority = ANDROID_LOG_ERROR; return true;
+    case 'F': *priority = ANDROID_LOG_FATAL; return true;
+    default: return false;
+  }
+}
+
+static bool parse_number(const std::string& value, uint64_t *number) {
+  if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) return false;
+  *number = strtoull(value.c_str(), nullptr, 10);
+  return true;
+}
+
+bool parse_tier_spec(const std::string& spec, ClogTierConfig& tier) {
+  size_t colon = spec.find(':');
+  if (colon == std::string::npos || colon == 0) return false;
+  std::string name = spec.substr(0, colon);
+  if (name == kBaseTierName || name.size() > kMaxTierNameLength ||
+      name.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789_") != std::string::npos) {
+    return false;
+  }
+  tier.name = name;
+
+  size_t pos = colon + 1;
+  size_t comma = spec.find(',', pos);
+  if (!parse_priority(spec.substr(pos, comma - pos), &tier.min_priority)) return false;
+
+  while (comma != std::string::npos) {
+    pos = comma + 1;
+    comma = spec.find(',', pos);
+    std::string field = spec.substr(pos, comma - pos);
+    size_t eq = field.find('=');
+    if (eq == std::string::npos) return false;
+    std::string key = field.substr(0, eq);
+    uint64_t value;
+    if (!parse_number(field.substr(eq + 1), &value)) return false;
+
+    if (key == "bytes") {
+      tier.dump_threshold_bytes = (size_t)value;
+    } else if (key == "time_ms") {
+      tier.dump_threshold_time_ms = value;
+    } else if (key == "quota") {
+      tier.storage_quota_bytes = value;
+    } else if (key == "priority" && value <= UINT8_MAX) {
+      tier.upload_priority = (uint8_t)value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<ClogTierConfig> build_tiers(const std::vector<std::string>& specs,
+                                        const ClogTierConfig& base) {
+  std::vector<ClogTierConfig> tiers;
+  std::set<std::string> names;
+  for (auto& spec : specs) {
+    // Unspecified thresholds default to the base ones
+    ClogTierConfig tier = base;
+    if (!parse_tier_spec(spec, tier) || !names.insert(tier.name).second) {
+      ALOGW("clog: ignoring invalid tier: %s", spec.c_str());
+      continue;
+    }
+    if (tier.storage_quota_bytes == 0) {
+      tier.storage_quota_bytes = 2 * (uint64_t)tier.dump_threshold_bytes;
+    }
+    tiers.push_back(tier);
+  }
+  std::stable_sort(tiers.begin(), tiers.end(), [](const ClogTierConfig& a, const ClogTierConfig& b) {
+    return a.min_priority > b.min_priority;
+  });
+
+  ClogTierConfig base_tier = base;
+  base_tier.name.clear();
+  base_tier.min_priority = ANDROID_LOG_DEFAULT;
+  if (base_tier.storage_quota_bytes == 0) {
+    base_tier.storage_quota_bytes = 2 * (uint64_t)base_tier.dump_threshold_bytes;
+  }
+  tiers.push_back(base_tier);
+  return tiers;
+}
+
+size_t route_to_tier(const std::vector<ClogTierConfig>& tiers, android_LogPriority priority) {
+  // Few tiers, most severe first: the first one admitting the priority wins
+  for (size_t i = 0; i + 1 < tiers.size(); i++) {
+    if (priority >= tiers[i].min_priority) return i;
+  }
+  return tiers.size() - 1;
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <android/log.h>
+
+namespace memfault {
+
+// Name of the base tier in segment headers, reserved
+static constexpr const char *kBaseTierName = "base";
+static constexpr size_t kMaxTierNameLength = 32;
+
+/**
+ * A severity tier of the continuous log. Each tier is written to its own segment with its
+ * own dump thresholds and storage quota, so that e.g. errors can be sent small and often
+ * while verbose output is sent lazily.
+ */
+struct ClogTierConfig {
+  // Empty for the base tier, otherwise its segment is CONTINUOUS_LOGCAT_FILE.<name>
+  std::string name;
+  // Lowest priority routed to this tier
+  android_LogPriority min_priority = ANDROID_LOG_DEFAULT;
+  size_t dump_threshold_bytes = 0;
+  uint64_t dump_threshold_time_ms = 0;
+  // Bound on the tier's current segment plus its leftover segments waiting to be dumped,
+  // 0 for twice dump_threshold_bytes, resolved by build_tiers()
+  uint64_t storage_quota_bytes = 0;
+  // Tiers due at the same time are dumped lowest first, also recorded in the segment header
+  uint8_t upload_priority = 0;
+};
+
+/**
+ * Parses a logcat priority letter (V, D, I, W, E or F).
+ */
+bool parse_priority(const std::string& value, android_LogPriority *priority);
+
+/**
+ * Parses a tier spec:
+ *
+ *   <name>:<min priority>[,bytes=N][,time_ms=N][,quota=N][,priority=N]
+ *
+ * e.g. "errors:W,bytes=65536,time_ms=60000,priority=0" routes warnings and above to their
+ * own segment dumped every 64 kB or minute. Omitted fields keep their value in tier.
+ * Names are made of up to 32 [a-z0-9_], "base" is reserved: they end up in file names and,
+ * unescaped, in the space separated key=value segment header (see SegmentMetadata).
+ *
+ * @return false if the spec is invalid, tier may then be partially updated.
+ */
+bool parse_tier_spec(const std::string& spec, ClogTierConfig& tier);
+
+/**
+ * Builds the tiers from specs, most severe first, followed by a base tier (name "",
+ * catching everything else) configured from base. Invalid and duplicate specs are skipped.
+ */
+std::vector<ClogTierConfig> build_tiers(const std::vector<std::string>& specs,
+                                        const ClogTierConfig& base);
+
+/**
+ * Index of the tier priority is routed to, tiers as returned by build_tiers().
+ */
+size_t route_to_tier(const std::vector<ClogTierConfig>& tiers, android_LogPriority priority);
+
+}
@@ -0,0 +1,165 @@
+#include "CommandExecutor.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <pthread.h>
+
+namespace memfault {
+
+CommandExecutor::CommandExecutor(std::vector<CommandLane> lanes,
+                                 QueueDepthListener queue_depth_listener)
+  : lanes_(lanes.size()),
+    queue_depth_listener_(std::move(queue_depth_listener)) {
+  for (size_t i = 0; i < lanes.size(); i++) {
+    lanes_[i].config = std::move(lanes[i]);
+  }
+  // Only start the threads once every lane is set up
+  for (size_t i = 0; i < lanes_.size(); i++) {
+    std::string thread_name = ("cmd-" + lanes_[i].config.name).substr(0, 15);
+    for (size_t n = 0; n < std::max<size_t>(lanes_[i].config.concurrency, 1); n++) {
+      lanes_[i].workers.emplace_back(&CommandExecutor::work, this, i);
+      pthread_setname_np(lanes_[i].workers.back().native_handle(), thread_name.c_str());
+    }
+  }
+  monitor_ = std::thread(&CommandExecutor::monitor, this);
+  pthread_setname_np(monitor_.native_handle(), "cmd-monitor");
+}
+
+CommandExecutor::~CommandExecutor() {
+  std::vector<std::function<void(int)>> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+    for (auto& lane : lanes_) {
+      for (uint64_t id : lane.queue) {
+        auto it = entries_.find(id);
+        if (it == entries_.end()) continue;
+        cancelled.push_back(std::move(it->second.task.on_failed));
+        entries_.erase(it);
+      }
+      lane.queue.clear();
+    }
+  }
+  work_available_.notify_all();
+  deadlines_changed_.notify_all();
+
+  for (auto& on_failed : cancelled) {
+    if (on_failed) on_failed(-ECANCELED);
+  }
+  for (auto& lane : lanes_) {
+    for (auto& worker : lane.workers) {
+      worker.join();
+    }
+  }
+  monitor_.join();
+}
+
+void CommandExecutor::submit(size_t lane, std::chrono::milliseconds timeout, CommandTask task) {
+  int error = 0;
+  size_t queue_depth = 0;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (stopping_ || lane >= lanes_.size()) {
+      error = -ECANCELED;
+    } else {
+      Lane& target = lanes_[lane];
+      queue_depth = target.queue.size();
+      if (queue_depth >= target.config.max_queued) {
+        error = -EBUSY;
+      } else {
+        auto deadline = timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max();
+        uint64_t id = next_id_++;
+        entries_.emplace(id, Entry{std::move(task), lane, deadline, false});
+        target.queue.push_back(id);
+      }
+    }
+  }
+
+  if (error == -ECANCELED) {
+    if (task.on_failed) task.on_failed(error);
+    return;
+  }
+  if (queue_depth_listener_) {
+    queue_depth_listener_(lane, queue_depth);
+  }
+  if (error == -EBUSY) {
+    rejections_.fetch_add(1, std::memory_order_relaxed);
+    if (task.on_failed) task.on_failed(error);
+    return;
+  }
+  work_available_.notify_all();
+  deadlines_changed_.notify_one();
+}
+
+void CommandExecutor::work(size_t lane) {
+  std::unique_lock<std::mutex> lock(lock_);
+  std::deque<uint64_t>& queue = lanes_[lane].queue;
+  while (true) {
+    work_available_.wait(lock, [&]() { return stopping_ || !queue.empty(); });
+    if (stopping_) return;
+
+    uint64_t id = queue.front();
+    queue.pop_front();
+    auto it = entries_.find(id);
+    if (it == entries_.end()) continue;
+    it->second.running = true;
+    std::function<void()> run = std::move(it->second.task.run);
+
+    lock.unlock();
+    if (run) run();
+    lock.lock();
+
+    // Gone if it timed out while running: the monitor already reported it
+    it = entries_.find(id);
+    if (it == entries_.end()) continue;
+    std::function<void()> on_finished = std::move(it->second.task.on_finished);
+    entries_.erase(it);
+
+    lock.unlock();
+    if (on_finished) on_finished();
+    lock.lock();
+  }
+}
+
+void CommandExecutor::monitor() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopping_) {
+    auto now = Clock::now();
+    auto next_deadline = Clock::time_point::max();
+    std::vector<std::function<void(int)>> expired;
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      Entry& entry = it->second;
+      if (entry.deadline > now) {
+        next_deadline = std::min(next_deadline, entry.deadline);
+        ++it;
+        continue;
+      }
+      if (!entry.running) {
+        auto& queue = lanes_[entry.lane].queue;
+        queue.erase(std::remove(queue.begin(), queue.end(), it->first), queue.end());
+      }
+      expired.push_back(std::move(entry.task.on_failed));
+      it = entries_.erase(it);
+    }
+
+    if (!expired.empty()) {
+      timeouts_.fetch_add(expired.size(), std::memory_order_relaxed);
+      lock.unlock();
+      for (auto& on_failed : expired) {
+        if (on_failed) on_failed(-ETIMEDOUT);
+      }
+      lock.lock();
+      continue;
+    }
+
+    if (next_deadline == Clock::time_point::max()) {
+      deadlines_changed_.wait(lock);
+    } else {
+      deadlines_changed_.wait_until(lock, next_deadline);
+    }
+  }
+}
+
+}
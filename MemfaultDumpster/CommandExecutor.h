@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace memfault {
+
+/**
+ * A class of commands run by their own workers, so that commands of one lane never wait
+ * behind those of another.
+ */
+struct CommandLane {
+  std::string name;
+  // Commands of the lane running at once
+  size_t concurrency;
+  // Commands waiting for a worker beyond which new ones are rejected
+  size_t max_queued;
+};
+
+/**
+ * A command and how its outcome is reported. Exactly one of on_finished and on_failed is
+ * called, from a worker or the executor's monitor thread.
+ */
+struct CommandTask {
+  std::function<void()> run;
+  // After run() returned in time
+  std::function<void()> on_finished;
+  // -ETIMEDOUT, -EBUSY when the lane's queue is full, or -ECANCELED on shutdown
+  std::function<void(int error)> on_failed;
+};
+
+/**
+ * Runs commands off the binder threads, in lanes with their own concurrency limits.
+ *
+ * A task that is not done by its timeout (counted from submit(), queueing included) fails
+ * with -ETIMEDOUT right away. A command that is already running cannot be interrupted: it
+ * keeps its worker until it returns, and its result is then discarded.
+ */
+class CommandExecutor {
+  public:
+    // Called with the number of tasks queued ahead of each submitted task, from submit()
+    using QueueDepthListener = std::function<void(size_t lane, size_t queue_depth)>;
+
+    explicit CommandExecutor(std::vector<CommandLane> lanes,
+                             QueueDepthListener queue_depth_listener = nullptr);
+    // Fails the tasks still queued with -ECANCELED and waits for the running ones
+    ~CommandExecutor();
+
+    CommandExecutor(const CommandExecutor&) = delete;
+    CommandExecutor& operator=(const CommandExecutor&) = delete;
+
+    /**
+     * Queues a task on a lane, 0 for no timeout. on_failed may be called before this
+     * returns.
+     */
+    void submit(size_t lane, std::chrono::milliseconds timeout, CommandTask task);
+
+    // Tasks that failed with -ETIMEDOUT, and -EBUSY
+    inline uint64_t timeouts() const { return timeouts_.load(std::memory_order_relaxed); }
+    inline uint64_t rejections() const { return rejections_.load(std::memory_order_relaxed); }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+      CommandTask task;
+      size_t lane;
+      Clock::time_point deadline;
+      bool running;
+    };
+
+    struct Lane {
+      CommandLane config;
+      std::deque<uint64_t> queue;
+      std::vector<std::thread> workers;
+    };
+
+    void work(size_t lane);
+    void monitor();
+
+    std::mutex lock_;
+    std::condition_variable work_available_;
+    std::condition_variable deadlines_changed_;
+    std::vector<Lane> lanes_;
+    // Queued and running tasks, by id
+    std::map<uint64_t, Entry> entries_;
+    uint64_t next_id_ = 1;
+    bool stopping_ = false;
+    QueueDepthListener queue_depth_listener_;
+
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> rejections_{0};
+    std::thread monitor_;
+};
+
+}
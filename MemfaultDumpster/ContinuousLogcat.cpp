@@ -6,15 +6,19 @@
 
 #include <android/os/DropBoxManager.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <fstream>
 #include <unordered_set>
 
+#include <dirent.h>
 #include <inttypes.h>
+#include <log/log.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
@@ -22,11 +26,165 @@
 
 namespace memfault {
 
-ContinuousLogcat::ContinuousLogcat() :
+static constexpr uint64_t kStorageCheckIntervalMs = 60 * 1000;
+// Lateness allowed to the wrap alarm for sharing wakeups with other timers
+static constexpr uint64_t kWrapAlarmWindowMs = 10 * 1000;
+static constexpr uint64_t kDefaultStorageLowFreeBytesMax = 500 * 1024 * 1024;
+// Out of the lines the upload budget sheds, one in this many is kept as a sample
+static constexpr uint64_t kUploadBudgetSampleRate = 16;
+// Within a read batch, which may last until logd wraps
+static constexpr uint64_t kEventWatermarkPersistIntervalMs = 10 * 1000;
+// Tier segments are CONTINUOUS_LOGCAT_FILE.<tier name>
+static constexpr const char *kTierFilePrefix = "clog.";
+// Leftover segments are renamed to CONTINUOUS_LOGCAT_DIR/pending.<n>[.<tier name>] until
+// they are dumped
+static constexpr const char *kPendingFilePrefix = "pending.";
+
+static std::string tier_path(const std::string& name) {
+  return name.empty() ? std::string(CONTINUOUS_LOGCAT_FILE) : CONTINUOUS_LOGCAT_FILE "." + name;
+}
+
+ClogTierOutput::ClogTierOutput(const ClogTierConfig& tier_config,
+                               const std::atomic<uint64_t>& tier_pending_bytes)
+  : config(tier_config), segment(tier_path(tier_config.name)),
+    pending_bytes(tier_pending_bytes) {}
+
+/**
+ * Shedding level derived from how much of the byte quota the pending output uses: verbose
+ * and debug lines go first, then info. Warnings and errors are only dropped once the
+ * quota is exhausted.
+ */
+static uint8_t quota_shed_level(uint64_t used_bytes, uint64_t quota_bytes) {
+  if (quota_bytes == 0) return SHED_NONE;
+  if (used_bytes >= quota_bytes) return SHED_ALL;
+  if (used_bytes >= quota_bytes / 10 * 9) return SHED_INFO;
+  if (used_bytes >= quota_bytes / 4 * 3) return SHED_VERBOSE_DEBUG;
+  return SHED_NONE;
+}
+
+static android_LogPriority min_priority_for_shed_level(uint8_t level) {
+  switch (level) {
+    case SHED_NONE: return ANDROID_LOG_DEFAULT;
+    case SHED_VERBOSE_DEBUG: return ANDROID_LOG_INFO;
+    case SHED_INFO: return ANDROID_LOG_WARN;
+    default: return ANDROID_LOG_SILENT;
+  }
+}
+
+/**
+ * Whether the reader has to end its read batch for a new snapshot to apply. Everything else
+ * is picked up with the next entry it reads.
+ */
+static bool needs_new_batch(const ContinuousLogcatSnapshot& previous,
+                            const ContinuousLogcatSnapshot& next) {
+  // /dev/kmsg is opened and closed between batches
+  return previous.kernel_logs != next.kernel_logs;
+}
+
+static bool is_binary_log(log_id_t log_id) {
+  bool is_binary = log_id == LOG_ID_EVENTS || log_id == LOG_ID_SECURITY;
+#if PLATFORM_SDK_VERSION > 27
+  is_binary |= log_id == LOG_ID_STATS;
+#endif
+  return is_binary;
+}
+
+/**
+ * Converts a logd buffer to the more human-friendly AndroidLogEntry, binary payloads are
+ * rendered into buf.
+ */
+static int process_log_msg(struct log_msg& log_msg, AndroidLogEntry *entry,
+                           const EventTagMap *event_tag_map, char *buf, size_t buf_size) {
+  if (is_binary_log((log_id_t)log_msg.id())) {
+#if PLATFORM_SDK_VERSION <= 29
+    return android_log_processBinaryLogBuffer(&log_msg.entry_v1, entry, event_tag_map, buf,
+                                              buf_size);
+#else
+    return android_log_processBinaryLogBuffer(&log_msg.entry, entry, event_tag_map, buf,
+                                              buf_size);
+#endif
+  }
+#if PLATFORM_SDK_VERSION <= 29
+  return android_log_processLogBuffer(&log_msg.entry_v1, entry);
+#else
+  return android_log_processLogBuffer(&log_msg.entry, entry);
+#endif
+}
+
+// FNV-1a, used to fingerprint the configuration in segment headers
+static constexpr uint32_t kFnvOffsetBasis = 2166136261u;
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t fnv1a(uint32_t hash, const std::vector<std::string>& values) {
+  for (auto& value : values) {
+    // Include the terminator so that {"ab", "c"} and {"a", "bc"} differ
+    hash = fnv1a(hash, value.c_str(), value.size() + 1);
+  }
+  return hash;
+}
+
+static uint32_t fnv1a(uint32_t hash, uint64_t value) {
+  return fnv1a(hash, &value, sizeof(value));
+}
+
+/**
+ * Fingerprint of everything that shapes the output, the started state aside.
+ */
+static uint32_t config_hash(ContinuousLogcatConfig& config) {
+  uint32_t hash = fnv1a(kFnvOffsetBasis, config.filter_specs());
+  hash = fnv1a(hash, config.tier_specs());
+  hash = fnv1a(hash, config.redaction_rules());
+  hash = fnv1a(hash, config.uid_rules());
+  hash = fnv1a(hash, config.escalation_filter_specs());
+  hash = fnv1a(hash, config.escalation_triggers());
+  hash = fnv1a(hash, config.escalation_duration_ms());
+  hash = fnv1a(hash, config.escalation_budget_bytes());
+  hash = fnv1a(hash, (uint64_t)config.dump_threshold_bytes());
+  hash = fnv1a(hash, config.dump_threshold_time_ms());
+  hash = fnv1a(hash, config.dump_wrapping_timeout_ms());
+  hash = fnv1a(hash, config.dump_wrapping_timeout_min_ms());
+  hash = fnv1a(hash, config.storage_quota_bytes());
+  hash = fnv1a(hash, config.storage_low_free_bytes());
+  hash = fnv1a(hash, (uint64_t)config.kernel_logs());
+  hash = fnv1a(hash, (uint64_t)config.process_names());
+  hash = fnv1a(hash, (uint64_t)config.event_metrics());
+  hash = fnv1a(hash, config.upload_budget_bytes());
+  hash = fnv1a(hash, config.upload_budget_period_ms());
+  return hash;
+}
+
+static void set_default_print_formats(AndroidLogFormat *format) {
+  // We current use the same log formats as the Bort periodic logcat collector.
+  auto logFormats = {
+    AndroidLogPrintFormat::FORMAT_THREADTIME,
+    AndroidLogPrintFormat::FORMAT_MODIFIER_TIME_NSEC,
+    AndroidLogPrintFormat::FORMAT_MODIFIER_PRINTABLE,
+    AndroidLogPrintFormat::FORMAT_MODIFIER_UID,
+    AndroidLogPrintFormat::FORMAT_MODIFIER_ZONE,
+    AndroidLogPrintFormat::FORMAT_MODIFIER_YEAR,
+  };
+
+  // Set the timezone to UTC (i.e. same behavior as logcat when -v UTC is passed)
+  setenv("TZ", "UTC", 1);
+
+  for (auto& logFormat : logFormats) {
+    android_log_setPrintFormat(format, logFormat);
+  }
+}
+
+ContinuousLogcat::ContinuousLogcat(std::function<void(uint64_t)> wrap_interval_listener,
+                                   EventMetricsSink *event_sink) :
     logger_list(nullptr, android_logger_list_close),
-    log_format(nullptr, android_log_format_free),
-    total_bytes_written(0),
-    last_collection_uptime_ms(android::uptimeMillis()) {
+    wrap_interval_listener(std::move(wrap_interval_listener)),
+    event_sink(event_sink),
+    subscriber_logger_list(nullptr, android_logger_list_close) {
   // Compute the list of buffers we want to read from. Buffers
   // may vary between platform versions we use the liblog API
   // to match names to buffer ids.
@@ -38,33 +196,62 @@ ContinuousLogcat::ContinuousLogcat() :
   }
 
   config.restore_config();
-  rebuild_log_format(config.filter_specs());
-  if (config.started()) {
-    this->start(true /* start_from_previous_config */);
+  publish_snapshot();
+}
+
+void ContinuousLogcat::recover() {
+  std::vector<ClaimedFile> claimed;
+  {
+    std::lock_guard<std::mutex> lock(log_lock);
+    if (recovered) {
+      ALOGT("clog: recovery preempted by start or stop");
+      return;
+    }
+    recovered = true;
+    if (!config.started()) return;
+    claimed = start_locked(true /* start_from_previous_config */);
   }
+
+  uint64_t recover_start_ms = android::uptimeMillis();
+  dump_claimed_files(claimed);
+  ALOGI("clog: recovered in %" PRIu64 " ms", android::uptimeMillis() - recover_start_ms);
 }
 
 void ContinuousLogcat::start(bool start_from_previous_config) {
-  std::lock_guard<std::mutex> lock(log_lock);
+  std::vector<ClaimedFile> claimed;
+  {
+    std::lock_guard<std::mutex> lock(log_lock);
+    if (!recovered) {
+      // Resume from the previous run here rather than in recover(), which will be a no-op
+      recovered = true;
+      start_from_previous_config |= config.started();
+    }
+    claimed = start_locked(start_from_previous_config);
+  }
+  dump_claimed_files(claimed);
+}
+
+std::vector<ContinuousLogcat::ClaimedFile> ContinuousLogcat::start_locked(
+    bool start_from_previous_config) {
   ALOGT("clog: start (running=%d)", config.started());
 
-  int clog_not_empty = is_file_not_empty(CONTINUOUS_LOGCAT_FILE) > 0;
-  if (clog_not_empty) {
-    ALOGT("clog: dump to dropbox on start");
-    dump_output_to_dropbox();
+  std::vector<ClaimedFile> claimed;
+  if (!running.load(std::memory_order_acquire)) {
+    claimed = claim_leftover_files();
   }
 
   if (!config.started() || start_from_previous_config) {
-    output_fd = creat(CONTINUOUS_LOGCAT_FILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-    output_fp = fdopen(output_fd, "w");
     config.set_started(true);
     config.persist_config();
+    running.store(true, std::memory_order_release);
     std::thread run_thread(&ContinuousLogcat::run, this);
     pthread_setname_np(run_thread.native_handle(), "clog");
 
     reader_thread = std::move(run_thread);
     ALOGT("clog: new log file created, thread running");
   }
+  sync_subscriber_reader_locked();
+  return claimed;
 }
 
 void ContinuousLogcat::interrupt_reader_thread() {
@@ -80,9 +267,19 @@ void ContinuousLogcat::interrupt_reader_thread() {
 
   // Send a SIGALRM so that the blocked reader in liblog returns
   // with -EINTR, we then handle that result in the reader loop.
+  // The reader may not exist yet when called before recover().
+  if (!reader_thread.joinable()) return;
   pthread_kill(reader_thread.native_handle(), SIGALRM);
 }
 
+void ContinuousLogcat::wake_reader_thread() {
+  // Ends the current read batch: the reader picks up what was published with its next one
+  std::lock_guard<std::mutex> lock(log_lock);
+  if (running.load(std::memory_order_acquire)) {
+    interrupt_reader_thread();
+  }
+}
+
 void ContinuousLogcat::request_dump() {
   std::lock_guard<std::mutex> lock(log_lock);
   ALOGT("clog: dumping requested by external caller");
@@ -91,69 +288,309 @@ void ContinuousLogcat::request_dump() {
   }
 }
 
+void ContinuousLogcat::escalate(const std::string& reason, uint64_t duration_ms) {
+  uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  ALOGI("clog: escalation requested (%s)", reason.c_str());
+  escalation_request_duration_ms.store(duration_ms, std::memory_order_relaxed);
+  escalation_request_ms.store(now_ms, std::memory_order_release);
+}
+
 void ContinuousLogcat::stop() {
   std::lock_guard<std::mutex> lock(log_lock);
   ALOGT("clog: stop (running=%d)", config.started());
+  // Stays stopped, the previous log is dumped on the next start()
+  recovered = true;
   if (config.started()) {
     config.set_started(false);
     config.persist_config();
+    running.store(false, std::memory_order_release);
 
     interrupt_reader_thread();
+    sync_subscriber_reader_locked();
   }
 }
 
-void ContinuousLogcat::reconfigure(
-    const std::vector<std::string>& filter_specs,
-    size_t dump_threshold_bytes,
-    uint64_t dump_threshold_time_ms,
-    uint64_t dump_wrapping_timeout_ms) {
+void ContinuousLogcat::reconfigure(const ContinuousLogcatConfig& new_config) {
   std::lock_guard<std::mutex> lock(log_lock);
   ALOGT("clog: reconfiguring");
 
-  rebuild_log_format(filter_specs);
-
-  config.set_filter_specs(filter_specs);
-  config.set_dump_threshold_bytes(dump_threshold_bytes);
-  config.set_dump_threshold_time_ms(dump_threshold_time_ms);
-  config.set_dump_wrapping_timeout_ms(dump_wrapping_timeout_ms);
+  // Keep the current running state, it is controlled by start() and stop()
+  bool started = config.started();
+  config = new_config;
+  config.set_started(started);
   config.persist_config();
+
+  auto previous = snapshot.load();
+  publish_snapshot();
+  // The reader may be blocked for as long as logd takes to wrap. New filters and thresholds
+  // apply to the entries it reads then, only settings applied per batch need it woken up.
+  if (running.load(std::memory_order_acquire) && needs_new_batch(*previous, *snapshot.load())) {
+    interrupt_reader_thread();
+  }
 }
 
-void ContinuousLogcat::rebuild_log_format(const std::vector<std::string>& filter_specs) {
+void ContinuousLogcat::publish_snapshot() {
   // readers receive all the logs and decide how to format them through a log_format object
   // log_format controls:
   // - Output formats (i.e. time spec, whether to print nanoseconds, etc)
   // - Filters (i.e. do we want to print this line)
   //
-  // When reconfiguring, we rebuild the log_format object (note that this is guarded by log_lock
-  // and will remain consistent even if we are currently collecting).
-  log_format.reset(android_log_format_new());
+  // When reconfiguring, we build a new log_format object along with the thresholds and
+  // publish them as a single snapshot. The reader picks up the new snapshot before its next
+  // entry and the previous one is freed.
+  auto next = std::make_shared<ContinuousLogcatSnapshot>();
+  next->log_format.reset(android_log_format_new(), android_log_format_free);
+  set_default_print_formats(next->log_format.get());
 
-  // We current use the same log formats as the Bort periodic logcat collector.
-  auto logFormats = {
-    AndroidLogPrintFormat::FORMAT_THREADTIME,
-    AndroidLogPrintFormat::FORMAT_MODIFIER_TIME_NSEC,
-    AndroidLogPrintFormat::FORMAT_MODIFIER_PRINTABLE,
-    AndroidLogPrintFormat::FORMAT_MODIFIER_UID,
-    AndroidLogPrintFormat::FORMAT_MODIFIER_ZONE,
-    AndroidLogPrintFormat::FORMAT_MODIFIER_YEAR,
-  };
+  // add filters
+  for (auto &filter : config.filter_specs()) {
+    ALOGT("clog: filter: %s", filter.c_str());
+    android_log_addFilterRule(next->log_format.get(), filter.c_str());
+  }
 
-  // Set the timezone to UTC (i.e. same behavior as logcat when -v UTC is passed)
-  setenv("TZ", "UTC", 1);
+  // silence all other tags and levels
+  android_log_addFilterRule(next->log_format.get(), "*:S");
+
+  // Without tier specs, everything goes to the base tier. By default, each tier allows one
+  // segment being dumped while the next one fills up.
+  ClogTierConfig base;
+  base.dump_threshold_bytes = config.dump_threshold_bytes();
+  base.dump_threshold_time_ms = config.dump_threshold_time_ms();
+  base.storage_quota_bytes = config.storage_quota_bytes();
+  next->tiers = build_tiers(config.tier_specs(), base);
+  next->dump_wrapping_timeout_ms = config.dump_wrapping_timeout_ms();
+  next->dump_wrapping_timeout_min_ms = config.dump_wrapping_timeout_min_ms();
+  next->storage_low_free_bytes = config.storage_low_free_bytes();
+  next->kernel_logs = config.kernel_logs();
+  next->process_names = config.process_names();
+  next->event_metrics = config.event_metrics();
+  next->upload_budget_bytes = config.upload_budget_bytes();
+  next->upload_budget_period_ms = config.upload_budget_period_ms();
+  next->filters_hash = fnv1a(kFnvOffsetBasis, config.filter_specs());
+  next->config_hash = config_hash(config);
+
+  auto redactor = std::make_shared<const LogRedactor>(config.redaction_rules());
+  if (!redactor->empty()) {
+    next->redactor = std::move(redactor);
+  }
 
-  for (auto& format : logFormats) {
-    android_log_setPrintFormat(log_format.get(), format);
+  // The escalation filter is a full replacement. Unlike the filters above, "*:S" goes first
+  // so that a "*:<priority>" spec (the default) can override it.
+  next->escalation_log_format.reset(android_log_format_new(), android_log_format_free);
+  set_default_print_formats(next->escalation_log_format.get());
+  android_log_addFilterRule(next->escalation_log_format.get(), "*:S");
+  if (config.escalation_filter_specs().empty()) {
+    android_log_addFilterRule(next->escalation_log_format.get(), kDefaultEscalationFilterSpec);
+  }
+  for (auto &filter : config.escalation_filter_specs()) {
+    android_log_addFilterRule(next->escalation_log_format.get(), filter.c_str());
   }
+  auto escalation_triggers = std::make_shared<const EscalationTriggers>(
+      config.escalation_triggers());
+  if (!escalation_triggers->empty()) {
+    next->escalation_triggers = std::move(escalation_triggers);
+  }
+  next->escalation_duration_ms = config.escalation_duration_ms();
+  next->escalation_budget_bytes = config.escalation_budget_bytes();
 
-  // add filters
+  // Packages are resolved to uids here, once per reconfiguration
+  auto uid_filter = std::make_shared<const UidFilter>(config.uid_rules());
+  if (!uid_filter->empty()) {
+    next->uid_filter = std::move(uid_filter);
+  }
+
+  snapshot.publish(std::move(next));
+}
+
+int32_t ContinuousLogcat::add_subscriber(
+    const std::vector<std::string>& filter_specs,
+    const std::vector<std::string>& formats,
+    android::base::unique_fd sink) {
+  if (sink.get() < 0) {
+    return -1;
+  }
+
+  std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format(
+      android_log_format_new(), android_log_format_free);
+  if (formats.empty()) {
+    set_default_print_formats(format.get());
+  } else {
+    for (auto &name : formats) {
+      AndroidLogPrintFormat print_format = android_log_formatFromString(name.c_str());
+      if (print_format == FORMAT_OFF) {
+        ALOGW("clog: ignoring unknown subscriber format: %s", name.c_str());
+        continue;
+      }
+      android_log_setPrintFormat(format.get(), print_format);
+    }
+  }
+
+  // Everything else is silenced. "*:S" goes first so that a "*:<priority>" spec overrides it.
+  android_log_addFilterRule(format.get(), "*:S");
   for (auto &filter : filter_specs) {
-    ALOGT("clog: filter: %s", filter.c_str());
-    android_log_addFilterRule(log_format.get(), filter.c_str());
+    android_log_addFilterRule(format.get(), filter.c_str());
   }
 
-  // silence all other tags and levels
-  android_log_addFilterRule(log_format.get(), "*:S");
+  int32_t id;
+  {
+    std::lock_guard<std::mutex> lock(subscribers_lock);
+    id = next_subscriber_id++;
+    auto next = std::make_shared<LogSubscriberList>(*subscribers.load());
+    next->emplace_back(std::make_shared<LogSubscriber>(id, std::move(format), std::move(sink)));
+    subscribers.publish(std::move(next));
+  }
+  ALOGT("clog: added subscriber %d", id);
+  std::lock_guard<std::mutex> lock(log_lock);
+  sync_subscriber_reader_locked();
+  return id;
+}
+
+bool ContinuousLogcat::remove_subscriber(int32_t id) {
+  if (!erase_subscriber(id)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(log_lock);
+  sync_subscriber_reader_locked();
+  return true;
+}
+
+bool ContinuousLogcat::erase_subscriber(int32_t id) {
+  std::lock_guard<std::mutex> lock(subscribers_lock);
+  auto next = std::make_shared<LogSubscriberList>(*subscribers.load());
+  for (auto it = next->begin(); it != next->end(); ++it) {
+    if ((*it)->id() == id) {
+      ALOGT("clog: removing subscriber %d (dropped %" PRIu64 " lines)", id, (*it)->dropped_lines());
+      // The reader may still hold the subscriber until its next batch
+      (*it)->close();
+      next->erase(it);
+      subscribers.publish(std::move(next));
+      return true;
+    }
+  }
+  return false;
+}
+
+void ContinuousLogcat::sync_subscriber_reader_locked() {
+  bool wanted = running.load(std::memory_order_acquire) && !subscribers.load()->empty();
+  // Also joins a reader that exited after its last subscriber failed
+  if (subscriber_thread.joinable() &&
+      (!wanted || !subscribers_running.load(std::memory_order_acquire))) {
+    subscribers_running.store(false, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(subscriber_list_lock);
+#if PLATFORM_SDK_VERSION >= 30
+      auto ptr = subscriber_logger_list.get();
+      if (ptr) {
+        LogdClose(ptr);
+      }
+#endif
+    }
+    pthread_kill(subscriber_thread.native_handle(), SIGALRM);
+    subscriber_thread.join();
+    ALOGT("clog: subscriber reader stopped");
+  }
+  if (wanted && !subscriber_thread.joinable()) {
+    subscribers_running.store(true, std::memory_order_release);
+    std::thread thread(&ContinuousLogcat::run_subscribers, this);
+    pthread_setname_np(thread.native_handle(), "clog_sub");
+    subscriber_thread = std::move(thread);
+    ALOGT("clog: subscriber reader running");
+  }
+}
+
+void ContinuousLogcat::run_subscribers() {
+  std::shared_ptr<const LogSubscriberList> active_subscribers;
+  uint64_t active_subscribers_generation = 0;
+  std::shared_ptr<const ContinuousLogcatSnapshot> current;
+  uint64_t current_generation = 0;
+  std::string redacted_message;
+  std::unique_ptr<EventTagMap, decltype(&android_closeEventTagMap)> event_tag_map(
+      nullptr, &android_closeEventTagMap);
+  bool has_opened_event_tag_map = false;
+
+  auto max_retry_backoff = std::chrono::milliseconds(30000);
+  auto current_retry_backoff = std::chrono::milliseconds(1);
+
+  // Subscribers get the entries logged from now on
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  log_time last_log_time;
+  last_log_time.tv_sec = now.tv_sec;
+  last_log_time.tv_nsec = now.tv_nsec;
+
+  while (subscribers_running.load(std::memory_order_acquire)) {
+    // Blocks until entries are logged and returns them as they come, unlike the wrap mode
+    // of the continuous log reader
+    struct logger_list *list = android_logger_list_alloc_time(0 /* mode */, last_log_time,
+                                                              0 /* pid */);
+    for (auto& buffer : buffers) {
+      if (!android_logger_open(list, buffer)) {
+        ALOGE("cannot add log buffer with id %d", buffer);
+      }
+    }
+    {
+      // sync_subscriber_reader_locked() may close the logger list from another thread
+      std::lock_guard<std::mutex> lock(subscriber_list_lock);
+      subscriber_logger_list.reset(list);
+      if (!subscribers_running.load(std::memory_order_acquire)) break;
+    }
+
+    while (subscribers_running.load(std::memory_order_acquire)) {
+      struct log_msg log_msg;
+      int ret = android_logger_list_read(list, &log_msg);
+      if (ret < 0) {
+        if (ret != -EINTR && ret != -EBADF) {
+          ALOGT("clog: subscriber reader error %d, backing off for %" PRIu64 " ms", ret,
+                static_cast<uint64_t>(current_retry_backoff.count()));
+          std::this_thread::sleep_for(current_retry_backoff);
+          current_retry_backoff = std::min(current_retry_backoff * 2, max_retry_backoff);
+        }
+        break;
+      }
+      current_retry_backoff = std::chrono::milliseconds(1);
+      last_log_time.tv_sec = log_msg.entry.sec;
+      last_log_time.tv_nsec = log_msg.entry.nsec + 1;
+
+      log_id_t log_id = (log_id_t)log_msg.id();
+      if (is_binary_log(log_id) && !event_tag_map && !has_opened_event_tag_map) {
+        event_tag_map.reset(android_openEventTagMap(nullptr));
+        has_opened_event_tag_map = true;
+      }
+      AndroidLogEntry entry;
+      char binary_msg_buf[1024];
+      if (process_log_msg(log_msg, &entry, event_tag_map.get(), binary_msg_buf,
+                          sizeof(binary_msg_buf)) < 0) {
+        continue;
+      }
+
+      // Subscribers are sent what the continuous log would keep of the message
+      snapshot.refresh(current, current_generation);
+      if (current->redactor &&
+          current->redactor->redact(entry.message, entry.messageLen, redacted_message)) {
+        entry.message = redacted_message.c_str();
+        entry.messageLen = redacted_message.size();
+      }
+
+      // Decoded once for all the subscribers, which share the same AndroidLogEntry
+      subscribers.refresh(active_subscribers, active_subscribers_generation);
+      auto name = log_names.find(log_id);
+      const char *log_name = name != log_names.end() ? name->second : nullptr;
+      for (auto &subscriber : *active_subscribers) {
+        if (!subscriber->closed() && !subscriber->write(log_id, log_name, entry)) {
+          erase_subscriber(subscriber->id());
+          // Nobody left to read for: exit, the next add_subscriber() starts a new reader
+          std::lock_guard<std::mutex> lock(subscribers_lock);
+          if (subscribers.load()->empty()) {
+            subscribers_running.store(false, std::memory_order_release);
+          }
+        }
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(subscriber_list_lock);
+  subscriber_logger_list.reset();
 }
 
 void ContinuousLogcat::join() {
@@ -163,19 +600,78 @@ void ContinuousLogcat::join() {
 }
 
 void ContinuousLogcat::run() {
-  std::unordered_set<log_id_t> first_line_printed;
-  log_id_t last_printed_log_id = LOG_ID_MAX;
   log_time last_log_time;
+  ClogTierOutputs tiers;
+  WrapIntervalEstimator churn;
+  uint32_t buffer_sizes_known = 0;
 
+  std::shared_ptr<const ContinuousLogcatSnapshot> current;
+  uint64_t current_generation = 0;
   bool alarm_fired = false;
   bool dump_after_intr = false;
 
   auto max_retry_backoff = std::chrono::milliseconds(30000);
   auto current_retry_backoff = std::chrono::milliseconds(1);
 
+  // Free space only changes slowly and is only used to decide how much to shed, there
+  // is no need to check it more often than this, nor to wake up just for it.
+  sample_storage_pressure(*snapshot.load());
+  ScopedRepeatingAlarm storage_alarm(
+      [&]() {
+        return std::chrono::milliseconds(kStorageCheckIntervalMs);
+      },
+      [&]() {
+        sample_storage_pressure(*snapshot.load());
+      },
+      TimerOptions{std::chrono::milliseconds(0), false /* critical */}
+  );
+  uint8_t last_shed_level = SHED_NONE;
+  uint8_t last_budget_shed_level = SHED_NONE;
+  uint64_t budget_sample_counter = 0;
+  EscalationWindow escalation;
+  bool was_escalated = false;
+
+  auto start_escalation = [&](uint64_t start_ms, uint64_t duration_ms, const char *reason) {
+    if (duration_ms == 0) duration_ms = current->escalation_duration_ms;
+    if (escalation.trigger(start_ms, duration_ms, current->escalation_budget_bytes)) {
+      ALOGI("clog: escalating verbosity for %" PRIu64 " ms (%s)", duration_ms, reason);
+    }
+  };
+  std::string redacted_message;
+  ProcessNameCache process_names;
+  std::string annotated_message;
+  std::unique_ptr<EventTagExtractors> extractors;
+  // Events logd still holds from before the reader started were extracted by a previous run
+  EventWatermark event_watermark(CONTINUOUS_LOGCAT_EVENT_WATERMARK);
+  if (event_sink) {
+    extractors = std::make_unique<EventTagExtractors>(*event_sink);
+    event_watermark.load((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+  }
+
+  // Without logd reading the kernel log itself, kernel records are read from /dev/kmsg
+  // alongside the logd entries. They are drained as they are logged and queued until the
+  // reader gets to them, which it does early if the queue fills up.
+  KernelLogReader kernel;
+  bool logd_reads_kernel = KernelLogReader::logd_reads_kernel();
+
   ScopedRepeatingAlarm alarm(
       [&]() {
-        return std::chrono::milliseconds(config.dump_wrapping_timeout_ms());
+        auto current_snapshot = snapshot.load();
+        // As long as possible without letting logd prune unread entries
+        uint64_t interval_ms = clamp_wrap_interval_ms(
+            safe_wrap_interval_ms.load(std::memory_order_relaxed),
+            current_snapshot->dump_wrapping_timeout_min_ms,
+            current_snapshot->dump_wrapping_timeout_ms);
+        if (wrap_interval_listener) {
+          wrap_interval_listener(interval_ms);
+        }
+        // Tiers flushing sooner than that (e.g. errors) also need the reader interrupted
+        for (size_t i = 0; i + 1 < current_snapshot->tiers.size(); i++) {
+          uint64_t tier_ms = current_snapshot->tiers[i].dump_threshold_time_ms;
+          if (tier_ms != 0) interval_ms = std::min(interval_ms, tier_ms);
+        }
+        return std::chrono::milliseconds(interval_ms);
       },
       [&]() {
         ALOGT("clog: alarm was triggered");
@@ -184,17 +680,196 @@ void ContinuousLogcat::run() {
         // Send a SIGALRM so that the blocked reader in liblog returns
         // with -EINTR, we then handle that result in the reader loop.
         std::lock_guard<std::mutex> lock(log_lock);
-        if (config.started()) {
+        if (running.load(std::memory_order_acquire)) {
           interrupt_reader_thread();
         }
-      }
+      },
+      TimerOptions{std::chrono::milliseconds(kWrapAlarmWindowMs), true /* critical */}
   );
 
+  // Filters, sheds, redacts and writes a decoded entry, logd and kernel entries alike
+  auto write_entry = [&](log_id_t log_id, AndroidLogEntry& entry) {
+    // Trigger lines are written under the escalated filters themselves, requests apply from
+    // the time they were made.
+    uint64_t entry_ms = (uint64_t)entry.tv_sec * 1000 + entry.tv_nsec / 1000000;
+    if (escalation_request_ms.load(std::memory_order_relaxed) != 0) {
+      uint64_t request_ms = escalation_request_ms.exchange(0, std::memory_order_acquire);
+      if (request_ms != 0) {
+        start_escalation(request_ms, escalation_request_duration_ms.load(std::memory_order_relaxed),
+                         "request");
+      }
+    }
+    if (current->escalation_triggers) {
+      const std::string *trigger = current->escalation_triggers->match(
+          entry.tag, entry.tagLen, entry.message, entry.messageLen);
+      if (trigger != nullptr) {
+        start_escalation(entry_ms, 0, trigger->c_str());
+      }
+    }
+    bool escalated = escalation.active(entry_ms);
+    if (escalated != was_escalated) {
+      if (!escalated) ALOGI("clog: escalation ended");
+      was_escalated = escalated;
+    }
+
+    // Force-checked if line should be printed, in some android
+    // versions, the filters are not passed to the logd backend
+    // so we need to recheck them
+    // Lines of the apps captured by uid pass regardless of their tag.
+    if (!android_log_shouldPrintLine(escalated ? current->escalation_log_format.get() :
+                                                 current->log_format.get(),
+                                     std::string(entry.tag, entry.tagLen).c_str(),
+                                     entry.priority) &&
+        !(current->uid_filter && current->uid_filter->matches(entry.uid, entry.priority))) {
+      return;
+    }
+
+    ClogTierOutput& tier = *tiers[route_to_tier(current->tiers, entry.priority)];
+    ClogSegment& segment = tier.segment;
+
+    // Under storage pressure, shed the least important lines first
+    uint64_t stored_bytes = segment.bytes_written() +
+        tier.pending_bytes.load(std::memory_order_relaxed);
+    uint8_t shed_level = std::max(storage_shed_level.load(std::memory_order_relaxed),
+        quota_shed_level(stored_bytes, tier.config.storage_quota_bytes));
+    if (shed_level != last_shed_level) {
+      ALOGW("clog: storage pressure, shedding level %u -> %u", last_shed_level, shed_level);
+      last_shed_level = shed_level;
+    }
+    if (shed_level != SHED_NONE) {
+      SegmentMetadata& metadata = segment.metadata();
+      metadata.max_shed_level = std::max(metadata.max_shed_level, shed_level);
+      if (entry.priority < min_priority_for_shed_level(shed_level)) {
+        metadata.shed_lines++;
+        return;
+      }
+    }
+
+    // Running low on upload budget, cut verbosity rather than write lines that would be
+    // dropped downstream: shed priorities are only sampled, and nothing is written once the
+    // budget is spent.
+    if (upload_budget.enabled()) {
+      upload_budget.refill(android::elapsedRealtime());
+      uint8_t budget_shed_level = quota_shed_level(upload_budget.used_bytes(),
+                                                   upload_budget.budget_bytes());
+      if (budget_shed_level != last_budget_shed_level) {
+        ALOGW("clog: upload budget, shedding level %u -> %u", last_budget_shed_level,
+              budget_shed_level);
+        last_budget_shed_level = budget_shed_level;
+      }
+      if (budget_shed_level != SHED_NONE &&
+          entry.priority < min_priority_for_shed_level(budget_shed_level)) {
+        SegmentMetadata& metadata = segment.metadata();
+        metadata.max_shed_level = std::max(metadata.max_shed_level, budget_shed_level);
+        if (budget_shed_level == SHED_ALL ||
+            budget_sample_counter++ % kUploadBudgetSampleRate != 0) {
+          metadata.budget_shed_lines++;
+          return;
+        }
+        metadata.budget_sampled_lines++;
+      }
+    }
+
+    // Scrub personal data before the line reaches the disk
+    if (current->redactor &&
+        current->redactor->redact(entry.message, entry.messageLen, redacted_message)) {
+      entry.message = redacted_message.c_str();
+      entry.messageLen = redacted_message.size();
+      segment.metadata().redacted_lines++;
+    }
+
+    // Prefix the message with the name of the process that logged it
+    if (current->process_names && entry.pid > 0) {
+      const std::string *name = process_names.lookup(entry.pid, entry.uid, entry.tv_sec);
+      if (name != nullptr) {
+        annotated_message.assign("[").append(*name).append("] ")
+            .append(entry.message, entry.messageLen);
+        entry.message = annotated_message.c_str();
+        entry.messageLen = annotated_message.size();
+      }
+    }
+
+    // Add dividers identical to those of logcat
+    bool hasPrinted = true;
+    if (tier.first_line_printed.find(log_id) == tier.first_line_printed.end()) {
+      tier.first_line_printed.insert(log_id);
+      hasPrinted = false;
+    }
+
+    if (tier.last_printed_log_id != log_id) {
+      char buf[1024];
+      auto name = log_names.find(log_id);
+
+      if (name != log_names.end()) {
+        snprintf(buf, sizeof(buf), "--------- %s %s\n",
+            hasPrinted ? "switch to" : "beginning of", name->second);
+        size_t len = strlen(buf);
+        if (segment.write(buf, len)) {
+          tier.last_printed_log_id = log_id;
+          upload_budget.consume(len);
+        } else {
+          ALOGW("Failed to write separator to continuous log output");
+        }
+      }
+    }
+
+    // Print the line to the output file.
+    size_t written = segment.print(current->log_format.get(), log_id, entry);
+    upload_budget.consume(written);
+    if (escalated) {
+      escalation.consume(written);
+      segment.metadata().record_escalated_line(escalation.id(), (uint32_t)entry.tv_sec,
+                                               (uint32_t)entry.tv_nsec);
+    }
+
+    // Dump to dropbox if thresholds are reached, but if we are in a immediate collection,
+    // do this later after all lines are processed.
+    if (!dump_after_intr) {
+      dump_output(tier);
+    }
+  };
+
+  // Kernel records older than the current logd entry (or all of them when until is null)
+  // are written first so that both sources are interleaved by timestamp.
+  uint64_t kernel_lost_reported = 0;
+  auto write_kernel_entries = [&](const AndroidLogEntry *until) {
+    while (until == nullptr ? kernel.peek() != nullptr :
+        kernel.next_is_before(until->tv_sec, until->tv_nsec)) {
+      AndroidLogEntry kernel_entry = *kernel.peek();
+      write_entry(LOG_ID_KERNEL, kernel_entry);
+      kernel.pop();
+    }
+    uint64_t lost = kernel.lost_records();
+    if (lost != kernel_lost_reported) {
+      tiers.back()->segment.metadata().kernel_lost_records += lost - kernel_lost_reported;
+      kernel_lost_reported = lost;
+    }
+  };
+
+  // Configuration changes apply from the next entry
+  auto refresh_snapshot = [&]() {
+    if (snapshot.refresh(current, current_generation)) {
+      sync_tier_outputs(*current, tiers);
+      upload_budget.configure(current->upload_budget_bytes, current->upload_budget_period_ms,
+                              android::elapsedRealtime());
+    }
+  };
+
   memset(&last_log_time, 0, sizeof(last_log_time));
 
   ALOGT("clog: thread starting");
 
-  while (config.started() || dump_after_intr) {
+  while (running.load(std::memory_order_acquire) || dump_after_intr) {
+    refresh_snapshot();
+
+    if (current->kernel_logs && !logd_reads_kernel) {
+      if (!kernel.is_open() && kernel.open()) {
+        kernel.start_draining([this]() { wake_reader_thread(); });
+      }
+    } else if (kernel.is_open()) {
+      kernel.close();
+    }
+
     /**
      * Initialize the logger. This is done for each logger dump and will happen multiple times
      * during collection, once initially then once each time wrapping behavior occurs.
@@ -215,32 +890,53 @@ void ContinuousLogcat::run() {
 
     // don't block when the buffer ends (equivalent to logcat -d), this does not prevent blocking in wrapping scenarios
     int log_mode = ANDROID_LOG_NONBLOCK;
+    bool draining = dump_after_intr;
 
-    // if we are not doing an immediate dump, use wrapping behavior
-    if (!dump_after_intr) {
+    // if we are not doing an immediate dump, use wrapping behavior. Subscribers are served
+    // by their own reader (run_subscribers()).
+    if (!draining) {
       log_mode |= ANDROID_LOG_WRAP;
     }
 
+    struct logger_list *list;
     if (last_log_time.tv_sec == 0 && last_log_time.tv_nsec == 0) {
-      logger_list.reset(android_logger_list_alloc(log_mode, 0 /* tail_lines */, 0 /* pid */));
+      list = android_logger_list_alloc(log_mode, 0 /* tail_lines */, 0 /* pid */);
     } else {
-      logger_list.reset(android_logger_list_alloc_time(log_mode, last_log_time, 0 /* pid */));
+      list = android_logger_list_alloc_time(log_mode, last_log_time, 0 /* pid */);
     }
 
-
     // do this for each intended buffer
     for (auto& buffer : buffers) {
       // Add all buffers to the collection list
-      if (!android_logger_open(logger_list.get(), buffer)) {
+      struct logger *logger = android_logger_open(list, buffer);
+      if (!logger) {
         ALOGE("cannot add log buffer with id %d", buffer);
+      } else if (!(buffer_sizes_known & (1u << buffer))) {
+        long size = android_logger_get_log_size(logger);
+        if (size > 0) {
+          churn.set_buffer_size(buffer, (size_t)size);
+          buffer_sizes_known |= 1u << buffer;
+        }
       }
     }
 
+    bool missed_wake;
+    {
+      // interrupt_reader_thread() may close the logger list from another thread
+      std::lock_guard<std::mutex> lock(log_lock);
+      logger_list.reset(list);
+      // Published since the refresh above, a wake for it interrupted the previous list
+      missed_wake = snapshot.generation() != current_generation;
+    }
+    if (missed_wake) {
+      continue;
+    }
+
     bool expiry_reported = false;
-    while (config.started() || dump_after_intr) {
+    while (running.load(std::memory_order_acquire) || dump_after_intr) {
       struct log_msg log_msg;
       // Read a log entry, this will run once per log line.
-      int ret = android_logger_list_read(logger_list.get(), &log_msg);
+      int ret = android_logger_list_read(list, &log_msg);
 
       if (ret == -EAGAIN) {
         ALOGT("clog: logger_list_read returned EAGAIN, backing off for %" PRIu64 " ms",
@@ -262,8 +958,9 @@ void ContinuousLogcat::run() {
 
       if (ret < 0) {
         ALOGT("clog: error while reading: %d\n", ret);
-        if (!config.started() || alarm_fired) {
-          ALOGT("clog: interrupted via stop signal, will dump (started: %d)", config.started());
+        bool started = running.load(std::memory_order_acquire);
+        if (!started || alarm_fired) {
+          ALOGT("clog: interrupted via stop signal, will dump (started: %d)", started);
           alarm_fired = false;
           dump_after_intr = true;
         }
@@ -273,153 +970,242 @@ void ContinuousLogcat::run() {
       if ((log_mode & ANDROID_LOG_WRAP) && !expiry_reported) {
         expiry_reported = true;
       }
+      refresh_snapshot();
 
       AndroidLogEntry entry;
       char binaryMsgBuf[1024];
 
-      bool is_binary = log_msg.id() == LOG_ID_EVENTS || log_msg.id() == LOG_ID_SECURITY;
-
-#if PLATFORM_SDK_VERSION > 27
-      is_binary |= log_msg.id() == LOG_ID_STATS;
-#endif
-
-      if (is_binary) {
-        if (!event_tag_map_ && !has_opened_event_tag_map_) {
-          event_tag_map_.reset(android_openEventTagMap(nullptr));
-          has_opened_event_tag_map_ = true;
-        }
-
-#if PLATFORM_SDK_VERSION <= 29
-        int err = android_log_processBinaryLogBuffer(&log_msg.entry_v1, &entry, event_tag_map_.get(),
-                                                     binaryMsgBuf, sizeof(binaryMsgBuf));
-#else
-        int err = android_log_processBinaryLogBuffer(&log_msg.entry, &entry, event_tag_map_.get(),
-                                                     binaryMsgBuf, sizeof(binaryMsgBuf));
-#endif
-        if (err < 0) {
-          ALOGE("error processing binary line: %d\n", err);
-          continue;
-        }
-      } else {
-        // Convert the logd buffer to the more human-friendly AndroidLogEntry
-#if PLATFORM_SDK_VERSION <= 29
-        int err = android_log_processLogBuffer(&log_msg.entry_v1, &entry);
-#else
-        int err = android_log_processLogBuffer(&log_msg.entry, &entry);
-#endif
-        if (err < 0) {
-          ALOGE("error processing line: %d\n", err);
-          continue;
-        }
-
+      bool is_binary = is_binary_log((log_id_t)log_msg.id());
+      if (is_binary && !event_tag_map_ && !has_opened_event_tag_map_) {
+        event_tag_map_.reset(android_openEventTagMap(nullptr));
+        has_opened_event_tag_map_ = true;
       }
 
-      // Force-checked if line should be printed, in some android
-      // versions, the filters are not passed to the logd backend
-      // so we need to recheck them
-      if (!android_log_shouldPrintLine(log_format.get(),
-                                       std::string(entry.tag, entry.tagLen).c_str(),
-                                       entry.priority)) {
+      int err = process_log_msg(log_msg, &entry, event_tag_map_.get(), binaryMsgBuf,
+                                sizeof(binaryMsgBuf));
+      if (err < 0) {
+        ALOGE("error processing %sline: %d\n", is_binary ? "binary " : "", err);
         continue;
       }
 
-      // Add dividers identical to those of logcat
-      log_id_t log_id = (log_id_t)log_msg.entry.lid;
-      bool hasPrinted = true;
-      if (first_line_printed.find(log_id) == first_line_printed.end()) {
-        first_line_printed.insert(log_id);
-        hasPrinted = false;
-      }
-
-      if (last_printed_log_id != log_id) {
-        char buf[1024];
-        auto name = log_names.find(log_id);
-
-        if (name != log_names.end()) {
-          snprintf(buf, sizeof(buf), "--------- %s %s\n",
-              hasPrinted ? "switch to" : "beginning of", name->second);
-          auto len = strlen(buf);
-#if PLATFORM_SDK_VERSION <= 32
-          if (write(output_fd, buf, len) >= 0) {
-            total_bytes_written += len;
-            last_printed_log_id = log_id;
-            fsync(output_fd);
-          } else {
-            ALOGW("Failed to write separator to continuous log output");
-          }
-#else
-          if (fwrite(buf, 1, len, output_fp) == len) {
-            total_bytes_written += len;
-            last_printed_log_id = log_id;
-            fflush(output_fp);
-            fsync(output_fd);
-          } else {
-            ALOGW("Failed to write separator to continuous log output");
-          }
-#endif
-        }
+      // Straight from the binary payload, and whatever the filters keep
+      if (extractors && current->event_metrics && log_msg.id() == LOG_ID_EVENTS &&
+          event_watermark.advance((uint64_t)log_msg.entry.sec * 1000000000 + log_msg.entry.nsec)) {
+        extractors->process(reinterpret_cast<const uint8_t *>(log_msg.msg()), log_msg.entry.len,
+                            entry.tag, entry.tagLen,
+                            (uint64_t)log_msg.entry.sec * 1000 + log_msg.entry.nsec / 1000000);
+        event_watermark.persist(android::uptimeMillis(), kEventWatermarkPersistIntervalMs);
       }
 
-      // Print the line to the output file.
-#if PLATFORM_SDK_VERSION <= 32
-      total_bytes_written += android_log_printLogLine(log_format.get(), output_fd, &entry);
-#else
-      total_bytes_written += android_log_printLogLine(log_format.get(), output_fp, &entry);
-#endif
+      churn.record(log_msg.entry.lid, log_msg.entry.sec, log_msg.entry.nsec, (size_t)ret);
 
-      // Dump to dropbox if thresholds are reached, but if we are in a immediate collection,
-      // do this later after all lines are processed.
-      if (!dump_after_intr) {
-        dump_output();
+      if (kernel.is_open()) {
+        write_kernel_entries(&entry);
       }
+      write_entry((log_id_t)log_msg.entry.lid, entry);
 
       last_log_time.tv_sec = log_msg.entry.sec;
       last_log_time.tv_nsec = log_msg.entry.nsec + 1;
     }
 
+    churn.end_batch();
+    event_watermark.persist(android::uptimeMillis());
+    safe_wrap_interval_ms.store(churn.safe_interval_ms(), std::memory_order_relaxed);
+
     // After a dump caused by an interruption (stop or alarm) reset the dump
     // flag).
-    if (dump_after_intr && !(log_mode & ANDROID_LOG_WRAP)) {
+    if (dump_after_intr && draining) {
+      // logd is drained, catch up with the kernel log as well
+      if (kernel.is_open()) {
+        kernel.drain();
+        write_kernel_entries(nullptr);
+      }
       dump_after_intr = false;
-      bool ignore_thresholds = !config.started();
-      dump_output(ignore_thresholds);
+      bool ignore_thresholds = !running.load(std::memory_order_acquire);
+      dump_outputs(tiers, ignore_thresholds);
     }
   }
 
   ALOGT("clog: removing leftover files");
-  fclose(output_fp);
-  unlink(CONTINUOUS_LOGCAT_FILE);
+  for (auto& tier : tiers) {
+    tier->segment.close();
+    unlink(tier->segment.path().c_str());
+  }
 
   ALOGT("clog: stop");
 }
 
-void ContinuousLogcat::dump_output(bool ignore_thresholds) {
-  if (total_bytes_written == 0) return;
+void ContinuousLogcat::sync_tier_outputs(const ContinuousLogcatSnapshot& current,
+                                         ClogTierOutputs& outputs) {
+  ClogTierOutputs next;
+  for (auto& tier : current.tiers) {
+    auto it = std::find_if(outputs.begin(), outputs.end(), [&](const std::unique_ptr<ClogTierOutput>& output) {
+      return output && output->config.name == tier.name;
+    });
+    if (it != outputs.end()) {
+      next.push_back(std::move(*it));
+      next.back()->config = tier;
+    } else {
+      next.push_back(std::make_unique<ClogTierOutput>(tier, pending_bytes_for(tier.name)));
+      next.back()->segment.open();
+    }
+    next.back()->segment.set_tier(tier.name, tier.upload_priority);
+    next.back()->segment.set_config(current.filters_hash, current.config_hash,
+                                    current.redactor != nullptr);
+  }
+
+  // Send whatever the removed tiers hold
+  for (auto& output : outputs) {
+    if (!output) continue;
+    ALOGT("clog: removing tier %s", output->config.name.c_str());
+    if (output->segment.bytes_written() > 0) {
+      output->segment.finalize();
+      dump_output_to_dropbox(output->segment.path());
+    } else {
+      output->segment.close();
+    }
+    unlink(output->segment.path().c_str());
+  }
+  outputs = std::move(next);
+}
 
-  uint64_t elapsed_ms_since_last_collection = android::uptimeMillis() - last_collection_uptime_ms;
-  if (ignore_thresholds || total_bytes_written > config.dump_threshold_bytes() ||
-        elapsed_ms_since_last_collection > config.dump_threshold_time_ms()) {
-      ALOGT("clog: reached threshold (wrote %zu / %zu), time_ms (%" PRIu64 " / %" PRIu64 "), dumping",
-          total_bytes_written,
-          config.dump_threshold_bytes(),
+void ContinuousLogcat::dump_output(ClogTierOutput& output, bool ignore_thresholds) {
+  ClogSegment& segment = output.segment;
+  size_t bytes_written = segment.bytes_written();
+  if (bytes_written == 0) return;
+
+  uint64_t elapsed_ms_since_last_collection = android::uptimeMillis() - segment.created_uptime_ms();
+  if (ignore_thresholds || bytes_written > output.config.dump_threshold_bytes ||
+        elapsed_ms_since_last_collection > output.config.dump_threshold_time_ms) {
+      ALOGT("clog: %s reached threshold (wrote %zu / %zu), time_ms (%" PRIu64 " / %" PRIu64 "), dumping",
+          segment.metadata().tier.c_str(),
+          bytes_written,
+          output.config.dump_threshold_bytes,
           elapsed_ms_since_last_collection,
-          config.dump_threshold_time_ms());
-      fsync(output_fd);
-      fclose(output_fp);
-      dump_output_to_dropbox();
-      total_bytes_written = 0;
-      last_collection_uptime_ms = android::uptimeMillis();
-      output_fd = creat(CONTINUOUS_LOGCAT_FILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-      output_fp = fdopen(output_fd, "w");
+          output.config.dump_threshold_time_ms);
+      segment.finalize();
+      dump_output_to_dropbox(segment.path());
+      segment.open();
+  }
+}
+
+void ContinuousLogcat::dump_outputs(ClogTierOutputs& outputs, bool ignore_thresholds) {
+  // DropBox entries are uploaded in the order they are added
+  std::vector<ClogTierOutput*> by_priority;
+  for (auto& output : outputs) {
+    by_priority.push_back(output.get());
+  }
+  std::stable_sort(by_priority.begin(), by_priority.end(), [](ClogTierOutput *a, ClogTierOutput *b) {
+    return a->config.upload_priority < b->config.upload_priority;
+  });
+  for (auto output : by_priority) {
+    dump_output(*output, ignore_thresholds);
+  }
+}
+
+std::vector<ContinuousLogcat::ClaimedFile> ContinuousLogcat::claim_leftover_files() {
+  DIR *dir = opendir(CONTINUOUS_LOGCAT_DIR);
+  if (dir == nullptr) return {};
+
+  std::vector<ClaimedFile> leftovers;
+  std::vector<ClaimedFile> claimed;
+  size_t tier_prefix_len = strlen(kTierFilePrefix);
+  size_t pending_prefix_len = strlen(kPendingFilePrefix);
+  while (struct dirent *entry = readdir(dir)) {
+    std::string path = std::string(CONTINUOUS_LOGCAT_DIR "/") + entry->d_name;
+    if (path == CONTINUOUS_LOGCAT_FILE) {
+      leftovers.push_back({path, ""});
+    } else if (strncmp(entry->d_name, kTierFilePrefix, tier_prefix_len) == 0) {
+      leftovers.push_back({path, entry->d_name + tier_prefix_len});
+    } else if (!claimed_stale_files &&
+               strncmp(entry->d_name, kPendingFilePrefix, pending_prefix_len) == 0) {
+      // Claimed by a previous process that did not get to dump it: pending.<n>[.<tier>]
+      const char *tier = strchr(entry->d_name + pending_prefix_len, '.');
+      claimed.push_back({path, tier ? tier + 1 : ""});
+    }
+  }
+  closedir(dir);
+  claimed_stale_files = true;
+
+  for (auto& leftover : leftovers) {
+    if (is_file_not_empty(leftover.path) <= 0) {
+      unlink(leftover.path.c_str());
+      continue;
+    }
+    std::string pending;
+    struct stat pending_stats;
+    do {
+      pending = std::string(CONTINUOUS_LOGCAT_DIR "/") + kPendingFilePrefix +
+          std::to_string(next_pending_id++) + (leftover.tier.empty() ? "" : "." + leftover.tier);
+    } while (stat(pending.c_str(), &pending_stats) == 0);
+    if (rename(leftover.path.c_str(), pending.c_str()) != 0) {
+      ALOGE("clog: could not claim %s: %d", leftover.path.c_str(), errno);
+      unlink(leftover.path.c_str());
+      continue;
+    }
+    claimed.push_back({pending, leftover.tier});
+  }
+
+  // Counted against the quota of their tier until they are dumped
+  for (auto& file : claimed) {
+    struct stat file_stats;
+    if (stat(file.path.c_str(), &file_stats) == 0) {
+      file.bytes = file_stats.st_size;
+      pending_bytes_for(file.tier).fetch_add(file.bytes, std::memory_order_relaxed);
+    }
   }
+  return claimed;
 }
 
-void ContinuousLogcat::dump_output_to_dropbox() {
+void ContinuousLogcat::dump_claimed_files(const std::vector<ClaimedFile>& files) {
+  for (auto& file : files) {
+    if (file.bytes > 0) {
+      ALOGT("clog: dump leftover %s to dropbox on start", file.path.c_str());
+      uint64_t dump_start_ms = android::uptimeMillis();
+      dump_output_to_dropbox(file.path);
+      ALOGI("clog: dumped the previous log to dropbox in %" PRIu64 " ms",
+            android::uptimeMillis() - dump_start_ms);
+    }
+    unlink(file.path.c_str());
+    pending_bytes_for(file.tier).fetch_sub(file.bytes, std::memory_order_relaxed);
+  }
+}
+
+std::atomic<uint64_t>& ContinuousLogcat::pending_bytes_for(const std::string& tier) {
+  std::lock_guard<std::mutex> lock(pending_lock);
+  // Entries are never erased, their address is stable
+  return pending_bytes[tier];
+}
+
+void ContinuousLogcat::sample_storage_pressure(const ContinuousLogcatSnapshot& current) {
+  struct statvfs stats;
+  if (statvfs(CONTINUOUS_LOGCAT_DIR, &stats) != 0) {
+    ALOGW("clog: statvfs failed: %d", errno);
+    return;
+  }
+
+  uint64_t free_bytes = (uint64_t)stats.f_bavail * stats.f_frsize;
+  uint64_t low_free_bytes = current.storage_low_free_bytes;
+  if (low_free_bytes == 0) {
+    // Same default as the platform storage monitor: 5% of the filesystem, capped at 500 MB
+    low_free_bytes = std::min((uint64_t)stats.f_blocks * stats.f_frsize / 20, kDefaultStorageLowFreeBytesMax);
+  }
+
+  uint8_t level = SHED_NONE;
+  if (free_bytes < low_free_bytes / 2) {
+    level = SHED_INFO;
+  } else if (free_bytes < low_free_bytes) {
+    level = SHED_VERBOSE_DEBUG;
+  }
+  storage_shed_level.store(level, std::memory_order_relaxed);
+}
+
+void ContinuousLogcat::dump_output_to_dropbox(const std::string& path) {
   using namespace android::os;
   std::unique_ptr<DropBoxManager> dropbox(new DropBoxManager());
-  Status status = dropbox->addFile(String16(CONTINUOUS_LOGCAT_TAG), CONTINUOUS_LOGCAT_FILE, 0);
+  Status status = dropbox->addFile(String16(CONTINUOUS_LOGCAT_TAG), path, 0);
   if (!status.isOk()) {
-    ALOGE("Could not add %s to dropbox", CONTINUOUS_LOGCAT_FILE);
+    ALOGE("Could not add %s to dropbox", path.c_str());
   }
 }
 
@@ -433,11 +1219,45 @@ void ContinuousLogcatConfig::restore_config(const std::string &path) {
       if (config.has_dump_threshold_bytes()) dump_threshold_bytes_ = (size_t)config.dump_threshold_bytes();
       if (config.has_dump_threshold_time_ms()) dump_threshold_time_ms_ = (uint64_t)config.dump_threshold_time_ms();
       if (config.has_dump_wrapping_timeout_ms()) dump_wrapping_timeout_ms_ = (uint64_t)config.dump_wrapping_timeout_ms();
+      if (config.has_dump_wrapping_timeout_min_ms()) dump_wrapping_timeout_min_ms_ = config.dump_wrapping_timeout_min_ms();
+      if (config.has_storage_quota_bytes()) storage_quota_bytes_ = config.storage_quota_bytes();
+      if (config.has_storage_low_free_bytes()) storage_low_free_bytes_ = config.storage_low_free_bytes();
+      if (config.has_kernel_logs()) kernel_logs_ = config.kernel_logs();
+      if (config.has_process_names()) process_names_ = config.process_names();
+      if (config.has_event_metrics()) event_metrics_ = config.event_metrics();
+      if (config.has_upload_budget_bytes()) upload_budget_bytes_ = config.upload_budget_bytes();
+      if (config.has_upload_budget_period_ms()) upload_budget_period_ms_ = config.upload_budget_period_ms();
 
       filter_specs_.clear();
       for (int i = 0; i < config.filter_specs_size(); i++ ){
         filter_specs_.emplace_back(config.filter_specs(i).c_str());
       }
+
+      redaction_rules_.clear();
+      for (int i = 0; i < config.redaction_rules_size(); i++) {
+        redaction_rules_.emplace_back(config.redaction_rules(i));
+      }
+
+      tier_specs_.clear();
+      for (int i = 0; i < config.tier_specs_size(); i++) {
+        tier_specs_.emplace_back(config.tier_specs(i));
+      }
+
+      uid_rules_.clear();
+      for (int i = 0; i < config.uid_rules_size(); i++) {
+        uid_rules_.emplace_back(config.uid_rules(i));
+      }
+
+      if (config.has_escalation_duration_ms()) escalation_duration_ms_ = config.escalation_duration_ms();
+      if (config.has_escalation_budget_bytes()) escalation_budget_bytes_ = config.escalation_budget_bytes();
+      escalation_filter_specs_.clear();
+      for (int i = 0; i < config.escalation_filter_specs_size(); i++) {
+        escalation_filter_specs_.emplace_back(config.escalation_filter_specs(i));
+      }
+      escalation_triggers_.clear();
+      for (int i = 0; i < config.escalation_triggers_size(); i++) {
+        escalation_triggers_.emplace_back(config.escalation_triggers(i));
+      }
     } else {
       ALOGT("Unable to read persisted config at %s, keeping defaults", path.c_str());
     }
@@ -457,6 +1277,31 @@ void ContinuousLogcatConfig::persist_config(const std::string &path) {
     config.set_dump_threshold_bytes(dump_threshold_bytes_);
     config.set_dump_threshold_time_ms(dump_threshold_time_ms_);
     config.set_dump_wrapping_timeout_ms(dump_wrapping_timeout_ms_);
+    config.set_dump_wrapping_timeout_min_ms(dump_wrapping_timeout_min_ms_);
+    config.set_storage_quota_bytes(storage_quota_bytes_);
+    config.set_storage_low_free_bytes(storage_low_free_bytes_);
+    config.set_kernel_logs(kernel_logs_);
+    config.set_process_names(process_names_);
+    config.set_event_metrics(event_metrics_);
+    config.set_upload_budget_bytes(upload_budget_bytes_);
+    config.set_upload_budget_period_ms(upload_budget_period_ms_);
+    for (auto &it : redaction_rules_) {
+      config.add_redaction_rules(it);
+    }
+    for (auto &it : tier_specs_) {
+      config.add_tier_specs(it);
+    }
+    for (auto &it : uid_rules_) {
+      config.add_uid_rules(it);
+    }
+    for (auto &it : escalation_filter_specs_) {
+      config.add_escalation_filter_specs(it);
+    }
+    for (auto &it : escalation_triggers_) {
+      config.add_escalation_triggers(it);
+    }
+    config.set_escalation_duration_ms(escalation_duration_ms_);
+    config.set_escalation_budget_bytes(escalation_budget_bytes_);
 
     if (config.SerializeToOstream(&output_config)) {
       ALOGT("Config persisted to %s", path.c_str());
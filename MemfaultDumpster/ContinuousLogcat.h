@@ -1,10 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include <log/event_tag_map.h>
@@ -18,9 +21,28 @@
 #endif
 #include <utils/String16.h>
 
+#include "AtomicSnapshot.h"
+#include "ClogEscalation.h"
+#include "ClogSegment.h"
+#include "ClogTier.h"
+#include "EventTagExtractors.h"
+#include "EventWatermark.h"
+#include "KernelLogReader.h"
+#include "LogRedactor.h"
+#include "LogSubscriber.h"
+#include "ProcessNameCache.h"
+#include "UidFilter.h"
+#include "UploadBudget.h"
+#include "WrapIntervalEstimator.h"
+
 #define CONTINUOUS_LOGCAT_TAG "memfault_clog"
-#define CONTINUOUS_LOGCAT_FILE "/data/system/MemfaultDumpster/clog"
-#define CONTINUOUS_LOGCAT_CONFIG "/data/system/MemfaultDumpster/clog_config"
+// Overridden by host builds (see benchmarks/replay)
+#ifndef CONTINUOUS_LOGCAT_DIR
+#define CONTINUOUS_LOGCAT_DIR "/data/system/MemfaultDumpster"
+#endif
+#define CONTINUOUS_LOGCAT_FILE CONTINUOUS_LOGCAT_DIR "/clog"
+#define CONTINUOUS_LOGCAT_CONFIG CONTINUOUS_LOGCAT_DIR "/clog_config"
+#define CONTINUOUS_LOGCAT_EVENT_WATERMARK CONTINUOUS_LOGCAT_DIR "/clog_events"
 
 #ifdef BORT_UNDER_TEST
 #include <log/log.h>
@@ -32,6 +54,8 @@
 static constexpr size_t kDefaultDumpThresholdBytes = 25 * 1024 * 1024; // 25 MB
 static constexpr size_t kDefaultDumpThresholdTimeMs = 15 * 60 * 1000; // 15 minutes
 static constexpr size_t kDefaultDumpWrappingTimeoutMs = 15 * 60 * 1000; // 15 minutes
+static constexpr size_t kDefaultDumpWrappingTimeoutMinMs = 60 * 1000; // 1 minute
+static constexpr uint64_t kDefaultUploadBudgetPeriodMs = 24 * 60 * 60 * 1000; // 1 day
 
 namespace memfault {
 
@@ -62,61 +86,276 @@ class ContinuousLogcatConfig {
     inline size_t dump_threshold_bytes() { return dump_threshold_bytes_; }
     inline uint64_t dump_threshold_time_ms() { return dump_threshold_time_ms_; }
     inline uint64_t dump_wrapping_timeout_ms() { return dump_wrapping_timeout_ms_; }
+    inline uint64_t dump_wrapping_timeout_min_ms() { return dump_wrapping_timeout_min_ms_; }
     inline const std::vector<std::string>& filter_specs() { return filter_specs_; }
+    inline uint64_t storage_quota_bytes() { return storage_quota_bytes_; }
+    inline uint64_t storage_low_free_bytes() { return storage_low_free_bytes_; }
+    inline const std::vector<std::string>& redaction_rules() { return redaction_rules_; }
+    inline bool kernel_logs() { return kernel_logs_; }
+    inline bool process_names() { return process_names_; }
+    inline bool event_metrics() { return event_metrics_; }
+    inline const std::vector<std::string>& tier_specs() { return tier_specs_; }
+    inline uint64_t upload_budget_bytes() { return upload_budget_bytes_; }
+    inline uint64_t upload_budget_period_ms() { return upload_budget_period_ms_; }
+    inline const std::vector<std::string>& uid_rules() { return uid_rules_; }
+    inline const std::vector<std::string>& escalation_filter_specs() { return escalation_filter_specs_; }
+    inline const std::vector<std::string>& escalation_triggers() { return escalation_triggers_; }
+    inline uint64_t escalation_duration_ms() { return escalation_duration_ms_; }
+    inline uint64_t escalation_budget_bytes() { return escalation_budget_bytes_; }
 
     void set_started(bool started) { started_ = started; }
     void set_dump_threshold_bytes(size_t dump_threshold_bytes) { dump_threshold_bytes_ = dump_threshold_bytes; }
     void set_dump_threshold_time_ms(uint64_t dump_threshold_time_ms) { dump_threshold_time_ms_ = dump_threshold_time_ms; }
     void set_dump_wrapping_timeout_ms(uint64_t dump_wrapping_timeout_ms) { dump_wrapping_timeout_ms_ = dump_wrapping_timeout_ms; }
+    void set_dump_wrapping_timeout_min_ms(uint64_t dump_wrapping_timeout_min_ms) { dump_wrapping_timeout_min_ms_ = dump_wrapping_timeout_min_ms; }
     void set_filter_specs(const std::vector<std::string>& filter_specs) { filter_specs_ = filter_specs; }
+    void set_storage_quota_bytes(uint64_t storage_quota_bytes) { storage_quota_bytes_ = storage_quota_bytes; }
+    void set_storage_low_free_bytes(uint64_t storage_low_free_bytes) { storage_low_free_bytes_ = storage_low_free_bytes; }
+    void set_redaction_rules(const std::vector<std::string>& redaction_rules) { redaction_rules_ = redaction_rules; }
+    void set_kernel_logs(bool kernel_logs) { kernel_logs_ = kernel_logs; }
+    void set_process_names(bool process_names) { process_names_ = process_names; }
+    void set_event_metrics(bool event_metrics) { event_metrics_ = event_metrics; }
+    void set_tier_specs(const std::vector<std::string>& tier_specs) { tier_specs_ = tier_specs; }
+    void set_upload_budget_bytes(uint64_t upload_budget_bytes) { upload_budget_bytes_ = upload_budget_bytes; }
+    void set_upload_budget_period_ms(uint64_t upload_budget_period_ms) { upload_budget_period_ms_ = upload_budget_period_ms; }
+    void set_uid_rules(const std::vector<std::string>& uid_rules) { uid_rules_ = uid_rules; }
+    void set_escalation_filter_specs(const std::vector<std::string>& escalation_filter_specs) { escalation_filter_specs_ = escalation_filter_specs; }
+    void set_escalation_triggers(const std::vector<std::string>& escalation_triggers) { escalation_triggers_ = escalation_triggers; }
+    void set_escalation_duration_ms(uint64_t escalation_duration_ms) { escalation_duration_ms_ = escalation_duration_ms; }
+    void set_escalation_budget_bytes(uint64_t escalation_budget_bytes) { escalation_budget_bytes_ = escalation_budget_bytes; }
   private:
     bool started_;
     size_t dump_threshold_bytes_;
     uint64_t dump_threshold_time_ms_;
     uint64_t dump_wrapping_timeout_ms_;
+    // The wrap timeout adapts to the buffer churn between this and dump_wrapping_timeout_ms_
+    uint64_t dump_wrapping_timeout_min_ms_ = kDefaultDumpWrappingTimeoutMinMs;
     std::vector<std::string> filter_specs_;
+    // 0 means "use the default" for both of these
+    uint64_t storage_quota_bytes_ = 0;
+    uint64_t storage_low_free_bytes_ = 0;
+    std::vector<std::string> redaction_rules_;
+    bool kernel_logs_ = false;
+    bool process_names_ = false;
+    // See EventTagExtractors
+    bool event_metrics_ = false;
+    // See parse_tier_spec()
+    std::vector<std::string> tier_specs_;
+    // 0 for no upload budget, see UploadBudget
+    uint64_t upload_budget_bytes_ = 0;
+    uint64_t upload_budget_period_ms_ = kDefaultUploadBudgetPeriodMs;
+    // See UidFilter
+    std::vector<std::string> uid_rules_;
+    // Empty for kDefaultEscalationFilterSpec
+    std::vector<std::string> escalation_filter_specs_;
+    // See EscalationTriggers
+    std::vector<std::string> escalation_triggers_;
+    uint64_t escalation_duration_ms_ = kDefaultEscalationDurationMs;
+    uint64_t escalation_budget_bytes_ = kDefaultEscalationBudgetBytes;
+};
+
+/**
+ * How aggressively lines are dropped under storage pressure or when running out of upload
+ * budget, recorded in the segment metadata. Each level also drops everything the previous
+ * level did.
+ */
+enum ShedLevel : uint8_t {
+  SHED_NONE = 0,
+  SHED_VERBOSE_DEBUG = 1,
+  SHED_INFO = 2,
+  // Quota exhausted, nothing is written until the segment is dumped
+  SHED_ALL = 3,
+};
+
+/**
+ * Immutable configuration used by the reader thread. Reconfiguring builds and publishes a
+ * new snapshot, which the reader picks up before its next entry.
+ */
+struct ContinuousLogcatSnapshot {
+  std::shared_ptr<AndroidLogFormat> log_format;
+  // Most severe first, the last one is the base tier
+  std::vector<ClogTierConfig> tiers;
+  uint64_t dump_wrapping_timeout_ms;
+  uint64_t dump_wrapping_timeout_min_ms;
+  uint64_t storage_low_free_bytes;
+  // null when redaction is disabled
+  std::shared_ptr<const LogRedactor> redactor;
+  // null without uid rules
+  std::shared_ptr<const UidFilter> uid_filter;
+  // Filters swapped in while verbosity is escalated
+  std::shared_ptr<AndroidLogFormat> escalation_log_format;
+  // null without triggers, escalations are then only requested through escalate()
+  std::shared_ptr<const EscalationTriggers> escalation_triggers;
+  uint64_t escalation_duration_ms;
+  uint64_t escalation_budget_bytes;
+  bool kernel_logs;
+  bool process_names;
+  // Only acted on with an event sink
+  bool event_metrics;
+  // 0 bytes for no budget
+  uint64_t upload_budget_bytes;
+  uint64_t upload_budget_period_ms;
+  // Recorded in the segment headers
+  uint32_t filters_hash;
+  uint32_t config_hash;
 };
 
+using LogSubscriberList = std::vector<std::shared_ptr<LogSubscriber>>;
+
+/**
+ * The segment a tier is written to, owned by the reader thread.
+ */
+struct ClogTierOutput {
+  ClogTierOutput(const ClogTierConfig& tier_config, const std::atomic<uint64_t>& tier_pending_bytes);
+
+  ClogTierConfig config;
+  ClogSegment segment;
+  // Size of the tier's leftover segments waiting to be dumped, counted against its quota
+  const std::atomic<uint64_t>& pending_bytes;
+  // State of the logcat-style buffer dividers within the tier's output
+  std::unordered_set<log_id_t> first_line_printed;
+  log_id_t last_printed_log_id = LOG_ID_MAX;
+};
+
+using ClogTierOutputs = std::vector<std::unique_ptr<ClogTierOutput>>;
+
 class ContinuousLogcat {
   public:
-    ContinuousLogcat();
-    void reconfigure(
-        const std::vector<std::string>& filter_specs,
-        size_t dump_threshold_bytes,
-        uint64_t dump_threshold_time_ms,
-        uint64_t dump_wrapping_timeout_ms
-    );
+    /**
+     * Restores the persisted configuration without acting on it: a continuous log left over
+     * by a previous run and the reader are only taken care of by recover().
+     *
+     * @param wrap_interval_listener called with the wrap timeout each time it is applied,
+     * from the alarm thread.
+     * @param event_sink receives the metrics extracted from well-known events when
+     * event_metrics is enabled, from the reader thread. Must outlive this.
+     */
+    explicit ContinuousLogcat(std::function<void(uint64_t)> wrap_interval_listener = nullptr,
+                              EventMetricsSink *event_sink = nullptr);
+    /**
+     * Resumes logging if it was started and dumps the continuous log left over by a previous
+     * run, which may take seconds for a large leftover. Meant to run once, off the binder
+     * threads, after the service is registered. A no-op if start() or stop() got there
+     * first.
+     */
+    void recover();
+    /**
+     * Applies a new configuration, the started state of new_config is ignored. It applies
+     * from the next entry the reader reads, including the entries logd returns once it
+     * wraps. The reader is only woken up for settings it applies per read batch (kernel_logs).
+     */
+    void reconfigure(const ContinuousLogcatConfig& new_config);
 
     void start(bool start_from_previous_config = false);
     void stop();
     void join();
     void request_dump();
 
+    /**
+     * Escalates verbosity from now on, as if a trigger had matched.
+     *
+     * @param duration_ms duration of the escalation, 0 for the configured one.
+     */
+    void escalate(const std::string& reason, uint64_t duration_ms = 0);
+
+    /**
+     * Registers a subscriber that receives the entries logged from now on, filtered and
+     * formatted according to its own filter specs and formats (logcat -v names, defaulting
+     * to the continuous log format). Entries are delivered while continuous logging is
+     * started, as they are logged: subscribers share a streaming reader of their own, so
+     * that the continuous log reader keeps waiting for logd to wrap. Messages are redacted
+     * with the continuous log redaction rules. Kernel records read from /dev/kmsg are not
+     * delivered.
+     *
+     * @return the subscriber id, or -1 if it could not be registered.
+     */
+    int32_t add_subscriber(
+        const std::vector<std::string>& filter_specs,
+        const std::vector<std::string>& formats,
+        android::base::unique_fd sink
+    );
+    /**
+     * Unregisters a subscriber and closes its sink, nothing is written to it once this
+     * returns.
+     */
+    bool remove_subscriber(int32_t id);
+
    private:
+    struct ClaimedFile {
+      std::string path;
+      std::string tier;
+      uint64_t bytes = 0;
+    };
+
+    // Returns the leftover files claimed for dump_claimed_files()
+    std::vector<ClaimedFile> start_locked(bool start_from_previous_config);
     void interrupt_reader_thread();
+    void wake_reader_thread();
+    bool erase_subscriber(int32_t id);
+    // Starts or stops the subscriber reader depending on running and the subscribers
+    void sync_subscriber_reader_locked();
     void run();
-    void dump_output(bool ignore_thresholds = false);
-    void dump_output_to_dropbox();
-    void rebuild_log_format(const std::vector<std::string>& filter_specs);
+    void run_subscribers();
+    void sync_tier_outputs(const ContinuousLogcatSnapshot& current, ClogTierOutputs& outputs);
+    void dump_output(ClogTierOutput& output, bool ignore_thresholds = false);
+    void dump_outputs(ClogTierOutputs& outputs, bool ignore_thresholds);
+    void dump_output_to_dropbox(const std::string& path);
+    std::vector<ClaimedFile> claim_leftover_files();
+    void dump_claimed_files(const std::vector<ClaimedFile>& files);
+    std::atomic<uint64_t>& pending_bytes_for(const std::string& tier);
+    void publish_snapshot();
+    void sample_storage_pressure(const ContinuousLogcatSnapshot& current);
     int is_file_not_empty(const std::string &path);
 
+    // Guards config and the reader thread lifecycle. The reader thread itself only takes it
+    // to swap the logger list, it reads its configuration from snapshot.
     std::mutex log_lock;
 
     std::unique_ptr<struct logger_list, decltype(&android_logger_list_close)> logger_list;
-    std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> log_format;
     std::vector<log_id_t> buffers{};
     std::map<log_id_t, const char*> log_names;
 
     std::thread reader_thread;
-    size_t total_bytes_written;
-    uint64_t last_collection_uptime_ms;
-    int output_fd;
-    FILE *output_fp;
+    std::atomic<uint8_t> storage_shed_level{SHED_NONE};
     ContinuousLogcatConfig config;
+    std::atomic<bool> running{false};
+    // Measured by the reader, see WrapIntervalEstimator
+    std::atomic<uint64_t> safe_wrap_interval_ms{0};
+    // Pending escalate() request, ms since the epoch (0 for none), picked up by the reader
+    std::atomic<uint64_t> escalation_request_ms{0};
+    std::atomic<uint64_t> escalation_request_duration_ms{0};
+    // Owned by the reader thread. Kept across reader runs, so that stop() and start() do not
+    // refill it.
+    UploadBudget upload_budget;
+    std::function<void(uint64_t)> wrap_interval_listener;
+    EventMetricsSink *event_sink;
+    // Whether the startup recovery ran, or was preempted by start() or stop()
+    bool recovered = false;
+    // Leftover segments are claimed (renamed) under log_lock and dumped once it is released,
+    // stale claimed files are only picked up by the first start of the process
+    bool claimed_stale_files = false;
+    uint64_t next_pending_id = 0;
+    // Size of the claimed files by tier name, until they are dumped
+    std::mutex pending_lock;
+    std::map<std::string, std::atomic<uint64_t>> pending_bytes;
+    AtomicSnapshot<ContinuousLogcatSnapshot> snapshot{nullptr};
 
     std::unique_ptr<EventTagMap, decltype(&android_closeEventTagMap)> event_tag_map_{
             nullptr, &android_closeEventTagMap};
     bool has_opened_event_tag_map_ = false;
+
+    // Subscribers are added and removed (copy-on-write, serialized by subscribers_lock) from
+    // binder threads and picked up by the subscriber reader before each entry.
+    std::mutex subscribers_lock;
+    AtomicSnapshot<LogSubscriberList> subscribers{std::make_shared<const LogSubscriberList>()};
+    int32_t next_subscriber_id = 1;
+    // Started and joined under log_lock, it never takes log_lock itself
+    std::thread subscriber_thread;
+    // Cleared to stop the subscriber reader, or by the reader once it has no subscribers left
+    std::atomic<bool> subscribers_running{false};
+    // Guards subscriber_logger_list, closed from other threads to interrupt the reader
+    std::mutex subscriber_list_lock;
+    std::unique_ptr<struct logger_list, decltype(&android_logger_list_close)> subscriber_logger_list;
 };
 
 };
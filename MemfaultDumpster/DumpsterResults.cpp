@@ -0,0 +1,130 @@
+#include "DumpsterResults.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace memfault {
+
+namespace {
+
+// Fields of /proc/<pid>/stat, numbered as in proc(5)
+enum StatField : size_t {
+  STAT_STATE = 3,
+  STAT_PPID = 4,
+  STAT_MINFLT = 10,
+  STAT_MAJFLT = 12,
+  STAT_UTIME = 14,
+  STAT_STIME = 15,
+  STAT_CUTIME = 16,
+  STAT_CSTIME = 17,
+  STAT_PRIORITY = 18,
+  STAT_NICE = 19,
+  STAT_NUM_THREADS = 20,
+  STAT_STARTTIME = 22,
+  STAT_VSIZE = 23,
+  STAT_RSS = 24,
+  STAT_PROCESSOR = 39,
+};
+
+bool parse_int(std::string_view text, int64_t& value) {
+  bool negative = !text.empty() && text[0] == '-';
+  if (negative) text.remove_prefix(1);
+  if (text.empty()) return false;
+  uint64_t magnitude = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') return false;
+    magnitude = magnitude * 10 + (uint64_t)(c - '0');
+  }
+  value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+  return true;
+}
+
+void set_cpu_times(const CpuTimes& times, ProcStatProto::CpuTimesProto& proto) {
+  if (times.cpu >= 0) proto.set_cpu(times.cpu);
+  proto.set_user(times.jiffies[CPU_USER]);
+  proto.set_nice(times.jiffies[CPU_NICE]);
+  proto.set_system(times.jiffies[CPU_SYSTEM]);
+  proto.set_idle(times.jiffies[CPU_IDLE]);
+  proto.set_iowait(times.jiffies[CPU_IOWAIT]);
+  proto.set_irq(times.jiffies[CPU_IRQ]);
+  proto.set_softirq(times.jiffies[CPU_SOFTIRQ]);
+  proto.set_steal(times.jiffies[CPU_STEAL]);
+  proto.set_guest(times.jiffies[CPU_GUEST]);
+  proto.set_guest_nice(times.jiffies[CPU_GUEST_NICE]);
+}
+
+}
+
+void proc_stat_to_proto(const ProcStat& stat, ProcStatProto& proto) {
+  proto.Clear();
+  set_cpu_times(stat.total, *proto.mutable_total());
+  for (const auto& cpu : stat.cpus) {
+    set_cpu_times(cpu, *proto.add_cpus());
+  }
+  proto.set_interrupts(stat.interrupts);
+  proto.set_softirqs(stat.softirqs);
+  proto.set_context_switches(stat.context_switches);
+  proto.set_boot_time(stat.boot_time);
+  proto.set_processes(stat.processes);
+  proto.set_procs_running(stat.procs_running);
+  proto.set_procs_blocked(stat.procs_blocked);
+}
+
+// "<pid> (<comm>) <state> ..."
+bool proc_pid_stat_to_proto(uint32_t uid, std::string_view stat,
+                            std::vector<std::string_view>& fields,
+                            ProcPidStatsProto::ProcessProto& process) {
+  size_t comm_begin = stat.find(" (");
+  // The name may itself hold spaces and parentheses
+  size_t comm_end = stat.rfind(')');
+  if (comm_begin == std::string_view::npos || comm_end == std::string_view::npos ||
+      comm_end < comm_begin) {
+    return false;
+  }
+
+  int64_t pid;
+  if (!parse_int(stat.substr(0, comm_begin), pid)) {
+    return false;
+  }
+
+  // Indexed by field number, pid and comm included
+  fields.assign(STAT_STATE, std::string_view());
+  size_t p = comm_end + 1;
+  while (p < stat.size()) {
+    while (p < stat.size() && (stat[p] == ' ' || stat[p] == '\n')) p++;
+    size_t end = std::min(stat.find_first_of(" \n", p), stat.size());
+    if (end > p) fields.push_back(stat.substr(p, end - p));
+    p = end;
+  }
+  if (fields.size() <= STAT_RSS) {
+    return false;
+  }
+
+  auto number = [&](size_t field) {
+    int64_t value = 0;
+    if (field < fields.size()) parse_int(fields[field], value);
+    return value;
+  };
+  process.set_uid(uid);
+  process.set_pid((int32_t)pid);
+  process.set_comm(std::string(stat.substr(comm_begin + 2, comm_end - comm_begin - 2)));
+  process.set_state(std::string(fields[STAT_STATE]));
+  process.set_ppid((int32_t)number(STAT_PPID));
+  process.set_minflt((uint64_t)number(STAT_MINFLT));
+  process.set_majflt((uint64_t)number(STAT_MAJFLT));
+  process.set_utime((uint64_t)number(STAT_UTIME));
+  process.set_stime((uint64_t)number(STAT_STIME));
+  process.set_cutime((uint64_t)number(STAT_CUTIME));
+  process.set_cstime((uint64_t)number(STAT_CSTIME));
+  process.set_priority((int32_t)number(STAT_PRIORITY));
+  process.set_nice((int32_t)number(STAT_NICE));
+  process.set_num_threads((int32_t)number(STAT_NUM_THREADS));
+  process.set_starttime((uint64_t)number(STAT_STARTTIME));
+  process.set_vsize((uint64_t)number(STAT_VSIZE));
+  process.set_rss(number(STAT_RSS));
+  if (STAT_PROCESSOR < fields.size()) process.set_processor((int32_t)number(STAT_PROCESSOR));
+  return true;
+}
+
+}
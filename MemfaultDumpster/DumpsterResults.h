@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "DumpsterResultsProto.pb.h"
+#include "ProcStat.h"
+
+namespace memfault {
+
+/**
+ * Builds the results of IDumpster.runProtoCommand() from what the text commands read.
+ */
+
+void proc_stat_to_proto(const ProcStat& stat, ProcStatProto& proto);
+
+/**
+ * Fills process from the contents of /proc/<pid>/stat, see ProcPidScanner.
+ *
+ * @param uid the real uid of the process
+ * @param fields scratch space, reused between calls
+ * @return false if stat cannot be parsed, process may then be partially filled.
+ */
+bool proc_pid_stat_to_proto(uint32_t uid, std::string_view stat,
+                            std::vector<std::string_view>& fields,
+                            ProcPidStatsProto::ProcessProto& process);
+
+}
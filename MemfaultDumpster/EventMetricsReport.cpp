@@ -0,0 +1,49 @@
+#include "EventMetricsReport.h"
+
+namespace memfault {
+
+EventMetricsReport::EventMetricsReport() :
+    anrs_(report_.event("app_anr", true /* countInReport */)),
+    crashes_(report_.event("app_crash", true /* countInReport */)),
+    process_deaths_(report_.counter("process_deaths")),
+    low_memory_events_(report_.counter("low_memory_events")),
+    lmk_kills_(report_.counter("lmk_kills")),
+    lmk_kill_oom_adj_(report_.distribution("lmk_kill_oom_adj", {MIN, MEAN})),
+    launch_times_(report_.distribution("activity_launch_time_ms", {MIN, MAX, MEAN})) {}
+
+void EventMetricsReport::on_anr(uint64_t timestamp_ms, const std::string& package) {
+  anrs_->add(package, timestamp_ms);
+}
+
+void EventMetricsReport::on_crash(uint64_t timestamp_ms, const std::string& process) {
+  crashes_->add(process, timestamp_ms);
+}
+
+void EventMetricsReport::on_process_died(uint64_t timestamp_ms, const std::string& process) {
+  process_deaths_->increment(timestamp_ms);
+}
+
+void EventMetricsReport::on_low_memory(uint64_t timestamp_ms, int64_t num_processes) {
+  low_memory_events_->increment(timestamp_ms);
+}
+
+void EventMetricsReport::on_lmk_kill(uint64_t timestamp_ms, int64_t uid, int64_t oom_adj) {
+  lmk_kills_->increment(timestamp_ms);
+  lmk_kill_oom_adj_->record((double)oom_adj, timestamp_ms);
+}
+
+void EventMetricsReport::on_activity_launch(uint64_t timestamp_ms, const std::string& component,
+                                            int64_t launch_ms) {
+  launch_times_->record((double)launch_ms, timestamp_ms);
+}
+
+void EventMetricsReport::on_boot_progress(uint64_t timestamp_ms, const std::string& stage,
+                                          int64_t uptime_ms) {
+  auto it = boot_progress_.find(stage);
+  if (it == boot_progress_.end()) {
+    it = boot_progress_.emplace(stage, report_.numberProperty(stage + "_ms")).first;
+  }
+  it->second->update((double)uptime_ms, timestamp_ms);
+}
+
+}
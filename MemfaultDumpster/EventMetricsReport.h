@@ -0,0 +1,47 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <reporting.h>
+
+#include "EventTagExtractors.h"
+
+namespace memfault {
+
+/**
+ * Reports what the event tag extractors decode as heartbeat metrics:
+ *  - app_anr, app_crash: events carrying the package or process, counted per heartbeat
+ *  - process_deaths, low_memory_events, lmk_kills: counters
+ *  - lmk_kill_oom_adj, activity_launch_time_ms: distributions
+ *  - <boot_progress_* tag>_ms: uptime of the last boot at each stage
+ */
+class EventMetricsReport : public EventMetricsSink {
+  public:
+    EventMetricsReport();
+
+    void on_anr(uint64_t timestamp_ms, const std::string& package) override;
+    void on_crash(uint64_t timestamp_ms, const std::string& process) override;
+    void on_process_died(uint64_t timestamp_ms, const std::string& process) override;
+    void on_low_memory(uint64_t timestamp_ms, int64_t num_processes) override;
+    void on_lmk_kill(uint64_t timestamp_ms, int64_t uid, int64_t oom_adj) override;
+    void on_activity_launch(uint64_t timestamp_ms, const std::string& component,
+                            int64_t launch_ms) override;
+    void on_boot_progress(uint64_t timestamp_ms, const std::string& stage,
+                          int64_t uptime_ms) override;
+
+  private:
+    Report report_;
+    std::unique_ptr<Event> anrs_;
+    std::unique_ptr<Event> crashes_;
+    std::unique_ptr<Counter> process_deaths_;
+    std::unique_ptr<Counter> low_memory_events_;
+    std::unique_ptr<Counter> lmk_kills_;
+    std::unique_ptr<Distribution> lmk_kill_oom_adj_;
+    std::unique_ptr<Distribution> launch_times_;
+    // By tag, created as stages are seen
+    std::map<std::string, std::unique_ptr<Property<double>>> boot_progress_;
+};
+
+}
@@ -0,0 +1,167 @@
+#include "EventTagExtractors.h"
+
+#include <cstring>
+
+namespace memfault {
+
+static bool decode_value(const uint8_t *payload, size_t len, size_t& pos, EventValue& value) {
+  if (pos >= len) return false;
+  value.type = payload[pos++];
+  value.number = 0;
+  value.real = 0;
+  value.str = nullptr;
+  value.str_len = 0;
+
+  switch (value.type) {
+    case kEventTypeInt: {
+      int32_t number;
+      if (len - pos < sizeof(number)) return false;
+      memcpy(&number, payload + pos, sizeof(number));
+      pos += sizeof(number);
+      value.number = number;
+      return true;
+    }
+    case kEventTypeLong: {
+      if (len - pos < sizeof(value.number)) return false;
+      memcpy(&value.number, payload + pos, sizeof(value.number));
+      pos += sizeof(value.number);
+      return true;
+    }
+    case kEventTypeFloat: {
+      if (len - pos < sizeof(value.real)) return false;
+      memcpy(&value.real, payload + pos, sizeof(value.real));
+      pos += sizeof(value.real);
+      return true;
+    }
+    case kEventTypeString: {
+      int32_t str_len;
+      if (len - pos < sizeof(str_len)) return false;
+      memcpy(&str_len, payload + pos, sizeof(str_len));
+      pos += sizeof(str_len);
+      if (str_len < 0 || len - pos < (size_t)str_len) return false;
+      value.str = reinterpret_cast<const char *>(payload + pos);
+      value.str_len = (size_t)str_len;
+      pos += (size_t)str_len;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+int decode_event_values(const uint8_t *payload, size_t len, EventValue *values,
+                        size_t max_values) {
+  size_t pos = 0;
+  size_t count = 1;
+  if (len >= 2 && payload[0] == kEventTypeList) {
+    count = payload[1];
+    pos = 2;
+  }
+
+  size_t decoded = 0;
+  for (size_t i = 0; i < count; i++) {
+    EventValue value;
+    if (!decode_value(payload, len, pos, value)) return -1;
+    if (decoded < max_values) {
+      values[decoded++] = value;
+    }
+  }
+  return (int)decoded;
+}
+
+static inline bool tag_is(const char *name, size_t len, const char *expected) {
+  size_t expected_len = strlen(expected);
+  return len == expected_len && memcmp(name, expected, len) == 0;
+}
+
+static inline std::string to_string(const EventValue& value) {
+  return std::string(value.str, value.str_len);
+}
+
+void EventTagExtractors::process(const uint8_t *msg, size_t len, const char *tag_name,
+                                 size_t tag_name_len, uint64_t timestamp_ms) {
+  uint32_t tag_id;
+  if (len < sizeof(tag_id)) return;
+  memcpy(&tag_id, msg, sizeof(tag_id));
+
+  auto it = extractors_.find(tag_id);
+  if (it == extractors_.end()) {
+    Kind kind = KIND_NONE;
+    if (tag_name == nullptr) {
+      // Left unresolved, e.g. without an event tag map
+    } else if (tag_is(tag_name, tag_name_len, "am_anr")) {
+      kind = KIND_ANR;
+    } else if (tag_is(tag_name, tag_name_len, "am_crash")) {
+      kind = KIND_CRASH;
+    } else if (tag_is(tag_name, tag_name_len, "am_proc_died")) {
+      kind = KIND_PROC_DIED;
+    } else if (tag_is(tag_name, tag_name_len, "am_low_memory")) {
+      kind = KIND_LOW_MEMORY;
+    } else if (tag_is(tag_name, tag_name_len, "killinfo")) {
+      kind = KIND_KILLINFO;
+    } else if (tag_is(tag_name, tag_name_len, "am_activity_launch_time")) {
+      kind = KIND_LAUNCH_TIME;
+    } else if (tag_name_len > 14 && memcmp(tag_name, "boot_progress_", 14) == 0) {
+      kind = KIND_BOOT_PROGRESS;
+    }
+    it = extractors_.emplace(tag_id, Extractor{
+        kind, kind == KIND_NONE ? std::string() : std::string(tag_name, tag_name_len)}).first;
+  }
+  const Extractor& extractor = it->second;
+  if (extractor.kind == KIND_NONE) return;
+
+  EventValue values[kMaxEventValues];
+  int count = decode_event_values(msg + sizeof(tag_id), len - sizeof(tag_id), values,
+                                  kMaxEventValues);
+  if (count <= 0) return;
+
+  // Field layouts are those of the AOSP event-log-tags, newer releases append fields
+  switch (extractor.kind) {
+    case KIND_ANR:
+      // User, pid, package name, flags, reason
+      if (count >= 3 && values[2].is_string()) {
+        sink_.on_anr(timestamp_ms, to_string(values[2]));
+      }
+      break;
+    case KIND_CRASH:
+      // User, pid, process name, flags, exception, message, file, line
+      if (count >= 3 && values[2].is_string()) {
+        sink_.on_crash(timestamp_ms, to_string(values[2]));
+      }
+      break;
+    case KIND_PROC_DIED:
+      // User, pid, process name[, oom adj, proc state]
+      if (count >= 3 && values[2].is_string()) {
+        sink_.on_process_died(timestamp_ms, to_string(values[2]));
+      }
+      break;
+    case KIND_LOW_MEMORY:
+      // Number of processes
+      if (values[0].is_number()) {
+        sink_.on_low_memory(timestamp_ms, values[0].number);
+      }
+      break;
+    case KIND_KILLINFO:
+      // Pid, uid, oom adj, min oom adj, task size, kill reason, memory stats...
+      if (count >= 3 && values[1].is_number() && values[2].is_number()) {
+        sink_.on_lmk_kill(timestamp_ms, values[1].number, values[2].number);
+      }
+      break;
+    case KIND_LAUNCH_TIME:
+      // User, token, component name, time
+      if (count >= 4 && values[2].is_string() && values[3].is_number()) {
+        sink_.on_activity_launch(timestamp_ms, to_string(values[2]), values[3].number);
+      }
+      break;
+    case KIND_BOOT_PROGRESS:
+      // Uptime
+      if (values[0].is_number()) {
+        sink_.on_boot_progress(timestamp_ms, extractor.tag_name, values[0].number);
+      }
+      break;
+    case KIND_NONE:
+      break;
+  }
+}
+
+}
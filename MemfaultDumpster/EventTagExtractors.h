@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace memfault {
+
+// Value types of binary event payloads, as AndroidEventLogType
+static constexpr uint8_t kEventTypeInt = 0;
+static constexpr uint8_t kEventTypeLong = 1;
+static constexpr uint8_t kEventTypeString = 2;
+static constexpr uint8_t kEventTypeList = 3;
+static constexpr uint8_t kEventTypeFloat = 4;
+
+// Values decoded per event, the tags we extract have fewer
+static constexpr size_t kMaxEventValues = 16;
+
+/**
+ * A value of a binary event, strings point into the payload.
+ */
+struct EventValue {
+  uint8_t type;
+  // Int and long values
+  int64_t number;
+  float real;
+  const char *str;
+  size_t str_len;
+
+  inline bool is_number() const { return type == kEventTypeInt || type == kEventTypeLong; }
+  inline bool is_string() const { return type == kEventTypeString; }
+};
+
+/**
+ * Decodes the values of a binary event payload (what follows the tag id), flattening a
+ * top-level list. Values past max_values are skipped.
+ *
+ * @return the number of values decoded, or -1 if the payload is malformed.
+ */
+int decode_event_values(const uint8_t *payload, size_t len, EventValue *values, size_t max_values);
+
+/**
+ * Receives what the extractors decode, on the reader thread. Timestamps are those of the
+ * events, in ms since the epoch.
+ */
+class EventMetricsSink {
+  public:
+    virtual ~EventMetricsSink() = default;
+
+    virtual void on_anr(uint64_t timestamp_ms, const std::string& package) = 0;
+    virtual void on_crash(uint64_t timestamp_ms, const std::string& process) = 0;
+    virtual void on_process_died(uint64_t timestamp_ms, const std::string& process) = 0;
+    virtual void on_low_memory(uint64_t timestamp_ms, int64_t num_processes) = 0;
+    virtual void on_lmk_kill(uint64_t timestamp_ms, int64_t uid, int64_t oom_adj) = 0;
+    virtual void on_activity_launch(uint64_t timestamp_ms, const std::string& component,
+                                    int64_t launch_ms) = 0;
+    // stage is the tag name, e.g. boot_progress_enable_screen
+    virtual void on_boot_progress(uint64_t timestamp_ms, const std::string& stage,
+                                  int64_t uptime_ms) = 0;
+};
+
+/**
+ * Decodes well-known events from their binary payloads, without rendering them to text:
+ * am_anr, am_crash, am_proc_died, am_low_memory, killinfo (lmkd), am_activity_launch_time
+ * and boot_progress_*.
+ *
+ * Extractors are keyed by tag id. Tag ids are only resolved to names (by the event tag
+ * map, which the reader already uses to render events) the first time they are seen.
+ */
+class EventTagExtractors {
+  public:
+    explicit EventTagExtractors(EventMetricsSink& sink) : sink_(sink) {}
+
+    /**
+     * @param msg the event payload, starting with the tag id.
+     * @param tag_name the name the tag id resolves to, only read for new tag ids.
+     */
+    void process(const uint8_t *msg, size_t len, const char *tag_name, size_t tag_name_len,
+                 uint64_t timestamp_ms);
+
+  private:
+    enum Kind : uint8_t {
+      KIND_NONE,
+      KIND_ANR,
+      KIND_CRASH,
+      KIND_PROC_DIED,
+      KIND_LOW_MEMORY,
+      KIND_KILLINFO,
+      KIND_LAUNCH_TIME,
+      KIND_BOOT_PROGRESS,
+    };
+
+    struct Extractor {
+      Kind kind;
+      std::string tag_name;
+    };
+
+    EventMetricsSink& sink_;
+    std::unordered_map<uint32_t, Extractor> extractors_;
+};
+
+}
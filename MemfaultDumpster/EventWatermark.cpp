@@ -0,0 +1,54 @@
+#define LOG_TAG "mflt-clog"
+
+#include "EventWatermark.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <log/log.h>
+
+namespace memfault {
+
+EventWatermark::EventWatermark(std::string path) : path_(std::move(path)) {}
+
+void EventWatermark::load(uint64_t now_ns) {
+  uint64_t timestamp_ns = 0;
+  std::ifstream input(path_);
+  if (!(input >> timestamp_ns)) return;
+  if (timestamp_ns > now_ns) {
+    ALOGW("clog: dropping event watermark ahead of the clock");
+    return;
+  }
+  timestamp_ns_ = timestamp_ns;
+  persisted_ns_ = timestamp_ns;
+}
+
+bool EventWatermark::advance(uint64_t timestamp_ns) {
+  if (timestamp_ns <= timestamp_ns_) return false;
+  timestamp_ns_ = timestamp_ns;
+  return true;
+}
+
+void EventWatermark::persist(uint64_t now_ms, uint64_t interval_ms) {
+  if (timestamp_ns_ == persisted_ns_) return;
+  if (interval_ms != 0 && now_ms - persisted_ms_ < interval_ms) return;
+
+  // Written aside then renamed, a crash leaves either watermark but never a torn one
+  std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream output(tmp_path, std::ios::trunc);
+    output << timestamp_ns_ << "\n";
+    if (!output.flush()) {
+      ALOGE("clog: could not write %s", tmp_path.c_str());
+      return;
+    }
+  }
+  if (rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    ALOGE("clog: could not rename %s", tmp_path.c_str());
+    return;
+  }
+  persisted_ns_ = timestamp_ns_;
+  persisted_ms_ = now_ms;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace memfault {
+
+/**
+ * Timestamp of the last event handed to the event tag extractors, persisted so that the
+ * backlog logd still holds when the reader starts over (after stop() and start(), or a
+ * restart of the service) is not extracted, and counted, twice.
+ */
+class EventWatermark {
+  public:
+    explicit EventWatermark(std::string path);
+
+    /**
+     * Restores the persisted watermark. One ahead of now_ns is dropped: the clock went back
+     * and newer events would be skipped for as long.
+     */
+    void load(uint64_t now_ns);
+
+    /**
+     * Whether an event is newer than the watermark, the watermark then moves to it.
+     */
+    bool advance(uint64_t timestamp_ns);
+
+    /**
+     * Persists the watermark if it moved, at most every interval_ms unless interval_ms is 0.
+     */
+    void persist(uint64_t now_ms, uint64_t interval_ms = 0);
+
+    inline uint64_t timestamp_ns() const { return timestamp_ns_; }
+
+  private:
+    std::string path_;
+    uint64_t timestamp_ns_ = 0;
+    uint64_t persisted_ns_ = 0;
+    uint64_t persisted_ms_ = 0;
+};
+
+}
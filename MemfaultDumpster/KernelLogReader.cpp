@@ -0,0 +1,272 @@
+#define LOG_TAG "mflt-clog"
+
+#include "KernelLogReader.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android-base/properties.h>
+#include <log/log.h>
+
+namespace memfault {
+
+static constexpr const char kKernelTag[] = "kernel";
+static constexpr int64_t kClockOffsetToleranceNs = 1000000; // 1 ms
+// Records waiting for the reader, the oldest ones are dropped beyond that
+static constexpr size_t kMaxQueuedBytes = 256 * 1024;
+
+static android_LogPriority priority_from_syslog_level(int level) {
+  switch (level) {
+    case 0: // KERN_EMERG
+    case 1: // KERN_ALERT
+    case 2: // KERN_CRIT
+      return ANDROID_LOG_FATAL;
+    case 3: // KERN_ERR
+      return ANDROID_LOG_ERROR;
+    case 4: // KERN_WARNING
+      return ANDROID_LOG_WARN;
+    case 5: // KERN_NOTICE
+    case 6: // KERN_INFO
+      return ANDROID_LOG_INFO;
+    default: // KERN_DEBUG
+      return ANDROID_LOG_DEBUG;
+  }
+}
+
+static int64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+KernelLogReader::KernelLogReader(std::string path) : path_(std::move(path)) {
+  memset(&entry_, 0, sizeof(entry_));
+}
+
+KernelLogReader::~KernelLogReader() {
+  stop_draining();
+}
+
+bool KernelLogReader::logd_reads_kernel() {
+  // Mirrors logd: ro.logd.kernel defaults to on for debuggable builds unless low on RAM
+  bool default_value = android::base::GetBoolProperty("ro.debuggable", false) &&
+      !android::base::GetBoolProperty("ro.config.low_ram", false);
+  return android::base::GetBoolProperty("ro.logd.kernel", default_value);
+}
+
+bool KernelLogReader::open() {
+  if (is_open()) return true;
+
+  fd_.reset(TEMP_FAILURE_RETRY(::open(path_.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)));
+  if (!is_open()) {
+    ALOGW("clog: unable to open %s: %s", path_.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void KernelLogReader::close() {
+  stop_draining();
+  fd_.reset();
+  {
+    std::lock_guard<std::mutex> lock(drain_lock_);
+    unparsed_.clear();
+  }
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  queue_.clear();
+  queued_bytes_ = 0;
+  backlog_reported_ = false;
+  has_entry_ = false;
+}
+
+void KernelLogReader::start_draining(std::function<void()> on_backlog) {
+  if (!is_open() || drain_thread_.joinable()) return;
+
+  stop_fd_.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (stop_fd_.get() < 0) {
+    ALOGE("clog: unable to create kernel log eventfd: %s", strerror(errno));
+    return;
+  }
+  drain_thread_ = std::thread(&KernelLogReader::drain_loop, this, std::move(on_backlog));
+  pthread_setname_np(drain_thread_.native_handle(), "clog-kmsg");
+}
+
+void KernelLogReader::stop_draining() {
+  if (!drain_thread_.joinable()) return;
+
+  uint64_t one = 1;
+  (void)TEMP_FAILURE_RETRY(write(stop_fd_.get(), &one, sizeof(one)));
+  drain_thread_.join();
+  stop_fd_.reset();
+}
+
+void KernelLogReader::drain_loop(std::function<void()> on_backlog) {
+  while (true) {
+    struct pollfd pfds[] = {
+      {fd_.get(), POLLIN, 0},
+      {stop_fd_.get(), POLLIN, 0},
+    };
+    if (poll(pfds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      ALOGW("clog: error polling %s: %s", path_.c_str(), strerror(errno));
+      return;
+    }
+    if (pfds[1].revents) return;
+
+    // POLLERR only signals overwritten records, the next read reports them with EPIPE
+    if (pfds[0].revents & (POLLIN | POLLERR)) {
+      drain();
+    } else if (pfds[0].revents) {
+      ALOGW("clog: %s is gone (%d)", path_.c_str(), pfds[0].revents);
+      return;
+    }
+
+    bool report;
+    {
+      std::lock_guard<std::mutex> lock(queue_lock_);
+      report = !backlog_reported_ && queued_bytes_ > kMaxQueuedBytes / 2;
+      if (report) backlog_reported_ = true;
+    }
+    if (report && on_backlog) on_backlog();
+  }
+}
+
+void KernelLogReader::drain() {
+  std::lock_guard<std::mutex> lock(drain_lock_);
+  if (!is_open()) return;
+
+  // Suspend and wall clock changes move the offset, resample it for every drain but only
+  // adopt meaningful changes so that sampling jitter doesn't reorder consecutive records.
+  int64_t realtime_offset_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+  if (std::abs(realtime_offset_ns - realtime_offset_ns_) > kClockOffsetToleranceNs) {
+    realtime_offset_ns_ = realtime_offset_ns;
+  }
+
+  while (true) {
+    // Each read of the device returns exactly one record, a regular file may return any part
+    ssize_t len = read(fd_.get(), read_buf_, sizeof(read_buf_));
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      // Overwritten records, the next read continues at the oldest remaining one. The
+      // sequence gap accounts for what was lost.
+      if (errno == EPIPE) continue;
+      if (errno != EAGAIN) {
+        ALOGW("clog: error reading %s: %s", path_.c_str(), strerror(errno));
+      }
+      break;
+    }
+    if (len == 0) break;
+
+    unparsed_.append(read_buf_, (size_t)len);
+    parse_records(false /* at_end */);
+  }
+  parse_records(true /* at_end */);
+}
+
+void KernelLogReader::parse_records(bool at_end) {
+  // Records end with a newline that is not followed by a continuation line (" KEY=value").
+  // The last one may still be missing continuation lines, unless everything was read.
+  size_t start = 0;
+  while (start < unparsed_.size()) {
+    size_t end = start;
+    while (true) {
+      end = unparsed_.find('\n', end);
+      if (end == std::string::npos) break;
+      end++;
+      if (end == unparsed_.size() || unparsed_[end] != ' ') break;
+    }
+    if (end == std::string::npos || (end == unparsed_.size() && !at_end)) break;
+
+    Record record;
+    if (parse_record(&unparsed_[start], end - start, record)) {
+      std::lock_guard<std::mutex> lock(queue_lock_);
+      queued_bytes_ += record.message.size();
+      queue_.push_back(std::move(record));
+      while (queued_bytes_ > kMaxQueuedBytes) {
+        queued_bytes_ -= queue_.front().message.size();
+        queue_.pop_front();
+        lost_records_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    start = end;
+  }
+  unparsed_.erase(0, start);
+}
+
+bool KernelLogReader::parse_record(char *record, size_t len, Record& parsed) {
+  // <syslog prefix>,<seq>,<timestamp us>,<flags>[,...];<message>\n[ KEY=value\n]...
+  char *message = static_cast<char *>(memchr(record, ';', len));
+  if (message == nullptr) return false;
+  *message++ = '\0';
+
+  char *end;
+  unsigned long prefix = strtoul(record, &end, 10);
+  if (*end != ',') return false;
+  uint64_t seq = strtoull(end + 1, &end, 10);
+  if (*end != ',') return false;
+  uint64_t timestamp_us = strtoull(end + 1, &end, 10);
+  if (*end != ',') return false;
+
+  if (has_last_seq_) {
+    // Already read before the device was reopened
+    if (seq <= last_seq_) return false;
+    lost_records_.fetch_add(seq - last_seq_ - 1, std::memory_order_relaxed);
+  }
+  last_seq_ = seq;
+  has_last_seq_ = true;
+
+  // Drop the continuation lines (dictionary)
+  char *record_end = record + len;
+  char *message_end = static_cast<char *>(memchr(message, '\n', record_end - message));
+  if (message_end == nullptr) message_end = record_end;
+
+  parsed.realtime_ns = (int64_t)timestamp_us * 1000 + realtime_offset_ns_;
+  parsed.priority = priority_from_syslog_level(prefix & 7);
+  parsed.message.assign(message, message_end - message);
+  return true;
+}
+
+const AndroidLogEntry *KernelLogReader::peek() {
+  if (!has_entry_) {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    if (queue_.empty()) return nullptr;
+    current_ = std::move(queue_.front());
+    queue_.pop_front();
+    queued_bytes_ -= current_.message.size();
+    if (queued_bytes_ <= kMaxQueuedBytes / 2) backlog_reported_ = false;
+    has_entry_ = true;
+
+    entry_.tv_sec = current_.realtime_ns / 1000000000LL;
+    entry_.tv_nsec = current_.realtime_ns % 1000000000LL;
+    entry_.priority = current_.priority;
+    entry_.uid = 0;
+    entry_.pid = 0;
+    entry_.tid = 0;
+    entry_.tag = kKernelTag;
+    entry_.tagLen = sizeof(kKernelTag) - 1;
+    entry_.message = current_.message.c_str();
+    entry_.messageLen = current_.message.size();
+  }
+  return &entry_;
+}
+
+void KernelLogReader::pop() {
+  has_entry_ = false;
+}
+
+bool KernelLogReader::next_is_before(time_t sec, long nsec) {
+  const AndroidLogEntry *entry = peek();
+  return entry != nullptr &&
+      (entry->tv_sec < sec || (entry->tv_sec == sec && entry->tv_nsec <= nsec));
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <android-base/unique_fd.h>
+#include <log/logprint.h>
+
+#define KERNEL_LOG_DEVICE "/dev/kmsg"
+
+namespace memfault {
+
+/**
+ * Reads kernel records from /dev/kmsg and converts them to AndroidLogEntry so that they go
+ * through the same filtering, formatting and dumping as logd entries (as LOG_ID_KERNEL,
+ * tag "kernel").
+ *
+ * The kernel buffer is small and the continuous logcat reader may wait for logd to wrap
+ * for a long time, so records are drained as soon as they are logged by a thread polling
+ * the device (see start_draining()), into a bounded queue the reader consumes with peek()
+ * and pop().
+ *
+ * Records are stamped with the monotonic clock (which does not advance in suspend), they
+ * are converted to realtime with the offset between both clocks as of when they are
+ * drained, so that they can be interleaved with logd entries. Since draining is prompt,
+ * only the records logged on the way into suspend (after user space is frozen) end up
+ * shifted by the time spent suspended.
+ */
+class KernelLogReader {
+  public:
+    explicit KernelLogReader(std::string path = KERNEL_LOG_DEVICE);
+    ~KernelLogReader();
+
+    KernelLogReader(const KernelLogReader&) = delete;
+    KernelLogReader& operator=(const KernelLogReader&) = delete;
+
+    /**
+     * Opens the device, starting at the oldest record still in the kernel buffer unless
+     * records were already read from it, in which case those are skipped.
+     */
+    bool open();
+    /**
+     * Stops draining, closes the device and drops the queued records.
+     */
+    void close();
+    inline bool is_open() const { return fd_.get() >= 0; }
+
+    /**
+     * Drains the device from a background thread whenever it has records. on_backlog is
+     * called from that thread when the queue fills past half its capacity, the records
+     * should be consumed soon after.
+     */
+    void start_draining(std::function<void()> on_backlog);
+
+    /**
+     * Reads the records available now into the queue. Done by the draining thread, may
+     * also be called to catch up before consuming the queue.
+     */
+    void drain();
+
+    /**
+     * Next record, without consuming it. The entry stays valid until pop() is called.
+     */
+    const AndroidLogEntry *peek();
+    void pop();
+
+    /**
+     * Whether the next record is older than (or as old as) the given realtime timestamp.
+     */
+    bool next_is_before(time_t sec, long nsec);
+
+    // Records overwritten in the kernel buffer, or dropped from a full queue, before they
+    // could be written
+    inline uint64_t lost_records() const { return lost_records_.load(std::memory_order_relaxed); }
+
+    /**
+     * Whether logd already reads the kernel log into its kernel buffer, in which case there
+     * is no need to read /dev/kmsg as well.
+     */
+    static bool logd_reads_kernel();
+
+  private:
+    struct Record {
+      int64_t realtime_ns;
+      android_LogPriority priority;
+      std::string message;
+    };
+
+    void drain_loop(std::function<void()> on_backlog);
+    void stop_draining();
+    void parse_records(bool at_end);
+    bool parse_record(char *record, size_t len, Record& parsed);
+
+    std::string path_;
+    android::base::unique_fd fd_;
+
+    // Serializes drain(), guards what follows
+    std::mutex drain_lock_;
+    // Large enough for any record (CONSOLE_EXT_LOG_MAX), smaller reads fail with EINVAL
+    char read_buf_[8192];
+    // Read but not parsed yet, i.e. the start of a record from a regular file
+    std::string unparsed_;
+    uint64_t last_seq_ = 0;
+    bool has_last_seq_ = false;
+    int64_t realtime_offset_ns_ = 0;
+
+    // Guards the queue, between the draining thread and the reader
+    std::mutex queue_lock_;
+    std::deque<Record> queue_;
+    size_t queued_bytes_ = 0;
+    bool backlog_reported_ = false;
+
+    // Popped from the queue, returned by peek()
+    Record current_;
+    AndroidLogEntry entry_;
+    bool has_entry_ = false;
+
+    std::atomic<uint64_t> lost_records_{0};
+
+    std::thread drain_thread_;
+    android::base::unique_fd stop_fd_;
+};
+
+}
@@ -0,0 +1,329 @@
+#define LOG_TAG "mflt-clog"
+
+#include "LogRedactor.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <log/log.h>
+
+namespace memfault {
+
+enum : uint32_t {
+  REDACT_EMAIL = 1 << 0,
+  REDACT_IMEI = 1 << 1,
+  REDACT_MAC = 1 << 2,
+  REDACT_IP = 1 << 3,
+  REDACT_TOKEN = 1 << 4,
+};
+
+static const char *kDefaultTokenPrefixes[] = {
+  "Bearer ",
+  "token=",
+  "password=",
+  "passwd=",
+  "apikey=",
+  "api_key=",
+  "secret=",
+};
+
+static constexpr size_t kImeiDigits = 15;
+static constexpr size_t kMinTokenLength = 6;
+
+static inline bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+static inline bool is_alpha(char c) { return (unsigned char)((c | 0x20) - 'a') < 26; }
+static inline bool is_alnum(char c) { return is_digit(c) || is_alpha(c); }
+static inline bool is_hex(char c) { return is_digit(c) || (unsigned char)((c | 0x20) - 'a') < 6; }
+
+static inline bool is_email_local(char c) {
+  return is_alnum(c) || (c != '\0' && strchr("!#$%&'*+=?^_`{|}~.-", c) != nullptr);
+}
+
+static inline bool is_domain(char c) { return is_alnum(c) || c == '-' || c == '.'; }
+
+static inline bool is_token(char c) {
+  return is_alnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '+' || c == '/' || c == '=';
+}
+
+LogRedactor::LogRedactor(const std::vector<std::string>& rules) {
+  for (auto &rule : rules) {
+    if (rule == "email") {
+      rules_ |= REDACT_EMAIL;
+    } else if (rule == "imei") {
+      rules_ |= REDACT_IMEI;
+    } else if (rule == "mac") {
+      rules_ |= REDACT_MAC;
+    } else if (rule == "ip") {
+      rules_ |= REDACT_IP;
+    } else if (rule == "token") {
+      rules_ |= REDACT_TOKEN;
+      token_prefixes_.insert(token_prefixes_.end(),
+          std::begin(kDefaultTokenPrefixes), std::end(kDefaultTokenPrefixes));
+    } else if (rule.rfind("token:", 0) == 0 && rule.size() > 6) {
+      rules_ |= REDACT_TOKEN;
+      token_prefixes_.emplace_back(rule.substr(6));
+    } else {
+      ALOGW("clog: ignoring unknown redaction rule: %s", rule.c_str());
+    }
+  }
+
+  for (auto &prefix : token_prefixes_) {
+    if (token_anchors_.find(prefix.back()) == std::string::npos) {
+      token_anchors_.push_back(prefix.back());
+    }
+  }
+}
+
+bool LogRedactor::redact(const char *msg, size_t len, std::string& out) const {
+  if (rules_ == 0 || len == 0) return false;
+
+  // Pre-screen: a single pass without branches or table lookups so that it vectorizes.
+  // Counting into bytes over blocks of up to 255 characters keeps 16 lanes per vector.
+  size_t ats = 0, colons = 0, dots = 0, digits = 0;
+  for (size_t block = 0; block < len; block += 255) {
+    size_t block_len = std::min<size_t>(len - block, 255);
+    uint8_t block_ats = 0, block_colons = 0, block_dots = 0, block_digits = 0;
+    for (size_t i = 0; i < block_len; i++) {
+      uint8_t c = msg[block + i];
+      block_ats += c == '@';
+      block_colons += c == ':';
+      block_dots += c == '.';
+      block_digits += (uint8_t)(c - '0') < 10;
+    }
+    ats += block_ats;
+    colons += block_colons;
+    dots += block_dots;
+    digits += block_digits;
+  }
+
+  static thread_local std::vector<Span> spans;
+  spans.clear();
+
+  if ((rules_ & REDACT_EMAIL) && ats > 0 && dots > 0) find_emails(msg, len, spans);
+  if ((rules_ & REDACT_IMEI) && digits >= kImeiDigits) find_imeis(msg, len, spans);
+  if ((rules_ & REDACT_MAC) && colons >= 5) find_macs(msg, len, spans);
+  if ((rules_ & REDACT_IP) && dots >= 3 && digits >= 4) find_ipv4s(msg, len, spans);
+  if ((rules_ & REDACT_IP) && colons >= 2) find_ipv6s(msg, len, spans);
+  if (rules_ & REDACT_TOKEN) find_tokens(msg, len, spans);
+
+  if (spans.empty()) return false;
+
+  std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+    return a.start < b.start || (a.start == b.start && a.end > b.end);
+  });
+
+  out.clear();
+  size_t pos = 0;
+  for (auto &span : spans) {
+    // Overlapping matches (e.g. an IPv4 inside an email) are covered by the first one
+    if (span.start < pos) continue;
+    out.append(msg + pos, span.start - pos);
+    out.append(span.replacement);
+    pos = span.end;
+  }
+  out.append(msg + pos, len - pos);
+  return true;
+}
+
+void LogRedactor::find_emails(const char *msg, size_t len, std::vector<Span>& spans) const {
+  const char *at = msg;
+  const char *end = msg + len;
+  while ((at = static_cast<const char *>(memchr(at, '@', end - at))) != nullptr) {
+    const char *start = at;
+    while (start > msg && is_email_local(start[-1])) start--;
+
+    const char *domain_end = at + 1;
+    const char *last_dot = nullptr;
+    while (domain_end < end && is_domain(*domain_end)) {
+      if (*domain_end == '.') last_dot = domain_end;
+      domain_end++;
+    }
+    // A trailing dot ends the sentence, not the domain
+    if (last_dot != nullptr && last_dot == domain_end - 1) {
+      domain_end--;
+      last_dot = static_cast<const char *>(memrchr(at + 1, '.', domain_end - (at + 1)));
+    }
+
+    bool valid_tld = last_dot != nullptr && domain_end - last_dot > 2;
+    for (const char *c = last_dot ? last_dot + 1 : domain_end; valid_tld && c < domain_end; c++) {
+      valid_tld = is_alpha(*c);
+    }
+
+    if (start < at && last_dot != nullptr && last_dot > at + 1 && valid_tld) {
+      spans.push_back({(size_t)(start - msg), (size_t)(domain_end - msg), "{{EMAIL}}"});
+    }
+    at++;
+  }
+}
+
+void LogRedactor::find_imeis(const char *msg, size_t len, std::vector<Span>& spans) const {
+  size_t i = 0;
+  while (i < len) {
+    if (!is_digit(msg[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < len && is_digit(msg[i])) i++;
+
+    bool bounded = (start == 0 || !is_alpha(msg[start - 1])) && (i == len || !is_alpha(msg[i]));
+    if (i - start != kImeiDigits || !bounded) continue;
+
+    // Luhn check, rules out most 15 digit numbers that are not IMEIs
+    unsigned sum = 0;
+    for (size_t d = 0; d < kImeiDigits; d++) {
+      unsigned v = msg[start + d] - '0';
+      if (d % 2 == 1) {
+        v *= 2;
+        if (v > 9) v -= 9;
+      }
+      sum += v;
+    }
+    if (sum % 10 == 0) {
+      spans.push_back({start, i, "{{IMEI}}"});
+    }
+  }
+}
+
+void LogRedactor::find_macs(const char *msg, size_t len, std::vector<Span>& spans) const {
+  // xx:xx:xx:xx:xx:xx, anchored on the first colon
+  static constexpr size_t kMacLength = 17;
+  const char *end = msg + len;
+  const char *colon = msg + 2;
+  while (colon < end && (colon = static_cast<const char *>(memchr(colon, ':', end - colon))) != nullptr) {
+    size_t i = colon - 2 - msg;
+    colon++;
+    if (i + kMacLength > len || (i > 0 && (is_hex(msg[i - 1]) || msg[i - 1] == ':'))) continue;
+
+    bool match = true;
+    for (size_t j = 0; match && j < kMacLength; j++) {
+      match = (j % 3 == 2) ? msg[i + j] == ':' : is_hex(msg[i + j]);
+    }
+    size_t mac_end = i + kMacLength;
+    if (match && (mac_end == len || (!is_hex(msg[mac_end]) && msg[mac_end] != ':'))) {
+      spans.push_back({i, mac_end, "{{MAC}}"});
+      colon = msg + mac_end;
+    }
+  }
+}
+
+void LogRedactor::find_ipv4s(const char *msg, size_t len, std::vector<Span>& spans) const {
+  for (size_t i = 0; i < len; i++) {
+    if (!is_digit(msg[i]) || (i > 0 && (is_alnum(msg[i - 1]) || msg[i - 1] == '.'))) continue;
+
+    size_t pos = i;
+    int octets = 0;
+    bool valid = true;
+    while (valid && octets < 4) {
+      unsigned value = 0;
+      size_t digits = 0;
+      while (pos < len && is_digit(msg[pos]) && digits < 4) {
+        value = value * 10 + (msg[pos] - '0');
+        pos++;
+        digits++;
+      }
+      valid = digits > 0 && digits <= 3 && value <= 255;
+      octets++;
+      if (valid && octets < 4) {
+        valid = pos < len && msg[pos] == '.';
+        pos++;
+      }
+    }
+
+    if (valid && (pos == len || (!is_alnum(msg[pos]) && !(msg[pos] == '.' && pos + 1 < len && is_digit(msg[pos + 1]))))) {
+      spans.push_back({i, pos, "{{IP}}"});
+      i = pos;
+    } else {
+      // Skip the rest of this number
+      while (i + 1 < len && is_digit(msg[i + 1])) i++;
+    }
+  }
+}
+
+void LogRedactor::find_ipv6s(const char *msg, size_t len, std::vector<Span>& spans) const {
+  // Either 8 groups of hex digits, or a compressed form containing "::". Requiring hex
+  // groups avoids matching C++ scopes (android::base) and times (12:34:56).
+  const char *end = msg + len;
+  const char *colon = msg;
+  while (colon < end && (colon = static_cast<const char *>(memchr(colon, ':', end - colon))) != nullptr) {
+    // Candidates start at most 4 hex digits before their first colon
+    size_t i = colon - msg;
+    while (i > 0 && (size_t)(colon - msg) - i < 4 && is_hex(msg[i - 1])) i--;
+    colon++;
+    if (i > 0 && (is_alnum(msg[i - 1]) || msg[i - 1] == ':' || msg[i - 1] == '.')) {
+      // Skip the rest of a run such as "a:b:c" or "::" that can't start an address
+      while (colon < end && (is_hex(*colon) || *colon == ':')) colon++;
+      continue;
+    }
+
+    size_t pos = i;
+    int groups = 0;
+    int colons = 0;
+    bool compressed = false;
+    bool valid = true;
+    while (pos < len && valid) {
+      size_t digits = 0;
+      while (pos < len && is_hex(msg[pos]) && digits < 5) {
+        pos++;
+        digits++;
+      }
+      if (digits > 4) {
+        valid = false;
+        break;
+      }
+      if (digits > 0) groups++;
+      if (pos < len && msg[pos] == ':') {
+        if (pos + 1 < len && msg[pos + 1] == ':') {
+          if (compressed) {
+            valid = false;
+            break;
+          }
+          compressed = true;
+          colons++;
+          pos++;
+        }
+        colons++;
+        pos++;
+      } else {
+        break;
+      }
+    }
+    // Don't end on a single trailing colon (e.g. "addr 12ab::1: failed")
+    if (pos > i && msg[pos - 1] == ':' && !(pos >= 2 && msg[pos - 2] == ':')) pos--;
+
+    bool terminated = pos == len || !(is_alnum(msg[pos]) || msg[pos] == '.');
+    if (valid && terminated && groups >= 1 &&
+        ((groups == 8 && colons == 7) || (compressed && colons >= 2 && groups <= 7))) {
+      spans.push_back({i, pos, "{{IP}}"});
+    }
+    if (msg + pos > colon) colon = msg + pos;
+  }
+}
+
+void LogRedactor::find_tokens(const char *msg, size_t len, std::vector<Span>& spans) const {
+  // Rather than searching for every prefix, find occurrences of their last characters
+  // (mostly '=') and compare backwards from there.
+  const char *end = msg + len;
+  for (char anchor : token_anchors_) {
+    const char *found = msg;
+    while ((found = static_cast<const char *>(memchr(found, anchor, end - found))) != nullptr) {
+      const char *value = found + 1;
+      for (auto &prefix : token_prefixes_) {
+        size_t n = prefix.size();
+        if (prefix.back() != anchor || (size_t)(value - msg) < n ||
+            memcmp(value - n, prefix.data(), n) != 0) {
+          continue;
+        }
+        const char *value_end = value;
+        while (value_end < end && is_token(*value_end)) value_end++;
+        if ((size_t)(value_end - value) >= kMinTokenLength) {
+          spans.push_back({(size_t)(value - msg), (size_t)(value_end - msg), "{{TOKEN}}"});
+        }
+        break;
+      }
+      found = value;
+    }
+  }
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace memfault {
+
+/**
+ * Scrubs personal data from log messages before they are written to disk. Matches are
+ * replaced with {{EMAIL}}, {{IMEI}}, {{MAC}}, {{IP}} or {{TOKEN}}, the same placeholders
+ * Bort's DataScrubber uses.
+ *
+ * Rules are compiled from names:
+ *  - "email": email addresses
+ *  - "imei": 15 digit numbers passing the Luhn check
+ *  - "mac": colon separated MAC addresses
+ *  - "ip": IPv4 and IPv6 addresses
+ *  - "token": values following common credential prefixes (e.g. "Bearer ", "token=")
+ *  - "token:<prefix>": values following a custom prefix
+ *
+ * Every message goes through a single branch-free pre-screen pass (which the compiler
+ * vectorizes) that looks for the characters each rule needs. Most lines contain none of
+ * them and are left untouched without running any matcher.
+ */
+class LogRedactor {
+  public:
+    explicit LogRedactor(const std::vector<std::string>& rules);
+
+    inline bool empty() const { return rules_ == 0; }
+
+    /**
+     * Redacts msg into out.
+     *
+     * @return true if anything was redacted, in which case out holds the redacted message.
+     * out is left untouched otherwise.
+     */
+    bool redact(const char *msg, size_t len, std::string& out) const;
+
+  private:
+    struct Span {
+      size_t start;
+      size_t end;
+      const char *replacement;
+    };
+
+    void find_emails(const char *msg, size_t len, std::vector<Span>& spans) const;
+    void find_imeis(const char *msg, size_t len, std::vector<Span>& spans) const;
+    void find_macs(const char *msg, size_t len, std::vector<Span>& spans) const;
+    void find_ipv4s(const char *msg, size_t len, std::vector<Span>& spans) const;
+    void find_ipv6s(const char *msg, size_t len, std::vector<Span>& spans) const;
+    void find_tokens(const char *msg, size_t len, std::vector<Span>& spans) const;
+
+    uint32_t rules_ = 0;
+    std::vector<std::string> token_prefixes_;
+    // Distinct last characters of token_prefixes_
+    std::string token_anchors_;
+};
+
+}
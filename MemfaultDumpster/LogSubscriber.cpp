@@ -0,0 +1,150 @@
+#define LOG_TAG "mflt-clog"
+
+#include "LogSubscriber.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <log/log.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace memfault {
+
+LogSubscriber::LogSubscriber(
+    int32_t id,
+    std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> log_format,
+    android::base::unique_fd sink) :
+    id_(id),
+    log_format_(std::move(log_format)),
+    sink_(std::move(sink)) {
+  struct stat sink_stat;
+  is_socket_ = fstat(sink_.get(), &sink_stat) == 0 && S_ISSOCK(sink_stat.st_mode);
+}
+
+bool LogSubscriber::write(log_id_t log_id, const char *log_name, const AndroidLogEntry &entry) {
+  if (closed()) {
+    return false;
+  }
+
+  if (!android_log_shouldPrintLine(log_format_.get(),
+                                   std::string(entry.tag, entry.tagLen).c_str(),
+                                   entry.priority)) {
+    return true;
+  }
+
+  char default_buffer[512];
+  size_t len = 0;
+  char *line = android_log_formatLogLine(log_format_.get(), default_buffer, sizeof(default_buffer),
+                                         &entry, &len);
+  if (line == nullptr) {
+    return true;
+  }
+
+  WriteResult result = WriteResult::WRITTEN;
+  {
+    std::lock_guard<std::mutex> lock(sink_lock_);
+    if (sink_.get() < 0) {
+      result = WriteResult::FAILED;
+    }
+
+    // Add dividers identical to those of logcat. A line whose divider was dropped is
+    // dropped as well, it would otherwise appear under the wrong buffer.
+    if (result == WriteResult::WRITTEN && last_printed_log_id_ != log_id && log_name != nullptr) {
+      uint32_t log_id_bit = 1u << log_id;
+      char buf[64];
+      int divider_len = snprintf(buf, sizeof(buf), "--------- %s %s\n",
+          (printed_log_ids_ & log_id_bit) ? "switch to" : "beginning of", log_name);
+      result = write_line(buf, (size_t)divider_len);
+      if (result == WriteResult::WRITTEN) {
+        printed_log_ids_ |= log_id_bit;
+        last_printed_log_id_ = log_id;
+      }
+    }
+
+    if (result == WriteResult::WRITTEN) {
+      result = write_line(line, len);
+    }
+  }
+
+  if (line != default_buffer) {
+    free(line);
+  }
+  return result != WriteResult::FAILED;
+}
+
+void LogSubscriber::close() {
+  closed_.store(true, std::memory_order_release);
+  std::lock_guard<std::mutex> lock(sink_lock_);
+  sink_.reset();
+  pending_.clear();
+}
+
+LogSubscriber::WriteResult LogSubscriber::write_line(const char *buf, size_t len) {
+  // Lines are never interleaved: the end of the previous one goes first
+  if (!pending_.empty()) {
+    ssize_t written = write_available(pending_.data(), pending_.size());
+    if (written < 0) {
+      return failed();
+    }
+    pending_.erase(0, (size_t)written);
+  }
+
+  ssize_t written = pending_.empty() ? write_available(buf, len) : 0;
+  if (written < 0) {
+    return failed();
+  }
+  if (written == 0) {
+    // The subscriber is not keeping up
+    dropped_lines_.fetch_add(1, std::memory_order_relaxed);
+    return WriteResult::DROPPED;
+  }
+  if ((size_t)written < len) {
+    pending_.assign(buf + written, len - (size_t)written);
+  }
+  return WriteResult::WRITTEN;
+}
+
+LogSubscriber::WriteResult LogSubscriber::failed() {
+  ALOGW("clog: subscriber %d sink failed (%d), removing", id_, errno);
+  closed_.store(true, std::memory_order_release);
+  return WriteResult::FAILED;
+}
+
+ssize_t LogSubscriber::write_available(const char *buf, size_t len) {
+  size_t total = 0;
+  while (total < len) {
+    ssize_t written;
+    if (is_socket_) {
+      written = TEMP_FAILURE_RETRY(send(sink_.get(), buf + total, len - total,
+                                        MSG_DONTWAIT | MSG_NOSIGNAL));
+    } else {
+      // A pipe reported writable takes PIPE_BUF bytes without blocking
+      struct pollfd pfd = {sink_.get(), POLLOUT, 0};
+      int ready = TEMP_FAILURE_RETRY(poll(&pfd, 1, 0));
+      if (ready < 0) return -1;
+      if (ready == 0) break;
+      if (pfd.revents & (POLLERR | POLLNVAL)) {
+        errno = EPIPE;
+        return -1;
+      }
+      written = TEMP_FAILURE_RETRY(::write(sink_.get(), buf + total,
+                                           std::min(len - total, (size_t)PIPE_BUF)));
+    }
+    if (written < 0) {
+      // Made non-blocking by the client
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return -1;
+    }
+    total += (size_t)written;
+  }
+  return (ssize_t)total;
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <android-base/unique_fd.h>
+#include <log/logprint.h>
+#if PLATFORM_SDK_VERSION >= 26
+#include <log/log_id.h>
+#else
+#include <log/logger.h>
+#endif
+
+namespace memfault {
+
+/**
+ * A consumer of the continuous logcat subscriber reader. Each subscriber has its own filters
+ * and print format (held in an AndroidLogFormat) and a sink file descriptor. The reader
+ * decodes each log_msg once and hands the same AndroidLogEntry to every subscriber, so
+ * registering an extra consumer costs one filter check and one format per line instead
+ * of a new logd connection.
+ *
+ * The sink is written to without blocking and without changing its flags, which are
+ * shared with the client: sockets are sent to with MSG_DONTWAIT, other sinks are polled
+ * before each write of at most PIPE_BUF bytes. Only whole lines are dropped: the end of a
+ * partially written line is kept and written before any other line.
+ */
+class LogSubscriber {
+  public:
+    LogSubscriber(
+        int32_t id,
+        std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> log_format,
+        android::base::unique_fd sink);
+
+    inline int32_t id() const { return id_; }
+    inline bool closed() const { return closed_.load(std::memory_order_acquire); }
+    inline uint64_t dropped_lines() const { return dropped_lines_.load(std::memory_order_relaxed); }
+
+    /**
+     * Formats and writes the entry to the sink if it passes the subscriber filters. Lines
+     * are dropped (and counted) if the sink cannot take them without blocking, so a slow
+     * subscriber never stalls the reader.
+     *
+     * @return false if the sink is gone (e.g. the other end of the pipe was closed) and the
+     * subscriber should be removed. Once closed, the subscriber ignores further entries.
+     */
+    bool write(log_id_t log_id, const char *log_name, const AndroidLogEntry &entry);
+
+    /**
+     * Closes the sink. Nothing is written to it once this returns, including by a write()
+     * running concurrently on the reader thread.
+     */
+    void close();
+
+  private:
+    enum class WriteResult {
+      WRITTEN,
+      DROPPED,
+      FAILED,
+    };
+
+    WriteResult write_line(const char *buf, size_t len);
+    WriteResult failed();
+    // Writes as much as the sink takes without blocking, -1 on errors
+    ssize_t write_available(const char *buf, size_t len);
+
+    int32_t id_;
+    std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> log_format_;
+    log_id_t last_printed_log_id_ = LOG_ID_MAX;
+    uint32_t printed_log_ids_ = 0;
+    std::atomic<bool> closed_{false};
+    std::atomic<uint64_t> dropped_lines_{0};
+
+    // Guards the sink against close() from binder threads
+    std::mutex sink_lock_;
+    android::base::unique_fd sink_;
+    bool is_socket_ = false;
+    // End of the last line, not taken by the sink yet
+    std::string pending_;
+};
+
+}
@@ -1,10 +1,15 @@
 #define LOG_TAG "MemfaultDumpster"
 
 #include <android-base/file.h>
+#include <android-base/unique_fd.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#if PLATFORM_SDK_VERSION >= 29
+#include <binder/ParcelFileDescriptor.h>
+#endif
 #include <binder/PersistableBundle.h>
 #include <binder/ProcessState.h>
+#include <cutils/ashmem.h>
 #include <DumpstateUtil.h>
 #if PLATFORM_SDK_VERSION < 26
 #include <log/log.h>
@@ -13,19 +18,44 @@
 #endif
 #include <com/memfault/dumpster/BnDumpster.h>
 #include <com/memfault/dumpster/IDumpsterBasicCommandListener.h>
+#include <com/memfault/dumpster/IDumpsterFdCommandListener.h>
+#include <com/memfault/dumpster/IDumpsterProtoCommandListener.h>
+#include <com/memfault/dumpster/IDumpsterPropertyListener.h>
+#include <utils/SystemClock.h>
 
+#include <errno.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <dirent.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include "CommandExecutor.h"
+#include "DumpsterResults.h"
+#include "ProcPidScanner.h"
+#include "ProcessSnapshotTracker.h"
+#include "ProcStat.h"
+#include "PropertyTracker.h"
+#include "ResultCache.h"
+#include "SystemProperties.h"
 #include "android-9/file.h"
 #ifdef BORT_SUPPORTS_CLOG
+#include <reporting.h>
+
 #include "ContinuousLogcat.h"
+#include "EventMetricsReport.h"
+#include "ScopedRepeatingAlarm.h"
 #endif
 #include "storage.h"
 
@@ -40,137 +70,205 @@ using android::os::dumpstate::RunCommandToFd;
 using com::memfault::dumpster::BnDumpster;
 using com::memfault::dumpster::IDumpster;
 using com::memfault::dumpster::IDumpsterBasicCommandListener;
+using com::memfault::dumpster::IDumpsterFdCommandListener;
+using com::memfault::dumpster::IDumpsterProtoCommandListener;
+using com::memfault::dumpster::IDumpsterPropertyListener;
+
+// How AIDL maps ParcelFileDescriptor
+#if PLATFORM_SDK_VERSION >= 29
+using ParcelFd = android::os::ParcelFileDescriptor;
+static int rawFd(const ParcelFd& fd) { return fd.get().get(); }
+static ParcelFd toParcelFd(android::base::unique_fd fd) { return ParcelFd(std::move(fd)); }
+#else
+using ParcelFd = android::base::unique_fd;
+static int rawFd(const ParcelFd& fd) { return fd.get(); }
+static ParcelFd toParcelFd(android::base::unique_fd fd) { return fd; }
+#endif
+
+// Binder threads only queue commands, see CommandExecutor: more of them lets the synchronous
+// calls go through while a oneway call (which binder delivers one at a time) is handled.
+static constexpr size_t kBinderThreads = 4;
+
+// Properties are often set several at a time (e.g. at boot), changes are pushed in batches
+static constexpr auto kPropertyPushBatchDelay = std::chrono::seconds(1);
+
+// How long results that rarely change are served from the result cache. Property results are
+// also recomputed as soon as a property changes (Android 8 and up, not cached before).
+static constexpr auto kPropertyResultTtl = std::chrono::hours(1);
+static constexpr auto kStorageWearTtl = std::chrono::hours(1);
+static constexpr auto kThermalZoneTypesTtl = std::chrono::hours(1);
+
+// Result cache keys besides the CMD_ID_s of text results
+static constexpr int kProtoResultKeyBase = 1000;
+static constexpr int kThermalZoneTypesKey = -1;
 
 namespace {
-  int RunCommandToString(const std::vector<std::string>& command, std::string &output) {
+  // Commands of one lane never wait behind those of another
+  enum CommandLaneId : size_t {
+    // Property writes and small reads
+    LANE_QUICK,
+    LANE_GETPROP,
+    // Scans of every process
+    LANE_PROCFS,
+  };
+
+  std::vector<memfault::CommandLane> commandLanes() {
+    return {
+      {"quick", 2 /* concurrency */, 16 /* max_queued */},
+      {"getprop", 1, 4},
+      {"procfs", 1, 4},
+    };
+  }
+
+  int RunCommandToString(const std::vector<std::string>& command, int timeoutSec, std::string &output) {
       TemporaryFile tempFile;
       const int rv = RunCommandToFd(tempFile.fd, "", command,
-                                    CommandOptions::WithTimeout(20)
+                                    CommandOptions::WithTimeout(timeoutSec)
                                     .Always()
                                     .Build());
       android::base::ReadFileToString(tempFile.path, &output);
       return rv;
   }
 
-  std::vector<pid_t> allPids() {
-    std::vector<pid_t> pids;
-    DIR *dir = opendir("/proc");
-    if (!dir) {
-      return pids;
-    }
-    dirent *entry;
-    while ((entry = readdir(dir)) != nullptr) {
-      if (entry->d_type == DT_DIR) {
-        // we're not interested in non-numeric entries such as /proc/stat and /proc/self
-        std::string name = entry->d_name;
-        if (name.find_first_not_of("0123456789") == std::string::npos) {
-          pids.push_back(std::stoi(name));
-        }
-      }
-    }
-    closedir(dir);
-    return pids;
+  // Read on every heartbeat: the /proc fd stays open and the buffers are reused
+  struct SharedProcPidScanner {
+    std::mutex lock;
+    memfault::ProcPidScanner scanner;
+  };
+
+  SharedProcPidScanner& procPidScanner() {
+    static SharedProcPidScanner shared;
+    return shared;
+  }
+
+  int readProcPidStats(std::string& output) {
+    auto& shared = procPidScanner();
+    std::lock_guard<std::mutex> guard(shared.lock);
+    return shared.scanner.scan(output) ? 0 : -1;
   }
 
-  std::string readProcPid(int pid) {
-    std::string procPid;
-    if (!android::base::ReadFileToString("/proc/" + std::to_string(pid) + "/stat", &procPid)) {
-      // Some of these are bound to fail due to process termination between listing pids
-      // and reading their stat entry
-      return "";
+  // Same output as /system/bin/getprop, without spawning it
+  int readSystemProperties(std::string& output) {
+    memfault::format_getprop(memfault::read_system_properties(), output);
+    return 0;
+  }
+
+  int readSystemPropertyTypes(std::string& output) {
+    auto properties = memfault::read_system_properties();
+    if (!memfault::read_system_property_types(properties)) {
+      return -1;
     }
-    return procPid;
+    memfault::format_getprop(properties, output);
+    return 0;
   }
 
-  int readUid(int pid) {
-    std::string status;
-    if (!android::base::ReadFileToString("/proc/" + std::to_string(pid) + "/status", &status)) {
-        return -1;
+  enum class ProcStatFormat { FULL, SUMMARY, PROTO };
+
+  // Read on every heartbeat: the file stays open and the buffer is reused
+  int readProcStat(ProcStatFormat format, std::string& output) {
+    static std::mutex lock;
+    static memfault::ProcStatReader reader;
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::string_view text = reader.read();
+    if (text.empty()) {
+      return -1;
     }
-    /**
-     * Output format is:
-     * Name:   colord
-     * Umask:  0022
-     * State:  S (sleeping)
-     * Tgid:   6007
-     * Ngid:   0
-     * Pid:    6007
-     * PPid:   1
-     * TracerPid:      0
-     * Uid:    961     961     961     961
-     * Gid:    961     961     961     961
-     * FDSize: 256
-     * Groups: 961
-     * (...)
-     *
-     * We only care about Uid
-     */
-
-    int uid;
-    std::istringstream statusStream(status);
-    std::string line;
-    while (std::getline(statusStream, line)) {
-        if (line.find("Uid:") == 0) {
-            std::istringstream uidStream(line);
-
-            // consume the label
-            std::string uidLabel;
-            uidStream >> uidLabel;
-
-            // consume the first value (ruid)
-            uidStream >> uid;
-            return uid;
-        }
+    if (format == ProcStatFormat::FULL) {
+      output.assign(text);
+      return 0;
+    }
+    memfault::ProcStat stat;
+    if (!memfault::parse_proc_stat(text, stat)) {
+      return -1;
     }
+    if (format == ProcStatFormat::SUMMARY) {
+      memfault::format_proc_stat_summary(stat, output);
+      return 0;
+    }
+    memfault::ProcStatProto proto;
+    memfault::proc_stat_to_proto(stat, proto);
+    return proto.SerializeToString(&output) ? 0 : -1;
+  }
 
-    return -1;
+  int readProcPidStatsProto(std::string& output) {
+    auto& shared = procPidScanner();
+    std::lock_guard<std::mutex> guard(shared.lock);
+    memfault::ProcPidStatsProto proto;
+    if (!shared.scanner.scan(proto)) {
+      return -1;
+    }
+    return proto.SerializeToString(&output) ? 0 : -1;
   }
 
-  int readProcPidStats(std::string& output) {
-    std::stringstream buffer;
-    for (int pid : allPids()) {
-      int uid = readUid(pid);
-      if (uid == -1) {
-        continue;
+  struct ThermalZone {
+    std::string type;
+    std::string temp;
+  };
+
+  // The zones and their types, cached: only temperatures are read on every call
+  std::vector<ThermalZone> readThermalZones(memfault::ResultCache& cache) {
+    std::string types;
+    cache.get(kThermalZoneTypesKey,
+              std::chrono::duration_cast<std::chrono::milliseconds>(kThermalZoneTypesTtl).count(),
+              0 /* version */, (uint64_t)android::elapsedRealtime(), [](std::string& output) {
+      std::stringstream buffer;
+      DIR* dir = opendir("/sys/class/thermal");
+      if (!dir) {
+          // /sys/class/thermal may not exist or may be unreadable on some devices/SELinux configs.
+          // Treat as "no data" rather than an error to avoid noisy logs in steady state.
+          output = "";
+          return 0;
       }
-      std::string procPid = readProcPid(pid);
-      if (!procPid.empty()) {
-        buffer << uid << " " << procPid << std::endl;
+      dirent* entry;
+      while ((entry = readdir(dir)) != nullptr) {
+          std::string name = entry->d_name;
+          if (name.find("thermal_zone") != 0) {
+              continue;
+          }
+          std::string zoneType;
+          if (!android::base::ReadFileToString("/sys/class/thermal/" + name + "/type", &zoneType)) continue;
+          if (!zoneType.empty() && zoneType.back() == '\n') zoneType.pop_back();
+          if (zoneType.empty()) continue;
+          buffer << name << "\t" << zoneType << "\n";
       }
+      closedir(dir);
+      output = buffer.str();
+      return 0;
+    }, types);
+
+    std::vector<ThermalZone> zones;
+    std::istringstream lines(types);
+    std::string name, zoneType;
+    while (std::getline(lines, name, '\t') && std::getline(lines, zoneType)) {
+        std::string zoneTemp;
+        if (!android::base::ReadFileToString("/sys/class/thermal/" + name + "/temp", &zoneTemp)) continue;
+        if (!zoneTemp.empty() && zoneTemp.back() == '\n') zoneTemp.pop_back();
+        if (zoneTemp.empty()) continue;
+        zones.push_back(ThermalZone{zoneType, std::move(zoneTemp)});
     }
-    output = buffer.str();
-    return 0;
+    return zones;
   }
 
-  int readSysfsThermalZones(std::string& output) {
+  int readSysfsThermalZones(memfault::ResultCache& cache, std::string& output) {
     std::stringstream buffer;
-    DIR* dir = opendir("/sys/class/thermal");
-    if (!dir) {
-        // /sys/class/thermal may not exist or may be unreadable on some devices/SELinux configs.
-        // Treat as "no data" rather than an error to avoid noisy logs in steady state.
-        output = "";
-        return 0;
-    }
-    dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        std::string name = entry->d_name;
-        if (name.find("thermal_zone") != 0) {
-            continue;
-        }
-        std::string base = "/sys/class/thermal/" + name + "/";
-        std::string zoneType, zoneTemp;
-        if (!android::base::ReadFileToString(base + "type", &zoneType)) continue;
-        if (!android::base::ReadFileToString(base + "temp", &zoneTemp)) continue;
-        if (!zoneType.empty() && zoneType.back() == '\n') zoneType.pop_back();
-        if (!zoneTemp.empty() && zoneTemp.back() == '\n') zoneTemp.pop_back();
-        if (zoneType.empty() || zoneTemp.empty()) continue;
-        buffer << zoneType << "\t" << zoneTemp << "\n";
+    for (const auto& zone : readThermalZones(cache)) {
+        buffer << zone.type << "\t" << zone.temp << "\n";
     }
-    closedir(dir);
     output = buffer.str();
     return 0;
   }
 
+  int readSysfsThermalZonesProto(memfault::ResultCache& cache, std::string& output) {
+    memfault::ThermalZonesProto proto;
+    for (const auto& zone : readThermalZones(cache)) {
+        auto *zoneProto = proto.add_zones();
+        zoneProto->set_type(zone.type);
+        zoneProto->set_temp(strtoll(zone.temp.c_str(), nullptr, 10));
+    }
+    return proto.SerializeToString(&output) ? 0 : -1;
+  }
+
   int readStorageWear(std::string& output) {
     memfault::jedec_storage_info info;
 
@@ -184,13 +282,59 @@ namespace {
     return 0;
   }
 
+  int readStorageWearProto(std::string& output) {
+    memfault::jedec_storage_info info;
+
+    if (!get_storage_info(info)) {
+      return -1;
+    }
+
+    memfault::StorageWearProto proto;
+    proto.set_eol(info.eol);
+    proto.set_lifetime_a(info.lifetimeA);
+    proto.set_lifetime_b(info.lifetimeB);
+    proto.set_source(info.source);
+    proto.set_version(info.version);
+    return proto.SerializeToString(&output) ? 0 : -1;
+  }
+
   class DumpsterService : public BnDumpster {
         public:
 #ifdef BORT_SUPPORTS_CLOG
-        DumpsterService() : clog(new memfault::ContinuousLogcat()) {
+        DumpsterService()
+          : wrapIntervalMetric(report.distribution("clog_wrap_interval_ms", {MIN, MAX, MEAN},
+                                                   true /* internal */)),
+            clog(new memfault::ContinuousLogcat([this](uint64_t intervalMs) {
+              wrapIntervalMetric->record((double)intervalMs);
+            }, &eventMetrics)),
+            timerWakeupsMetric(report.counter("dumpster_timer_wakeups", true /* sumInReport */, true /* internal */)),
+            timerWakeupsAvoidedMetric(
+                report.counter("dumpster_timer_wakeups_avoided", true /* sumInReport */, true /* internal */)),
+            commandTimeoutsMetric(report.counter("dumpster_command_timeouts", true /* sumInReport */, true /* internal */)),
+            commandRejectionsMetric(
+                report.counter("dumpster_command_rejections", true /* sumInReport */, true /* internal */)),
+            commandQueueDepthMetrics(commandQueueDepthDistributions(report)),
+            resultCacheHitsMetric(
+                report.counter("dumpster_result_cache_hits", true /* sumInReport */, true /* internal */)),
+            resultCacheMissesMetric(
+                report.counter("dumpster_result_cache_misses", true /* sumInReport */, true /* internal */)),
+            propertyTracker(std::random_device()()),
+            processSnapshots(std::random_device()(),
+                             [](std::string& output) { return readProcPidStats(output) == 0; }),
+            executor(commandLanes(), [this](size_t lane, size_t queueDepth) {
+              commandQueueDepthMetrics[lane]->record((double)queueDepth);
+            }),
+            metricsAlarm(
+                []() { return std::chrono::hours(1); },
+                [this]() { reportServiceMetrics(); },
+                memfault::TimerOptions{std::chrono::hours(1), true /* critical */}) {
         }
 #else
-        DumpsterService() {
+        DumpsterService()
+          : propertyTracker(std::random_device()()),
+            processSnapshots(std::random_device()(),
+                             [](std::string& output) { return readProcPidStats(output) == 0; }),
+            executor(commandLanes()) {
         }
 #endif
 
@@ -201,62 +345,244 @@ namespace {
 
         using CommandFunc = std::function<int(std::string&)>;
 
+        struct Command {
+          // null if unsupported
+          CommandFunc func;
+          size_t lane;
+          // Counted from the call, queueing included
+          std::chrono::milliseconds timeout;
+        };
+
         android::binder::Status runBasicCommand(
             int cmdId, const android::sp<IDumpsterBasicCommandListener> &listener) override {
-            auto commandFunc = commandFuncForId(cmdId);
-            if (!commandFunc) {
+            bool supported = submitCommand(cmdId, commandForId(cmdId),
+              [listener](int rv, const std::string &output) { reportFinished(listener, rv, output); },
+              [listener](int error) { reportFinished(listener, error, ""); });
+            if (!supported) {
+              listener->onUnsupported();
+            }
+            return android::binder::Status::ok();
+        }
+
+        android::binder::Status runBasicCommandToFd(
+            int cmdId, const android::sp<IDumpsterFdCommandListener> &listener) override {
+            bool supported = submitCommand(cmdId, commandForId(cmdId),
+              [listener, cmdId](int rv, const std::string &output) {
+                android::base::unique_fd fd = sharedMemoryCopy(output);
+                if (fd < 0) {
+                  ALOGE("Command %d: failed to share %zu bytes: %d", cmdId, output.size(), errno);
+                  listener->onFailed(-ENOMEM);
+                  return;
+                }
+                listener->onFinished(rv, toParcelFd(std::move(fd)), (int64_t)output.size());
+              },
+              [listener](int error) { listener->onFailed(error); });
+            if (!supported) {
+              listener->onUnsupported();
+            }
+            return android::binder::Status::ok();
+        }
+
+        android::binder::Status runProtoCommand(
+            int cmdId, const android::sp<IDumpsterProtoCommandListener> &listener) override {
+            bool supported = submitCommand(cmdId, protoCommandForId(cmdId),
+              [listener](int rv, const std::string &output) {
+                listener->onFinished(rv, std::vector<uint8_t>(rv == 0 ? output.begin() : output.end(),
+                                                              output.end()));
+              },
+              [listener](int error) { listener->onFinished(error, {}); });
+            if (!supported) {
               listener->onUnsupported();
-            } else {
-              std::string output;
-              const int rv = commandFunc(output);
+            }
+            return android::binder::Status::ok();
+        }
+
+        /**
+         * Runs the command on its lane, then calls finished with its status code and output, or
+         * failed if it timed out or could not be queued.
+         *
+         * @return false if the command is not supported.
+         */
+        bool submitCommand(int cmdId, Command command,
+                           std::function<void(int, const std::string &)> finished,
+                           std::function<void(int)> failed) {
+            if (!command.func) {
+              return false;
+            }
+
+            // Shared by whichever of the callbacks the executor ends up calling
+            auto output = std::make_shared<std::string>();
+            auto rv = std::make_shared<int>(0);
+            executor.submit(command.lane, command.timeout, memfault::CommandTask{
+              [func = std::move(command.func), output, rv]() { *rv = func(*output); },
+              [finished = std::move(finished), output, rv]() { finished(*rv, *output); },
+              [failed = std::move(failed), cmdId](int error) {
+                ALOGW("Command %d failed: %d", cmdId, error);
+                failed(error);
+              },
+            });
+            return true;
+        }
+
+        /**
+         * Copies output into a read-only shared memory region. libcutils backs it with a memfd
+         * where the kernel supports them, ashmem otherwise.
+         */
+        static android::base::unique_fd sharedMemoryCopy(const std::string &output) {
+          // Regions cannot be empty
+          android::base::unique_fd fd(ashmem_create_region("dumpster-output",
+                                                           std::max<size_t>(output.size(), 1)));
+          if (fd < 0) {
+            return fd;
+          }
+          if (!output.empty()) {
+            void *addr = mmap(nullptr, output.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+              return android::base::unique_fd();
+            }
+            memcpy(addr, output.data(), output.size());
+            munmap(addr, output.size());
+          }
+          if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+            return android::base::unique_fd();
+          }
+          return fd;
+        }
+
+        static void reportFinished(const android::sp<IDumpsterBasicCommandListener> &listener, int rv,
+                                   const std::string &output) {
 #if PLATFORM_SDK_VERSION <= 30
-              listener->onFinished(rv, std::make_unique<android::String16>(output.c_str()));
+          listener->onFinished(rv, std::make_unique<android::String16>(output.c_str()));
 #else
-              listener->onFinished(rv, android::String16(output.c_str()));
+          listener->onFinished(rv, android::String16(output.c_str()));
 #endif
+        }
+
+        // Serves func from resultCache for ttl
+        CommandFunc cachedResult(int key, std::chrono::milliseconds ttl, CommandFunc func,
+                                 std::function<uint64_t()> version = nullptr) {
+          return [this, key, ttl, func = std::move(func), version = std::move(version)](std::string& output) {
+            return resultCache.get(key, (uint64_t)ttl.count(), version ? version() : 0,
+                                   (uint64_t)android::elapsedRealtime(), func, output);
+          };
+        }
+
+        // Serves func from resultCache until a property changes
+        CommandFunc cachedPropertyResult(int key, CommandFunc func) {
+          if (memfault::system_property_area_serial() == 0) {
+            // Cannot tell when properties change
+            return func;
+          }
+          return cachedResult(key, kPropertyResultTtl, std::move(func), []() {
+            return (uint64_t)memfault::system_property_area_serial();
+          });
+        }
+
+        // Property results are recomputed after, even before Android 8
+        Command setpropCommand(const std::vector<std::string>& argv) {
+          Command command = quickCommand(argv);
+          command.func = [this, func = std::move(command.func)](std::string& output) {
+            int rv = func(output);
+            for (int key : {(int)IDumpster::CMD_ID_GETPROP, (int)IDumpster::CMD_ID_GETPROP_TYPES}) {
+              resultCache.invalidate(key);
             }
-            return android::binder::Status::ok();
+            return rv;
+          };
+          return command;
         }
 
-        CommandFunc commandFuncForId(int cmdId) {
+        Command commandForId(int cmdId) {
             switch (cmdId) {
-                case IDumpster::CMD_ID_GETPROP: return cmdToStringFunc({ "/system/bin/getprop" });
-                case IDumpster::CMD_ID_GETPROP_TYPES: return cmdToStringFunc({ "/system/bin/getprop", "-T" });
-                case IDumpster::CMD_ID_SET_BORT_ENABLED_PROPERTY_ENABLED: return cmdToStringFunc({
+                case IDumpster::CMD_ID_GETPROP: {
+                  return Command{cachedPropertyResult(cmdId, [](std::string& output) {
+                    return readSystemProperties(output);
+                  }), LANE_GETPROP, std::chrono::seconds(10)};
+                }
+#if PLATFORM_SDK_VERSION >= 28
+                case IDumpster::CMD_ID_GETPROP_TYPES: {
+                  return Command{cachedPropertyResult(cmdId, [](std::string& output) {
+                    return readSystemPropertyTypes(output);
+                  }), LANE_GETPROP, std::chrono::seconds(10)};
+                }
+#else
+                case IDumpster::CMD_ID_GETPROP_TYPES: {
+                  Command command = getpropCommand({ "/system/bin/getprop", "-T" });
+                  command.func = cachedPropertyResult(cmdId, std::move(command.func));
+                  return command;
+                }
+#endif
+                case IDumpster::CMD_ID_SET_BORT_ENABLED_PROPERTY_ENABLED: return setpropCommand({
                   "/system/bin/setprop", BORT_ENABLED_PROPERTY, "1"
                 });
-                case IDumpster::CMD_ID_SET_BORT_ENABLED_PROPERTY_DISABLED: return cmdToStringFunc({
+                case IDumpster::CMD_ID_SET_BORT_ENABLED_PROPERTY_DISABLED: return setpropCommand({
                   "/system/bin/setprop", BORT_ENABLED_PROPERTY, "0"
                 });
-                case IDumpster::CMD_ID_SET_STRUCTURED_ENABLED_PROPERTY_ENABLED: return cmdToStringFunc({
+                case IDumpster::CMD_ID_SET_STRUCTURED_ENABLED_PROPERTY_ENABLED: return setpropCommand({
                   "/system/bin/setprop", STRUCTURED_ENABLED_PROPERTY, "1"
                 });
-                case IDumpster::CMD_ID_SET_STRUCTURED_ENABLED_PROPERTY_DISABLED: return cmdToStringFunc({
+                case IDumpster::CMD_ID_SET_STRUCTURED_ENABLED_PROPERTY_DISABLED: return setpropCommand({
                   "/system/bin/setprop", STRUCTURED_ENABLED_PROPERTY, "0"
                 });
-                case IDumpster::CMD_ID_CYCLE_COUNT_NEVER_USE: return cmdToStringFunc({
+                case IDumpster::CMD_ID_CYCLE_COUNT_NEVER_USE: return quickCommand({
                   "echo", ""
                 });
-                case IDumpster::CMD_ID_PROC_STAT: return cmdToStringFunc({
-                  "cat", "/proc/stat"
-                });
+                case IDumpster::CMD_ID_PROC_STAT: {
+                  return Command{[](std::string& output) {
+                    return readProcStat(ProcStatFormat::FULL, output);
+                  }, LANE_QUICK, std::chrono::seconds(15)};
+                }
+                case IDumpster::CMD_ID_PROC_STAT_SUMMARY: {
+                  return Command{[](std::string& output) {
+                    return readProcStat(ProcStatFormat::SUMMARY, output);
+                  }, LANE_QUICK, std::chrono::seconds(15)};
+                }
                 case IDumpster::CMD_ID_PROC_PID_STAT: {
-                  return [](std::string& output) { 
+                  return Command{[](std::string& output) {
                     return readProcPidStats(output);
-                  };
+                  }, LANE_PROCFS, std::chrono::seconds(30)};
                 }
                 case IDumpster::CMD_ID_STORAGE_WEAR: {
-                  return [](std::string& output) {
+                  return Command{cachedResult(cmdId, kStorageWearTtl, [](std::string& output) {
                     return readStorageWear(output);
-                  };
+                  }), LANE_QUICK, std::chrono::seconds(15)};
+                }
+                case IDumpster::CMD_ID_SYSFS_THERMAL_ZONES: {
+                  return Command{[this](std::string& output) {
+                    return readSysfsThermalZones(resultCache, output);
+                  }, LANE_QUICK, std::chrono::seconds(15)};
+                }
+
+                default: return Command{nullptr, LANE_QUICK, std::chrono::milliseconds(0)};
+            }
+        }
+
+        // Commands with a protobuf result, see DumpsterResultsProto.proto
+        Command protoCommandForId(int cmdId) {
+            switch (cmdId) {
+                case IDumpster::CMD_ID_PROC_STAT:
+                case IDumpster::CMD_ID_PROC_STAT_SUMMARY: {
+                  return Command{[](std::string& output) {
+                    return readProcStat(ProcStatFormat::PROTO, output);
+                  }, LANE_QUICK, std::chrono::seconds(15)};
+                }
+                case IDumpster::CMD_ID_PROC_PID_STAT: {
+                  return Command{[](std::string& output) {
+                    return readProcPidStatsProto(output);
+                  }, LANE_PROCFS, std::chrono::seconds(30)};
+                }
+                case IDumpster::CMD_ID_STORAGE_WEAR: {
+                  return Command{cachedResult(kProtoResultKeyBase + cmdId, kStorageWearTtl,
+                                              [](std::string& output) {
+                    return readStorageWearProto(output);
+                  }), LANE_QUICK, std::chrono::seconds(15)};
                 }
                 case IDumpster::CMD_ID_SYSFS_THERMAL_ZONES: {
-                  return [](std::string& output) {
-                    return readSysfsThermalZones(output);
-                  };
+                  return Command{[this](std::string& output) {
+                    return readSysfsThermalZonesProto(resultCache, output);
+                  }, LANE_QUICK, std::chrono::seconds(15)};
                 }
 
-                default: return nullptr;
+                default: return Command{nullptr, LANE_QUICK, std::chrono::milliseconds(0)};
             }
         }
 
@@ -265,38 +591,83 @@ namespace {
 #ifdef BORT_SUPPORTS_CLOG
           int32_t version;
           if (options.getInt(android::String16("version"), &version) && version == 1) {
-            std::vector<android::String16> filter_specs_s16;
-            options.getStringVector(android::String16("filterSpecs"), &filter_specs_s16);
-
-            // unpack String16-format strings
-            std::vector<std::string> filter_specs;
-            for (auto &it : filter_specs_s16) {
-#if PLATFORM_SDK_VERSION <= 34
-              const char* spec = android::String8(it).string();
-#else
-              const char* spec = android::String8(it);
-#endif
-              filter_specs.emplace_back(spec);
-            }
+            memfault::ContinuousLogcatConfig config;
+            config.set_filter_specs(getStringVector(options, "filterSpecs"));
 
             int32_t dump_threshold_bytes;
-            if (!options.getInt(android::String16("dumpThresholdBytes"), &dump_threshold_bytes)) {
-              dump_threshold_bytes = kDefaultDumpThresholdBytes;
+            if (options.getInt(android::String16("dumpThresholdBytes"), &dump_threshold_bytes)) {
+              config.set_dump_threshold_bytes(dump_threshold_bytes);
             }
 
             int64_t dump_threshold_time_ms;
-            if (!options.getLong(android::String16("dumpThresholdTimeMs"), &dump_threshold_time_ms)) {
-              dump_threshold_time_ms = kDefaultDumpThresholdTimeMs;
+            if (options.getLong(android::String16("dumpThresholdTimeMs"), &dump_threshold_time_ms)) {
+              config.set_dump_threshold_time_ms((uint64_t)dump_threshold_time_ms);
             }
 
             int64_t dump_wrapping_timeout_ms;
-            if (!options.getLong(android::String16("dumpWrappingTimeoutMs"), &dump_wrapping_timeout_ms)) {
-              dump_wrapping_timeout_ms = kDefaultDumpWrappingTimeoutMs;
+            if (options.getLong(android::String16("dumpWrappingTimeoutMs"), &dump_wrapping_timeout_ms)) {
+              config.set_dump_wrapping_timeout_ms((uint64_t)dump_wrapping_timeout_ms);
+            }
+
+            int64_t dump_wrapping_timeout_min_ms;
+            if (options.getLong(android::String16("dumpWrappingTimeoutMinMs"), &dump_wrapping_timeout_min_ms)) {
+              config.set_dump_wrapping_timeout_min_ms((uint64_t)dump_wrapping_timeout_min_ms);
+            }
+
+            int64_t storage_quota_bytes;
+            if (options.getLong(android::String16("storageQuotaBytes"), &storage_quota_bytes)) {
+              config.set_storage_quota_bytes((uint64_t)storage_quota_bytes);
+            }
+
+            int64_t storage_low_free_bytes;
+            if (options.getLong(android::String16("storageLowFreeBytes"), &storage_low_free_bytes)) {
+              config.set_storage_low_free_bytes((uint64_t)storage_low_free_bytes);
+            }
+
+            config.set_redaction_rules(getStringVector(options, "redactionRules"));
+
+            bool kernel_logs;
+            if (options.getBoolean(android::String16("kernelLogs"), &kernel_logs)) {
+              config.set_kernel_logs(kernel_logs);
+            }
+
+            bool process_names;
+            if (options.getBoolean(android::String16("processNames"), &process_names)) {
+              config.set_process_names(process_names);
+            }
+
+            bool event_metrics;
+            if (options.getBoolean(android::String16("eventMetrics"), &event_metrics)) {
+              config.set_event_metrics(event_metrics);
+            }
+
+            config.set_tier_specs(getStringVector(options, "tiers"));
+            config.set_uid_rules(getStringVector(options, "uidRules"));
+            config.set_escalation_filter_specs(getStringVector(options, "escalationFilterSpecs"));
+            config.set_escalation_triggers(getStringVector(options, "escalationTriggers"));
+
+            int64_t escalation_duration_ms;
+            if (options.getLong(android::String16("escalationDurationMs"), &escalation_duration_ms)) {
+              config.set_escalation_duration_ms((uint64_t)escalation_duration_ms);
+            }
+
+            int64_t escalation_budget_bytes;
+            if (options.getLong(android::String16("escalationBudgetBytes"), &escalation_budget_bytes)) {
+              config.set_escalation_budget_bytes((uint64_t)escalation_budget_bytes);
+            }
+
+            int64_t upload_budget_bytes;
+            if (options.getLong(android::String16("uploadBudgetBytes"), &upload_budget_bytes)) {
+              config.set_upload_budget_bytes((uint64_t)upload_budget_bytes);
+            }
+
+            int64_t upload_budget_period_ms;
+            if (options.getLong(android::String16("uploadBudgetPeriodMs"), &upload_budget_period_ms)) {
+              config.set_upload_budget_period_ms((uint64_t)upload_budget_period_ms);
             }
 
             ALOGT("clog: reconfiguring");
-            clog->reconfigure(filter_specs, dump_threshold_bytes, (uint64_t)dump_threshold_time_ms,
-                (uint64_t)dump_wrapping_timeout_ms);
+            clog->reconfigure(config);
           } else {
             ALOGW("Cannot parse reconfiguration options, starting with current config");
           }
@@ -319,6 +690,125 @@ namespace {
           return android::binder::Status::ok();
         }
 
+        android::binder::Status registerLogSubscriber(
+            const PersistableBundle &options, const ParcelFd &sink, int32_t *_aidl_return) override {
+#ifdef BORT_SUPPORTS_CLOG
+          android::base::unique_fd sink_fd(dup(rawFd(sink)));
+          *_aidl_return = clog->add_subscriber(
+              getStringVector(options, "filterSpecs"),
+              getStringVector(options, "formats"),
+              std::move(sink_fd));
+#else
+          *_aidl_return = -1;
+#endif
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status unregisterLogSubscriber(int32_t subscriberId) override {
+#ifdef BORT_SUPPORTS_CLOG
+          clog->remove_subscriber(subscriberId);
+#endif
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status escalateContinuousLogging(
+            const PersistableBundle &options) override {
+#ifdef BORT_SUPPORTS_CLOG
+          android::String16 reason("binder");
+          options.getString(android::String16("reason"), &reason);
+          int64_t duration_ms = 0;
+          options.getLong(android::String16("durationMs"), &duration_ms);
+          android::String8 reason8(reason);
+#if PLATFORM_SDK_VERSION <= 34
+          clog->escalate(reason8.string(), duration_ms > 0 ? (uint64_t)duration_ms : 0);
+#else
+          clog->escalate((const char *)reason8, duration_ms > 0 ? (uint64_t)duration_ms : 0);
+#endif
+#endif
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status getPropertyChanges(
+            int64_t token, const android::sp<IDumpsterPropertyListener> &listener) override {
+          auto delta = std::make_shared<memfault::PropertyDelta>();
+          executor.submit(LANE_GETPROP, std::chrono::seconds(10), memfault::CommandTask{
+            [this, token, delta]() { *delta = propertyTracker.changes_since((uint64_t)token); },
+            [listener, delta]() { sendPropertyDelta(listener, *delta); },
+            [listener](int error) {
+              ALOGW("Property changes failed: %d", error);
+              listener->onFailed(error);
+            },
+          });
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status getProcessChanges(
+            int64_t token, const android::sp<IDumpsterBasicCommandListener> &listener) override {
+          auto output = std::make_shared<std::string>();
+          auto rv = std::make_shared<int>(0);
+          executor.submit(LANE_PROCFS, std::chrono::seconds(30), memfault::CommandTask{
+            [this, token, output, rv]() {
+              *rv = processSnapshots.changes_since((uint64_t)token, *output) ? 0 : -1;
+            },
+            [listener, output, rv]() { reportFinished(listener, *rv, *output); },
+            [listener](int error) {
+              ALOGW("Process changes failed: %d", error);
+              reportFinished(listener, error, "");
+            },
+          });
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status registerPropertyListener(
+            int64_t token, const android::sp<IDumpsterPropertyListener> &listener, bool *_aidl_return) override {
+#if PLATFORM_SDK_VERSION >= 26
+          uint64_t rounds;
+          {
+            std::lock_guard<std::mutex> lock(propertyListenersLock);
+            rounds = propertyWatcherRounds;
+            if (!propertyWatcherStarted) {
+              // Lives as long as the service
+              std::thread([this]() { watchProperties(); }).detach();
+              propertyWatcherStarted = true;
+            }
+          }
+          // Sent without the lock: a slow client must not hold up the other listeners
+          uint64_t sentToken = (uint64_t)token;
+          while (sendPropertyChanges(listener, sentToken, &sentToken)) {
+            std::lock_guard<std::mutex> lock(propertyListenersLock);
+            if (rounds == propertyWatcherRounds) {
+              propertyListeners.push_back(PropertyListener{listener, sentToken});
+              break;
+            }
+            // The watcher started pushing changes without this listener, catch up first
+            rounds = propertyWatcherRounds;
+          }
+          *_aidl_return = true;
+#else
+          *_aidl_return = false;
+#endif
+          return android::binder::Status::ok();
+        }
+
+        android::binder::Status unregisterPropertyListener(
+            const android::sp<IDumpsterPropertyListener> &listener) override {
+          std::lock_guard<std::mutex> lock(propertyListenersLock);
+          auto binder = android::IInterface::asBinder(listener);
+          propertyListeners.erase(
+              std::remove_if(propertyListeners.begin(), propertyListeners.end(),
+                             [&](const PropertyListener& it) {
+                               return android::IInterface::asBinder(it.listener) == binder;
+                             }),
+              propertyListeners.end());
+          return android::binder::Status::ok();
+        }
+
+        void recoverContinuousLogging() {
+#ifdef BORT_SUPPORTS_CLOG
+          clog->recover();
+#endif
+        }
+
         void requestContinuousLogDump() {
 #ifdef BORT_SUPPORTS_CLOG
           ALOGT("clog: requesting dump");
@@ -329,11 +819,181 @@ namespace {
 
     private:
 #ifdef BORT_SUPPORTS_CLOG
+        memfault::Report report;
+        std::unique_ptr<memfault::Distribution> wrapIntervalMetric;
+        // Before clog, whose reader thread reports to it
+        memfault::EventMetricsReport eventMetrics;
         std::unique_ptr<memfault::ContinuousLogcat> clog;
+
+        std::unique_ptr<memfault::Counter> timerWakeupsMetric;
+        std::unique_ptr<memfault::Counter> timerWakeupsAvoidedMetric;
+        uint64_t reportedTimerWakeups = 0;
+        uint64_t reportedTimerWakeupsAvoided = 0;
+
+        std::unique_ptr<memfault::Counter> commandTimeoutsMetric;
+        std::unique_ptr<memfault::Counter> commandRejectionsMetric;
+        // By lane
+        std::vector<std::unique_ptr<memfault::Distribution>> commandQueueDepthMetrics;
+        uint64_t reportedCommandTimeouts = 0;
+        uint64_t reportedCommandRejections = 0;
+
+        std::unique_ptr<memfault::Counter> resultCacheHitsMetric;
+        std::unique_ptr<memfault::Counter> resultCacheMissesMetric;
+        uint64_t reportedResultCacheHits = 0;
+        uint64_t reportedResultCacheMisses = 0;
 #endif
 
-        CommandFunc cmdToStringFunc(const std::vector<std::string>& command) {
-          return [command](std::string& output) { return RunCommandToString(command, output); };
+        memfault::PropertyTracker propertyTracker;
+        memfault::ProcessSnapshotTracker processSnapshots;
+        // Used by commands, outlives the executor
+        memfault::ResultCache resultCache;
+        memfault::CommandExecutor executor;
+
+        struct PropertyListener {
+          android::sp<IDumpsterPropertyListener> listener;
+          // Of the last changes it was sent
+          uint64_t token;
+        };
+        std::mutex propertyListenersLock;
+        std::vector<PropertyListener> propertyListeners;
+        bool propertyWatcherStarted = false;
+        // Incremented each time the watcher takes a copy of propertyListeners to push changes
+        uint64_t propertyWatcherRounds = 0;
+
+#ifdef BORT_SUPPORTS_CLOG
+        // Last, so that it stops before the metrics go away
+        memfault::ScopedRepeatingAlarm metricsAlarm;
+
+        static std::vector<std::unique_ptr<memfault::Distribution>> commandQueueDepthDistributions(
+            const memfault::Report& report) {
+          std::vector<std::unique_ptr<memfault::Distribution>> metrics;
+          for (const auto& lane : commandLanes()) {
+            metrics.push_back(report.distribution("dumpster_command_queue_depth_" + lane.name, {MAX, MEAN},
+                                                  true /* internal */));
+          }
+          return metrics;
+        }
+
+        void reportServiceMetrics() {
+          auto& timers = memfault::TimerService::get();
+          uint64_t wakeups = timers.wakeups();
+          uint64_t wakeupsAvoided = timers.wakeups_avoided();
+          timerWakeupsMetric->incrementBy(wakeups - reportedTimerWakeups);
+          timerWakeupsAvoidedMetric->incrementBy(wakeupsAvoided - reportedTimerWakeupsAvoided);
+          reportedTimerWakeups = wakeups;
+          reportedTimerWakeupsAvoided = wakeupsAvoided;
+
+          uint64_t timeouts = executor.timeouts();
+          uint64_t rejections = executor.rejections();
+          commandTimeoutsMetric->incrementBy(timeouts - reportedCommandTimeouts);
+          commandRejectionsMetric->incrementBy(rejections - reportedCommandRejections);
+          reportedCommandTimeouts = timeouts;
+          reportedCommandRejections = rejections;
+
+          uint64_t hits = resultCache.hits();
+          uint64_t misses = resultCache.misses();
+          resultCacheHitsMetric->incrementBy(hits - reportedResultCacheHits);
+          resultCacheMissesMetric->incrementBy(misses - reportedResultCacheMisses);
+          reportedResultCacheHits = hits;
+          reportedResultCacheMisses = misses;
+        }
+#endif
+
+        /**
+         * Sends the changes since token, if any (or every property for an unknown token).
+         *
+         * @return false if the listener is gone.
+         */
+        bool sendPropertyChanges(const android::sp<IDumpsterPropertyListener> &listener, uint64_t token,
+                                 uint64_t *sentToken = nullptr) {
+          memfault::PropertyDelta delta = propertyTracker.changes_since(token);
+          if (sentToken) *sentToken = delta.token;
+          if (!delta.full && delta.properties.empty() && sentToken) {
+            // Nothing new to push
+            return true;
+          }
+          return sendPropertyDelta(listener, delta);
+        }
+
+        static bool sendPropertyDelta(const android::sp<IDumpsterPropertyListener> &listener,
+                                      const memfault::PropertyDelta &delta) {
+          std::string output;
+          memfault::format_getprop(delta.properties, output);
+          auto status = listener->onPropertyChanges((int64_t)delta.token, delta.full,
+                                                    android::String16(output.c_str()));
+          return status.transactionError() != android::DEAD_OBJECT;
+        }
+
+        void watchProperties() {
+          uint32_t serial = memfault::system_property_area_serial();
+          while (true) {
+            uint32_t newSerial = memfault::wait_system_property_change(serial, std::chrono::hours(24));
+            if (newSerial == serial) continue;
+            std::this_thread::sleep_for(kPropertyPushBatchDelay);
+            serial = memfault::system_property_area_serial();
+
+            std::vector<PropertyListener> listeners;
+            {
+              std::lock_guard<std::mutex> lock(propertyListenersLock);
+              listeners = propertyListeners;
+              propertyWatcherRounds++;
+            }
+
+            // Binder calls are made without the lock, so that a slow client does not block
+            // registrations
+            std::vector<bool> alive;
+            for (auto& it : listeners) {
+              alive.push_back(sendPropertyChanges(it.listener, it.token, &it.token));
+            }
+
+            // Listeners may have (un)registered in the meantime: only update those that were sent
+            std::lock_guard<std::mutex> lock(propertyListenersLock);
+            propertyListeners.erase(
+                std::remove_if(propertyListeners.begin(), propertyListeners.end(),
+                               [&](PropertyListener& it) {
+                                 auto binder = android::IInterface::asBinder(it.listener);
+                                 for (size_t i = 0; i < listeners.size(); i++) {
+                                   if (android::IInterface::asBinder(listeners[i].listener) == binder) {
+                                     if (!alive[i]) return true;
+                                     it.token = listeners[i].token;
+                                   }
+                                 }
+                                 return false;
+                               }),
+                propertyListeners.end());
+          }
+        }
+
+        static std::vector<std::string> getStringVector(const PersistableBundle &options, const char *key) {
+          std::vector<android::String16> values_s16;
+          options.getStringVector(android::String16(key), &values_s16);
+
+          // unpack String16-format strings
+          std::vector<std::string> values;
+          for (auto &it : values_s16) {
+#if PLATFORM_SDK_VERSION <= 34
+            const char* value = android::String8(it).string();
+#else
+            const char* value = android::String8(it);
+#endif
+            values.emplace_back(value);
+          }
+          return values;
+        }
+
+        static CommandFunc cmdToStringFunc(const std::vector<std::string>& command, int timeoutSec) {
+          return [command, timeoutSec](std::string& output) {
+            return RunCommandToString(command, timeoutSec, output);
+          };
+        }
+
+        // The executor times out a little after the command itself is killed
+        static Command quickCommand(const std::vector<std::string>& command) {
+          return Command{cmdToStringFunc(command, 10), LANE_QUICK, std::chrono::seconds(15)};
+        }
+
+        static Command getpropCommand(const std::vector<std::string>& command) {
+          return Command{cmdToStringFunc(command, 20), LANE_GETPROP, std::chrono::seconds(30)};
         }
     };
 } // namespace
@@ -358,6 +1018,7 @@ void watch_dump_signal(DumpsterService *service) {
 
 int main(void) {
     ALOGI("Starting...");
+    const int64_t startMs = android::uptimeMillis();
 
     struct sigaction sa;
     sa.sa_handler = uncaught_handler;
@@ -371,11 +1032,12 @@ int main(void) {
     sigprocmask(SIG_BLOCK, &blockset, NULL);
 
     android::sp<android::ProcessState> ps(android::ProcessState::self());
-    ps->setThreadPoolMaxThreadCount(1);
+    ps->setThreadPoolMaxThreadCount(kBinderThreads);
     ps->startThreadPool();
     ps->giveThreadPoolName();
 
     DumpsterService *dumpsterService = new DumpsterService();
+    const int64_t createdMs = android::uptimeMillis();
     android::sp<android::IServiceManager> sm(android::defaultServiceManager());
     const android::status_t status =
         sm->addService(android::String16(DUMPSTER_SERVICE_NAME), dumpsterService, false /* allowIsolated */);
@@ -383,6 +1045,12 @@ int main(void) {
         ALOGE("Service not added: %d", static_cast<int>(status));
         exit(2);
     }
+    ALOGI("Service registered in %" PRId64 " ms (create: %" PRId64 " ms, register: %" PRId64 " ms)",
+          android::uptimeMillis() - startMs, createdMs - startMs, android::uptimeMillis() - createdMs);
+
+    // Dumping a large continuous log left over by the previous run can take seconds: do it
+    // once the service is available to Bort.
+    std::thread recoveryThread([dumpsterService] { dumpsterService->recoverContinuousLogging(); });
 
 #ifdef BORT_SUPPORTS_CLOG
     std::thread signalWatchThread([dumpsterService] { watch_dump_signal(dumpsterService); });
@@ -390,6 +1058,7 @@ int main(void) {
 
     android::IPCThreadState::self()->joinThreadPool();
 
+    recoveryThread.join();
     dumpsterService = nullptr;
     raise(SIGUSR1);
 
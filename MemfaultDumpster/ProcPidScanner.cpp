@@ -0,0 +1,235 @@
+#define LOG_TAG "mflt-procpid"
+
+#include "ProcPidScanner.h"
+
+#include "DumpsterResults.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace memfault {
+
+// Up to this many threads by default, fewer on devices with fewer cores
+static constexpr size_t kMaxDefaultThreads = 4;
+// Below this many pids per thread, spawning threads costs more than it saves
+static constexpr size_t kMinPidsPerThread = 64;
+// stat is a single line, status about 1.5 KB: a single read is enough for both
+static constexpr size_t kInitialBufferSize = 4096;
+static constexpr size_t kDirentsBufferSize = 32 * 1024;
+
+namespace {
+
+// The layout getdents64 fills, which neither libc declares
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+bool is_pid(const char *name) {
+  if (*name == '\0') return false;
+  for (; *name != '\0'; name++) {
+    if (*name < '0' || *name > '9') return false;
+  }
+  return true;
+}
+
+// The real uid, first of the "Uid:" line of /proc/<pid>/status, or -1
+int64_t parse_status_uid(const char *begin, const char *end) {
+  static constexpr char kUid[] = "\nUid:";
+  const char *p = static_cast<const char *>(
+      memmem(begin, end - begin, kUid, sizeof(kUid) - 1));
+  if (p == nullptr) return -1;
+  p += sizeof(kUid) - 1;
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p >= end || *p < '0' || *p > '9') return -1;
+  int64_t uid = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    uid = uid * 10 + (*p - '0');
+    p++;
+  }
+  return uid;
+}
+
+void append_uid(int64_t uid, std::string& output) {
+  char digits[24];
+  size_t len = 0;
+  do {
+    digits[len++] = (char)('0' + uid % 10);
+    uid /= 10;
+  } while (uid > 0);
+  while (len > 0) output.push_back(digits[--len]);
+}
+
+}
+
+ProcPidScanner::ProcPidScanner(const char *proc_path, size_t threads)
+  : proc_path_(proc_path), dirents_(kDirentsBufferSize) {
+  if (threads == 0) {
+    threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, kMaxDefaultThreads);
+  }
+  workers_.resize(threads);
+  for (auto& worker : workers_) {
+    worker.buffer.resize(kInitialBufferSize);
+  }
+}
+
+ProcPidScanner::~ProcPidScanner() {
+  if (proc_fd_ >= 0) close(proc_fd_);
+}
+
+bool ProcPidScanner::list_pids() {
+  pid_names_.clear();
+  pid_offsets_.clear();
+
+  if (proc_fd_ < 0) {
+    proc_fd_ = TEMP_FAILURE_RETRY(
+        open(proc_path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (proc_fd_ < 0) {
+      ALOGE("Failed to open %s: %d", proc_path_.c_str(), errno);
+      return false;
+    }
+  } else if (lseek(proc_fd_, 0, SEEK_SET) < 0) {
+    ALOGE("Failed to rewind %s: %d", proc_path_.c_str(), errno);
+    return false;
+  }
+
+  while (true) {
+    long n = syscall(SYS_getdents64, proc_fd_, dirents_.data(), dirents_.size());
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      ALOGE("Failed to list %s: %d", proc_path_.c_str(), errno);
+      return false;
+    }
+    if (n == 0) return true;
+    for (long offset = 0; offset < n;) {
+      auto *entry = reinterpret_cast<const linux_dirent64 *>(dirents_.data() + offset);
+      offset += entry->d_reclen;
+      // Not interested in non-numeric entries such as /proc/stat and /proc/self
+      if (entry->d_type != DT_DIR || !is_pid(entry->d_name)) continue;
+      pid_offsets_.push_back(pid_names_.size());
+      pid_names_.insert(pid_names_.end(), entry->d_name,
+                        entry->d_name + strlen(entry->d_name) + 1);
+    }
+  }
+}
+
+bool ProcPidScanner::read_file(int dir_fd, const char *name, std::vector<char>& buffer,
+                               size_t& len) {
+  int fd = TEMP_FAILURE_RETRY(openat(dir_fd, name, O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return false;
+  len = 0;
+  bool ok = true;
+  while (true) {
+    if (len == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    ssize_t n = TEMP_FAILURE_RETRY(read(fd, buffer.data() + len, buffer.size() - len));
+    if (n < 0) {
+      ok = false;
+      break;
+    }
+    if (n == 0) break;
+    len += (size_t)n;
+  }
+  close(fd);
+  return ok && len > 0;
+}
+
+void ProcPidScanner::scan_range(Worker& worker, size_t begin, size_t end, bool to_proto) {
+  worker.output.clear();
+  worker.proto.Clear();
+  for (size_t i = begin; i < end; i++) {
+    // Some of these are bound to fail due to processes exiting between listing pids
+    // and reading their entries
+    const char *name = pid_names_.data() + pid_offsets_[i];
+    int pid_fd = TEMP_FAILURE_RETRY(
+        openat(proc_fd_, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (pid_fd < 0) continue;
+
+    // Not the owner of /proc/<pid>: that is the effective uid, or root for non-dumpable
+    // processes
+    size_t len;
+    int64_t uid = read_file(pid_fd, "status", worker.buffer, len)
+                      ? parse_status_uid(worker.buffer.data(), worker.buffer.data() + len)
+                      : -1;
+    if (uid >= 0 && read_file(pid_fd, "stat", worker.buffer, len)) {
+      if (to_proto) {
+        auto *process = worker.proto.add_processes();
+        if (!proc_pid_stat_to_proto((uint32_t)uid, std::string_view(worker.buffer.data(), len),
+                                    worker.fields, *process)) {
+          worker.proto.mutable_processes()->RemoveLast();
+        }
+      } else {
+        append_uid(uid, worker.output);
+        worker.output.push_back(' ');
+        worker.output.append(worker.buffer.data(), len);
+        worker.output.push_back('\n');
+      }
+    }
+    close(pid_fd);
+  }
+}
+
+size_t ProcPidScanner::scan_pids(bool to_proto) {
+  const size_t pids = pid_offsets_.size();
+  const size_t threads = std::clamp<size_t>(pids / kMinPidsPerThread, 1, workers_.size());
+  const size_t per_thread = (pids + threads - 1) / threads;
+
+  // The calling thread takes the first range
+  std::vector<std::thread> spawned;
+  spawned.reserve(threads - 1);
+  for (size_t t = 1; t < threads; t++) {
+    size_t begin = std::min(pids, t * per_thread);
+    size_t end = std::min(pids, begin + per_thread);
+    spawned.emplace_back(
+        [this, t, begin, end, to_proto] { scan_range(workers_[t], begin, end, to_proto); });
+  }
+  scan_range(workers_[0], 0, std::min(pids, per_thread), to_proto);
+  for (auto& thread : spawned) {
+    thread.join();
+  }
+  return threads;
+}
+
+bool ProcPidScanner::scan(std::string& output) {
+  output.clear();
+  if (!list_pids()) return false;
+
+  const size_t threads = scan_pids(false /* to_proto */);
+  size_t total = 0;
+  for (size_t t = 0; t < threads; t++) total += workers_[t].output.size();
+  output.reserve(total);
+  for (size_t t = 0; t < threads; t++) output.append(workers_[t].output);
+  return true;
+}
+
+bool ProcPidScanner::scan(ProcPidStatsProto& proto) {
+  proto.Clear();
+  if (!list_pids()) return false;
+
+  const size_t threads = scan_pids(true /* to_proto */);
+  auto& processes = *proto.mutable_processes();
+  for (size_t t = 0; t < threads; t++) {
+    // Moved rather than copied: the workers keep the emptied messages for the next scan
+    for (auto& process : *workers_[t].proto.mutable_processes()) {
+      processes.Add()->Swap(&process);
+    }
+  }
+  std::sort(processes.begin(), processes.end(),
+            [](const auto& a, const auto& b) { return a.pid() < b.pid(); });
+  return true;
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DumpsterResultsProto.pb.h"
+
+namespace memfault {
+
+/**
+ * Produces the output of CMD_ID_PROC_PID_STAT: for each process, its real uid, a space and
+ * the contents of /proc/<pid>/stat, followed by an empty line. Processes that exit during
+ * the scan are skipped.
+ *
+ * Files are opened relative to a /proc fd kept open, into buffers kept between scans. The
+ * uid is read from /proc/<pid>/status: the owner of /proc/<pid> is the effective uid, or
+ * root for non-dumpable processes.
+ *
+ * The pids are split across threads, each scanning a contiguous range. Not thread safe.
+ */
+class ProcPidScanner {
+  public:
+    explicit ProcPidScanner(const char *proc_path = "/proc", size_t threads = 0 /* default */);
+    ~ProcPidScanner();
+
+    ProcPidScanner(const ProcPidScanner&) = delete;
+    ProcPidScanner& operator=(const ProcPidScanner&) = delete;
+
+    /**
+     * @return false if proc_path cannot be read.
+     */
+    bool scan(std::string& output);
+
+    /**
+     * The same processes, for CMD_ID_PROC_PID_STAT as a proto (sorted by pid), parsed from
+     * the files as they are read.
+     *
+     * @return false if proc_path cannot be read.
+     */
+    bool scan(ProcPidStatsProto& proto);
+
+  private:
+    struct Worker {
+      std::string output;
+      ProcPidStatsProto proto;
+      std::vector<char> buffer;
+      std::vector<std::string_view> fields;
+    };
+
+    bool list_pids();
+    // Fills the output or the proto of the workers, returns how many took part
+    size_t scan_pids(bool to_proto);
+    void scan_range(Worker& worker, size_t begin, size_t end, bool to_proto);
+    bool read_file(int dir_fd, const char *name, std::vector<char>& buffer, size_t& len);
+
+    const std::string proc_path_;
+    int proc_fd_ = -1;
+    std::vector<char> dirents_;
+    // Names of the pid directories, NUL-separated, and their offsets
+    std::vector<char> pid_names_;
+    std::vector<size_t> pid_offsets_;
+    std::vector<Worker> workers_;
+};
+
+}
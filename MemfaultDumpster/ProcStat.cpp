@@ -0,0 +1,169 @@
+#define LOG_TAG "mflt-procstat"
+
+#include "ProcStat.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+namespace memfault {
+
+// Large enough for the whole file on most devices, it grows otherwise
+static constexpr size_t kInitialBufferSize = 16 * 1024;
+
+namespace {
+
+// Hand-rolled: this runs on every heartbeat, and strtoull() and friends would need the
+// lines copied to be terminated.
+class Scanner {
+  public:
+    Scanner(const char *begin, const char *end) : p_(begin), end_(end) {}
+
+    inline bool at_end() const { return p_ >= end_; }
+
+    inline bool consume(const char *prefix, size_t len) {
+      if ((size_t)(end_ - p_) < len || memcmp(p_, prefix, len) != 0) return false;
+      p_ += len;
+      return true;
+    }
+
+    // Skips spaces, but not line ends
+    inline bool number(uint64_t& value) {
+      while (p_ < end_ && *p_ == ' ') p_++;
+      if (p_ >= end_ || *p_ < '0' || *p_ > '9') return false;
+      value = 0;
+      while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+        value = value * 10 + (uint64_t)(*p_ - '0');
+        p_++;
+      }
+      return true;
+    }
+
+    inline void next_line() {
+      const void *eol = memchr(p_, '\n', end_ - p_);
+      p_ = eol != nullptr ? static_cast<const char *>(eol) + 1 : end_;
+    }
+
+  private:
+    const char *p_;
+    const char *end_;
+};
+
+void parse_cpu_times(Scanner& scanner, CpuTimes& times) {
+  for (size_t i = 0; i < kCpuTimeFields; i++) {
+    if (!scanner.number(times.jiffies[i])) break;
+  }
+}
+
+}
+
+#define CONSUME(scanner, literal) (scanner).consume(literal, sizeof(literal) - 1)
+
+bool parse_proc_stat(std::string_view text, ProcStat& stat) {
+  stat = ProcStat();
+  bool has_total = false;
+  Scanner scanner(text.data(), text.data() + text.size());
+
+  while (!scanner.at_end()) {
+    if (CONSUME(scanner, "cpu ")) {
+      parse_cpu_times(scanner, stat.total);
+      has_total = true;
+    } else if (CONSUME(scanner, "cpu")) {
+      uint64_t cpu;
+      if (scanner.number(cpu)) {
+        stat.cpus.emplace_back();
+        stat.cpus.back().cpu = (int32_t)cpu;
+        parse_cpu_times(scanner, stat.cpus.back());
+      }
+    } else if (CONSUME(scanner, "intr ")) {
+      scanner.number(stat.interrupts);
+    } else if (CONSUME(scanner, "ctxt ")) {
+      scanner.number(stat.context_switches);
+    } else if (CONSUME(scanner, "btime ")) {
+      scanner.number(stat.boot_time);
+    } else if (CONSUME(scanner, "processes ")) {
+      scanner.number(stat.processes);
+    } else if (CONSUME(scanner, "procs_running ")) {
+      scanner.number(stat.procs_running);
+    } else if (CONSUME(scanner, "procs_blocked ")) {
+      scanner.number(stat.procs_blocked);
+    } else if (CONSUME(scanner, "softirq ")) {
+      scanner.number(stat.softirqs);
+    }
+    scanner.next_line();
+  }
+  return has_total;
+}
+
+static void append_cpu_times(const CpuTimes& times, std::string& output) {
+  char line[32 + kCpuTimeFields * 21];
+  int len = times.cpu < 0 ? snprintf(line, sizeof(line), "cpu ")
+                          : snprintf(line, sizeof(line), "cpu%" PRId32, times.cpu);
+  for (size_t i = 0; i < kCpuTimeFields; i++) {
+    len += snprintf(line + len, sizeof(line) - len, " %" PRIu64, times.jiffies[i]);
+  }
+  output.append(line, len).append("\n");
+}
+
+static void append_counter(const char *name, uint64_t value, std::string& output) {
+  char line[64];
+  int len = snprintf(line, sizeof(line), "%s %" PRIu64 "\n", name, value);
+  output.append(line, len);
+}
+
+void format_proc_stat_summary(const ProcStat& stat, std::string& output) {
+  output.clear();
+  append_cpu_times(stat.total, output);
+  for (const auto& cpu : stat.cpus) {
+    append_cpu_times(cpu, output);
+  }
+  append_counter("intr", stat.interrupts, output);
+  append_counter("ctxt", stat.context_switches, output);
+  append_counter("btime", stat.boot_time, output);
+  append_counter("processes", stat.processes, output);
+  append_counter("procs_running", stat.procs_running, output);
+  append_counter("procs_blocked", stat.procs_blocked, output);
+  append_counter("softirq", stat.softirqs, output);
+}
+
+ProcStatReader::ProcStatReader(const char *path)
+  : path_(path), buffer_(kInitialBufferSize) {}
+
+ProcStatReader::~ProcStatReader() {
+  if (fd_ >= 0) close(fd_);
+}
+
+std::string_view ProcStatReader::read() {
+  if (fd_ < 0) {
+    fd_ = TEMP_FAILURE_RETRY(open(path_.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd_ < 0) {
+      ALOGE("Failed to open %s: %d", path_.c_str(), errno);
+      return {};
+    }
+  }
+
+  // Generated anew from offset 0 for each read, a single pread usually gets all of it
+  size_t len = 0;
+  while (true) {
+    if (len == buffer_.size()) {
+      buffer_.resize(buffer_.size() * 2);
+    }
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd_, buffer_.data() + len, buffer_.size() - len, len));
+    if (n < 0) {
+      ALOGE("Failed to read %s: %d", path_.c_str(), errno);
+      close(fd_);
+      fd_ = -1;
+      return {};
+    }
+    if (n == 0) break;
+    len += (size_t)n;
+  }
+  return std::string_view(buffer_.data(), len);
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace memfault {
+
+// Columns of the cpu lines, in jiffies. Older kernels have fewer, those are left at 0.
+enum CpuTimeField : size_t {
+  CPU_USER,
+  CPU_NICE,
+  CPU_SYSTEM,
+  CPU_IDLE,
+  CPU_IOWAIT,
+  CPU_IRQ,
+  CPU_SOFTIRQ,
+  CPU_STEAL,
+  CPU_GUEST,
+  CPU_GUEST_NICE,
+  kCpuTimeFields,
+};
+
+struct CpuTimes {
+  // -1 for the line summing every CPU
+  int32_t cpu = -1;
+  uint64_t jiffies[kCpuTimeFields] = {};
+};
+
+/**
+ * What Bort uses of /proc/stat. The per interrupt and per softirq breakdowns, most of the
+ * file, are only summed.
+ */
+struct ProcStat {
+  CpuTimes total;
+  // Online CPUs, in the order listed
+  std::vector<CpuTimes> cpus;
+  uint64_t interrupts = 0;
+  uint64_t context_switches = 0;
+  uint64_t boot_time = 0;
+  uint64_t processes = 0;
+  uint64_t procs_running = 0;
+  uint64_t procs_blocked = 0;
+  uint64_t softirqs = 0;
+};
+
+/**
+ * Parses the contents of /proc/stat, in place. Unknown lines are skipped.
+ *
+ * @return false if there is no aggregate cpu line.
+ */
+bool parse_proc_stat(std::string_view text, ProcStat& stat);
+
+/**
+ * Formats the summary returned for CMD_ID_PROC_STAT_SUMMARY: the lines of /proc/stat that
+ * were parsed, in the same format, with every cpu line carrying all the columns and only the
+ * totals of intr and softirq.
+ */
+void format_proc_stat_summary(const ProcStat& stat, std::string& output);
+
+/**
+ * Reads /proc/stat through a file descriptor kept open, into a buffer kept between reads.
+ * Not thread safe.
+ */
+class ProcStatReader {
+  public:
+    explicit ProcStatReader(const char *path = "/proc/stat");
+    ~ProcStatReader();
+
+    ProcStatReader(const ProcStatReader&) = delete;
+    ProcStatReader& operator=(const ProcStatReader&) = delete;
+
+    /**
+     * @return the current contents, valid until the next read, or an empty view on error.
+     */
+    std::string_view read();
+
+  private:
+    const std::string path_;
+    int fd_ = -1;
+    std::vector<char> buffer_;
+};
+
+}
@@ -0,0 +1,133 @@
+#include "ProcessNameCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
+
+namespace memfault {
+
+// Field 22 of /proc/<pid>/stat, counted from the state (field 3) that follows the comm
+static constexpr int kStartTimeFieldAfterComm = 22 - 3;
+
+static ssize_t read_proc_file(const std::string& path, char *buf, size_t size) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd.get() < 0) return -1;
+  ssize_t len = TEMP_FAILURE_RETRY(read(fd.get(), buf, size - 1));
+  if (len < 0) return -1;
+  buf[len] = '\0';
+  return len;
+}
+
+// Start time (in clock ticks since boot) and comm from /proc/<pid>/stat
+static bool read_proc_stat(const std::string& dir, unsigned long long *start_ticks,
+                           std::string *comm) {
+  // pid (comm) state ppid ... starttime ..., comm may contain spaces and parentheses
+  char stat[1024];
+  if (read_proc_file(dir + "/stat", stat, sizeof(stat)) <= 0) return false;
+  char *comm_start = strchr(stat, '(');
+  char *comm_end = strrchr(stat, ')');
+  if (comm_start == nullptr || comm_end == nullptr || comm_end < comm_start) return false;
+
+  char *field = comm_end + 1;
+  for (int i = 0; i < kStartTimeFieldAfterComm && field != nullptr; i++) {
+    field = strchr(field + 1, ' ');
+  }
+  if (field == nullptr) return false;
+  *start_ticks = strtoull(field + 1, nullptr, 10);
+  if (comm != nullptr) comm->assign(comm_start + 1, comm_end);
+  return true;
+}
+
+ProcessNameCache::ProcessNameCache(size_t capacity, std::string proc_root)
+  : capacity_(capacity), proc_root_(std::move(proc_root)) {}
+
+const std::string *ProcessNameCache::lookup(int32_t pid, int32_t uid, time_t line_sec) {
+  auto it = index_.find(pid);
+  if (it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    Entry& entry = lru_.front();
+    if (entry.uid != uid) {
+      fill(entry, pid, uid);
+    } else if (line_sec > entry.filled_sec) {
+      // Logged after the fill: the pid may have been reused since, by the same uid
+      revalidate(entry, pid, uid);
+    }
+  } else {
+    if (index_.size() >= capacity_) {
+      index_.erase(lru_.back().pid);
+      lru_.pop_back();
+    }
+    lru_.emplace_front();
+    index_[pid] = lru_.begin();
+    fill(lru_.front(), pid, uid);
+  }
+
+  const Entry& entry = lru_.front();
+  // Allow for the start time being rounded down to the second
+  if (entry.start_sec == 0 || line_sec + 1 < entry.start_sec) {
+    return nullptr;
+  }
+  return &entry.name;
+}
+
+void ProcessNameCache::revalidate(Entry& entry, int32_t pid, int32_t uid) {
+  revalidations_++;
+
+  unsigned long long start_ticks = 0;
+  read_proc_stat(proc_root_ + "/" + std::to_string(pid), &start_ticks, nullptr);
+  if (start_ticks != entry.start_ticks) {
+    fill(entry, pid, uid);
+    return;
+  }
+
+  // Same process, no need to check again for lines logged before now
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  entry.filled_sec = now.tv_sec;
+}
+
+void ProcessNameCache::fill(Entry& entry, int32_t pid, int32_t uid) {
+  fills_++;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  entry.pid = pid;
+  entry.uid = uid;
+  entry.start_ticks = 0;
+  entry.start_sec = 0;
+  entry.filled_sec = now.tv_sec;
+  entry.name.clear();
+
+  std::string dir = proc_root_ + "/" + std::to_string(pid);
+
+  unsigned long long start_ticks;
+  std::string comm;
+  if (!read_proc_stat(dir, &start_ticks, &comm)) return;
+
+  // starttime is in clock ticks since boot (including suspend)
+  struct timespec boottime;
+  clock_gettime(CLOCK_BOOTTIME, &boottime);
+  long ticks_per_sec = sysconf(_SC_CLK_TCK);
+  if (ticks_per_sec <= 0) return;
+  time_t since_start_sec = boottime.tv_sec - (time_t)(start_ticks / ticks_per_sec);
+  entry.start_ticks = start_ticks;
+  entry.start_sec = std::max<time_t>(now.tv_sec - since_start_sec, 1);
+
+  // argv[0], falling back to the comm for kernel threads and processes that cleared it
+  char cmdline[256];
+  ssize_t len = read_proc_file(dir + "/cmdline", cmdline, sizeof(cmdline));
+  if (len > 0 && cmdline[0] != '\0') {
+    entry.name.assign(cmdline);
+  } else {
+    entry.name = std::move(comm);
+  }
+}
+
+}
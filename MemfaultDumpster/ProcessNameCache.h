@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace memfault {
+
+static constexpr size_t kDefaultProcessNameCacheCapacity = 512;
+
+/**
+ * Bounded LRU cache of process names, keyed by (pid, start time) so that pid reuse does not
+ * attribute lines to the wrong process.
+ *
+ * Entries are filled lazily from /proc/<pid>/stat (start time) and /proc/<pid>/cmdline
+ * (name) the first time a pid is seen. After that a pid is only looked up again in /proc
+ * if its lines show it may have been reused:
+ *  - the line's uid differs from the one the entry was filled for: the entry is refilled.
+ *  - the line is more recent than the fill: the start time in /proc/<pid>/stat is checked
+ *    again, and the entry refilled if it changed. Lines read as they are logged cost at
+ *    most one such check per pid and second, lines read after logd wrapped none.
+ *
+ * Lines older than the start time of the process currently holding their pid (the reader
+ * can lag behind by up to the wrap timeout) were logged by a process that is gone, their
+ * name is unknown.
+ */
+class ProcessNameCache {
+  public:
+    explicit ProcessNameCache(
+        size_t capacity = kDefaultProcessNameCacheCapacity,
+        std::string proc_root = "/proc");
+
+    /**
+     * @return the name of the process that logged a line, or nullptr if unknown. The pointer
+     * is valid until the next lookup.
+     */
+    const std::string *lookup(int32_t pid, int32_t uid, time_t line_sec);
+
+    inline size_t size() const { return index_.size(); }
+    // Number of times /proc was consulted, i.e. cache fills
+    inline uint64_t fills() const { return fills_; }
+    // Number of start time checks of cached entries
+    inline uint64_t revalidations() const { return revalidations_; }
+
+  private:
+    struct Entry {
+      int32_t pid;
+      // uid of the lines the entry was filled for
+      int32_t uid;
+      // Both 0 if the process did not exist when the entry was filled
+      // Clock ticks since boot, as in /proc/<pid>/stat
+      unsigned long long start_ticks;
+      time_t start_sec;
+      time_t filled_sec;
+      std::string name;
+    };
+
+    void fill(Entry& entry, int32_t pid, int32_t uid);
+    void revalidate(Entry& entry, int32_t pid, int32_t uid);
+
+    size_t capacity_;
+    std::string proc_root_;
+    std::list<Entry> lru_;
+    std::unordered_map<int32_t, std::list<Entry>::iterator> index_;
+    uint64_t fills_ = 0;
+    uint64_t revalidations_ = 0;
+};
+
+}
@@ -0,0 +1,178 @@
+#include "ProcessSnapshotTracker.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace memfault {
+
+// Identifies a process along with its pid and name: a pid reused by another process is
+// reported as a new process rather than as changes
+static constexpr size_t kStartTimeField = 22;
+// The first field after the name
+static constexpr size_t kStateField = 3;
+
+namespace {
+
+// "<uid> <pid> (<name>) <state> ..."
+bool parse_pid(std::string_view line, int32_t& pid) {
+  size_t space = line.find(' ');
+  if (space == std::string_view::npos || space + 1 >= line.size()) return false;
+  size_t p = space + 1;
+  if (line[p] < '0' || line[p] > '9') return false;
+  pid = 0;
+  for (; p < line.size() && line[p] >= '0' && line[p] <= '9'; p++) {
+    pid = pid * 10 + (line[p] - '0');
+  }
+  return true;
+}
+
+// Up to the end of the name, which may itself hold spaces and parentheses
+std::string_view identity(std::string_view line) {
+  size_t end = line.rfind(')');
+  return end == std::string_view::npos ? line : line.substr(0, end + 1);
+}
+
+void split_fields(std::string_view line, std::vector<std::string_view>& fields) {
+  fields.clear();
+  size_t p = identity(line).size();
+  while (p < line.size()) {
+    while (p < line.size() && line[p] == ' ') p++;
+    size_t end = line.find(' ', p);
+    if (end == std::string_view::npos) end = line.size();
+    if (end > p) fields.push_back(line.substr(p, end - p));
+    p = end;
+  }
+}
+
+void append_new(std::string_view line, std::string& output) {
+  output.push_back('+');
+  output.append(line);
+  output.push_back('\n');
+}
+
+void append_pid(char prefix, int32_t pid, std::string& output) {
+  char buffer[16];
+  int len = snprintf(buffer, sizeof(buffer), "%c%" PRId32, prefix, pid);
+  output.append(buffer, len);
+}
+
+}
+
+ProcessSnapshotTracker::ProcessSnapshotTracker(uint32_t epoch, ScanFunc scan,
+                                               size_t max_snapshots)
+  : epoch_(epoch != 0 ? epoch : 1), scan_(std::move(scan)),
+    max_snapshots_(std::max<size_t>(max_snapshots, 1)) {}
+
+void ProcessSnapshotTracker::parse(Snapshot& snapshot) {
+  snapshot.processes.clear();
+  std::string_view text(snapshot.text);
+  size_t offset = 0;
+  while (offset < text.size()) {
+    size_t end = text.find('\n', offset);
+    if (end == std::string_view::npos) end = text.size();
+    int32_t pid;
+    if (end > offset && parse_pid(text.substr(offset, end - offset), pid)) {
+      snapshot.processes.push_back(Process{pid, offset, end - offset});
+    }
+    offset = end + 1;
+  }
+  // /proc lists pids in order, but not necessarily everything else
+  std::sort(snapshot.processes.begin(), snapshot.processes.end(),
+            [](const Process& a, const Process& b) { return a.pid < b.pid; });
+}
+
+void ProcessSnapshotTracker::append_changes(int32_t pid, std::string_view before,
+                                            std::string_view after, std::string& output) {
+  if (before == after) return;
+
+  // uid, pid and name
+  if (identity(before) != identity(after)) {
+    append_new(after, output);
+    return;
+  }
+
+  split_fields(before, before_fields_);
+  split_fields(after, after_fields_);
+  const size_t start_time = kStartTimeField - kStateField;
+  if (before_fields_.size() != after_fields_.size() ||
+      (start_time < after_fields_.size() &&
+       before_fields_[start_time] != after_fields_[start_time])) {
+    append_new(after, output);
+    return;
+  }
+
+  append_pid('~', pid, output);
+  char field[24];
+  for (size_t i = 0; i < after_fields_.size(); i++) {
+    if (before_fields_[i] == after_fields_[i]) continue;
+    int len = snprintf(field, sizeof(field), " %zu=", i + kStateField);
+    output.append(field, len).append(after_fields_[i]);
+  }
+  output.push_back('\n');
+}
+
+bool ProcessSnapshotTracker::changes_since(uint64_t token, std::string& output) {
+  std::lock_guard<std::mutex> lock(lock_);
+  output.clear();
+
+  const Snapshot *since = nullptr;
+  if ((uint32_t)(token >> 32) == epoch_) {
+    for (const auto& snapshot : snapshots_) {
+      if (snapshot.generation == (uint32_t)token) since = &snapshot;
+    }
+  }
+
+  // Reuses the buffers of the oldest snapshot when this one is to evict it
+  Snapshot current;
+  if (snapshots_.size() >= max_snapshots_ && since != &snapshots_.front()) {
+    current = std::move(snapshots_.front());
+    snapshots_.pop_front();
+  }
+  if (!scan_(current.text)) {
+    return false;
+  }
+  parse(current);
+  current.generation = ++generation_;
+
+  char header[48];
+  int len = snprintf(header, sizeof(header), "%" PRIu64 " %s\n",
+                     ((uint64_t)epoch_ << 32) | current.generation, since ? "delta" : "full");
+  output.append(header, len);
+
+  std::string_view text(current.text);
+  if (since == nullptr) {
+    for (const auto& process : current.processes) {
+      append_new(text.substr(process.offset, process.len), output);
+    }
+  } else {
+    // Both sorted by pid
+    std::string_view before_text(since->text);
+    auto before = since->processes.begin();
+    auto after = current.processes.begin();
+    while (before != since->processes.end() || after != current.processes.end()) {
+      if (after == current.processes.end() ||
+          (before != since->processes.end() && before->pid < after->pid)) {
+        append_pid('-', before->pid, output);
+        output.push_back('\n');
+        ++before;
+      } else if (before == since->processes.end() || after->pid < before->pid) {
+        append_new(text.substr(after->offset, after->len), output);
+        ++after;
+      } else {
+        append_changes(after->pid, before_text.substr(before->offset, before->len),
+                       text.substr(after->offset, after->len), output);
+        ++before;
+        ++after;
+      }
+    }
+  }
+
+  snapshots_.push_back(std::move(current));
+  while (snapshots_.size() > max_snapshots_) {
+    snapshots_.pop_front();
+  }
+  return true;
+}
+
+}
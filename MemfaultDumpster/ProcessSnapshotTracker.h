@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace memfault {
+
+/**
+ * Keeps the last few process snapshots, as returned by CMD_ID_PROC_PID_STAT, so that callers
+ * can be sent how processes changed since the snapshot they last got rather than every
+ * process. Deltas start with a "<token> full" or "<token> delta" line, then have a line per
+ * process that is:
+ *  - new, or that changed its uid, name or start time: "+<uid> <contents of stat>"
+ *  - gone: "-<pid>"
+ *  - changed: "~<pid> <field>=<value> ...", with fields numbered as in proc(5), pid being 1
+ * sorted by pid. Unchanged processes are left out. A full snapshot only has "+" lines.
+ *
+ * Tokens combine an epoch, unique to this tracker, with the generation of the snapshot. 0, a
+ * token from another tracker (e.g. before Dumpster restarted), or one whose snapshot was
+ * evicted by newer ones, gets a full snapshot.
+ */
+class ProcessSnapshotTracker {
+  public:
+    // Fills the output of CMD_ID_PROC_PID_STAT, false on error
+    using ScanFunc = std::function<bool(std::string& output)>;
+
+    static constexpr size_t kDefaultMaxSnapshots = 4;
+
+    ProcessSnapshotTracker(uint32_t epoch, ScanFunc scan,
+                           size_t max_snapshots = kDefaultMaxSnapshots);
+
+    /**
+     * @return false if processes could not be scanned.
+     */
+    bool changes_since(uint64_t token, std::string& output);
+
+  private:
+    struct Process {
+      int32_t pid;
+      // Of its "<uid> <contents of stat>" line in Snapshot::text, without the line end
+      size_t offset;
+      size_t len;
+    };
+
+    struct Snapshot {
+      uint32_t generation;
+      std::string text;
+      // Sorted by pid
+      std::vector<Process> processes;
+    };
+
+    static void parse(Snapshot& snapshot);
+    void append_changes(int32_t pid, std::string_view before, std::string_view after,
+                        std::string& output);
+
+    std::mutex lock_;
+    const uint32_t epoch_;
+    ScanFunc scan_;
+    const size_t max_snapshots_;
+    uint32_t generation_ = 0;
+    // Oldest first
+    std::deque<Snapshot> snapshots_;
+    // Fields of the process being compared, after its name
+    std::vector<std::string_view> before_fields_;
+    std::vector<std::string_view> after_fields_;
+};
+
+}
@@ -0,0 +1,73 @@
+#include "PropertyTracker.h"
+
+namespace memfault {
+
+PropertySource system_property_source() {
+  return PropertySource{system_property_area_serial, for_each_system_property};
+}
+
+PropertyTracker::PropertyTracker(uint32_t epoch, PropertySource source)
+  : epoch_(epoch != 0 ? epoch : 1), source_(std::move(source)) {}
+
+void PropertyTracker::refresh_locked() {
+  // Read first: a change racing with the enumeration is then seen next time
+  uint32_t area_serial = source_.area_serial();
+  if (refreshed_ && area_serial != 0 && area_serial == area_serial_) {
+    return;
+  }
+
+  uint32_t generation = generation_ + 1;
+  bool changed = false;
+  source_.for_each([&](const char *name, const char *value, uint32_t serial) {
+    auto it = properties_.find(name);
+    if (it == properties_.end()) {
+      properties_.emplace(name, Entry{value, serial, generation});
+      changed = true;
+      return;
+    }
+    Entry& entry = it->second;
+    if (serial != 0 && serial == entry.serial) {
+      return;
+    }
+    entry.serial = serial;
+    // Serials also move when a property is set to the value it already had
+    if (entry.value == value) {
+      return;
+    }
+    entry.value = value;
+    entry.generation = generation;
+    changed = true;
+  });
+
+  if (changed) {
+    generation_ = generation;
+  }
+  area_serial_ = area_serial;
+  refreshed_ = true;
+}
+
+PropertyDelta PropertyTracker::changes_since(uint64_t token) {
+  std::lock_guard<std::mutex> lock(lock_);
+  refresh_locked();
+
+  PropertyDelta delta{token_locked(), false, {}};
+  uint32_t since = (uint32_t)token;
+  if ((uint32_t)(token >> 32) != epoch_ || since > generation_) {
+    delta.full = true;
+    since = 0;
+  }
+  for (const auto& it : properties_) {
+    if (it.second.generation > since) {
+      delta.properties.push_back({it.first, it.second.value});
+    }
+  }
+  return delta;
+}
+
+uint64_t PropertyTracker::current_token() {
+  std::lock_guard<std::mutex> lock(lock_);
+  refresh_locked();
+  return token_locked();
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "SystemProperties.h"
+
+namespace memfault {
+
+/**
+ * Where properties are read from, the property areas of the device unless testing.
+ */
+struct PropertySource {
+  std::function<uint32_t()> area_serial;
+  std::function<void(const SystemPropertyFunc&)> for_each;
+};
+
+PropertySource system_property_source();
+
+struct PropertyDelta {
+  // To pass to the next changes_since() call
+  uint64_t token;
+  // Whether properties holds every property rather than the changes since the token given
+  bool full;
+  // Sorted by name
+  std::vector<SystemProperty> properties;
+};
+
+/**
+ * Keeps the last seen value of every property, and the generation it last changed in, so
+ * that callers can be sent what changed since they last asked rather than every property.
+ *
+ * Tokens combine an epoch, unique to this tracker, with a generation that is bumped each
+ * time a change is seen. A token from another tracker (e.g. before Dumpster restarted), or
+ * 0, gets every property.
+ *
+ * Properties are only enumerated when the serial of the property areas moved (Android 8
+ * and up), and then only compared by their serials.
+ */
+class PropertyTracker {
+  public:
+    explicit PropertyTracker(uint32_t epoch, PropertySource source = system_property_source());
+
+    PropertyDelta changes_since(uint64_t token);
+
+    // The token of an empty delta, i.e. "up to date as of now"
+    uint64_t current_token();
+
+  private:
+    struct Entry {
+      std::string value;
+      uint32_t serial;
+      uint32_t generation;
+    };
+
+    void refresh_locked();
+    inline uint64_t token_locked() const { return ((uint64_t)epoch_ << 32) | generation_; }
+
+    std::mutex lock_;
+    const uint32_t epoch_;
+    PropertySource source_;
+    uint32_t generation_ = 0;
+    uint32_t area_serial_ = 0;
+    bool refreshed_ = false;
+    // Looked up by the names of the property areas without copying them
+    std::map<std::string, Entry, std::less<>> properties_;
+};
+
+}
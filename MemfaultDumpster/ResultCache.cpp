@@ -0,0 +1,70 @@
+#include "ResultCache.h"
+
+namespace memfault {
+
+int ResultCache::get(int key, uint64_t ttl_ms, uint64_t version, uint64_t now_ms,
+                     const ComputeFunc& compute, std::string& output) {
+  std::unique_lock<std::mutex> lock(lock_);
+  Entry& entry = entries_[key];
+
+  if (entry.valid && entry.version == version && now_ms - entry.computed_ms < ttl_ms) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    output.assign(*entry.output);
+    return 0;
+  }
+
+  if (entry.flight) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<Flight> flight = entry.flight;
+    flight_done_.wait(lock, [&flight]() { return flight->done; });
+    output.assign(*flight->output);
+    return flight->rv;
+  }
+
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  auto flight = std::make_shared<Flight>();
+  entry.flight = flight;
+  uint64_t generation = entry.generation;
+  lock.unlock();
+
+  auto computed = std::make_shared<std::string>();
+  int rv = compute(*computed);
+
+  lock.lock();
+  // entries_ is a map: entry is still valid, nothing erases entries
+  flight->done = true;
+  flight->rv = rv;
+  flight->output = computed;
+  entry.flight.reset();
+  if (rv == 0 && entry.generation == generation) {
+    entry.output = computed;
+    entry.valid = true;
+    entry.computed_ms = now_ms;
+    entry.version = version;
+  }
+  lock.unlock();
+  flight_done_.notify_all();
+
+  output.assign(*computed);
+  return rv;
+}
+
+void ResultCache::invalidate(int key) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return;
+  it->second.valid = false;
+  it->second.output.reset();
+  it->second.generation++;
+}
+
+void ResultCache::invalidate_all() {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto& it : entries_) {
+    it.second.valid = false;
+    it.second.output.reset();
+    it.second.generation++;
+  }
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace memfault {
+
+/**
+ * Caches the outputs of commands whose results rarely change, by key.
+ *
+ * A result is reused for ttl_ms, as long as the version passed along is the same (e.g. the
+ * serial of the property areas for property commands) and it was not invalidated. Callers
+ * asking for a key while it is being computed wait for that computation rather than running
+ * their own. Only successful (0) results are cached.
+ */
+class ResultCache {
+  public:
+    using ComputeFunc = std::function<int(std::string& output)>;
+
+    /**
+     * Fills output with the cached result of key, or with the result of compute.
+     *
+     * @return the status code of compute.
+     */
+    int get(int key, uint64_t ttl_ms, uint64_t version, uint64_t now_ms,
+            const ComputeFunc& compute, std::string& output);
+
+    void invalidate(int key);
+    void invalidate_all();
+
+    // Served from the cache, or by waiting for another caller's computation
+    inline uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    inline uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+  private:
+    struct Flight {
+      bool done = false;
+      int rv = 0;
+      std::shared_ptr<const std::string> output;
+    };
+
+    struct Entry {
+      std::shared_ptr<const std::string> output;
+      bool valid = false;
+      uint64_t computed_ms = 0;
+      uint64_t version = 0;
+      // Bumped by invalidate(): results computed since are not cached
+      uint64_t generation = 0;
+      std::shared_ptr<Flight> flight;
+    };
+
+    std::mutex lock_;
+    std::condition_variable flight_done_;
+    std::map<int, Entry> entries_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+}
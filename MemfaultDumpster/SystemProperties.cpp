@@ -0,0 +1,98 @@
+#include "SystemProperties.h"
+
+#include <algorithm>
+#include <ctime>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#if PLATFORM_SDK_VERSION >= 28
+#include <property_info_parser/property_info_parser.h>
+#endif
+#endif
+
+namespace memfault {
+
+void for_each_system_property(const SystemPropertyFunc& func) {
+#ifdef __ANDROID__
+  __system_property_foreach([](const prop_info *pi, void *cookie) {
+#if PLATFORM_SDK_VERSION >= 26
+    // Also reads the long values of ro. properties
+    __system_property_read_callback(pi, [](void *cookie, const char *name, const char *value,
+                                           uint32_t serial) {
+      (*static_cast<const SystemPropertyFunc *>(cookie))(name, value, serial);
+    }, cookie);
+#else
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+    __system_property_read(pi, name, value);
+    (*static_cast<const SystemPropertyFunc *>(cookie))(name, value, 0);
+#endif
+  }, const_cast<SystemPropertyFunc *>(&func));
+#endif
+}
+
+std::vector<SystemProperty> read_system_properties() {
+  std::vector<SystemProperty> properties;
+  for_each_system_property([&](const char *name, const char *value, uint32_t serial) {
+    properties.push_back({name, value});
+  });
+
+  std::sort(properties.begin(), properties.end(),
+            [](const SystemProperty& a, const SystemProperty& b) { return a.name < b.name; });
+  return properties;
+}
+
+uint32_t system_property_area_serial() {
+#if defined(__ANDROID__) && PLATFORM_SDK_VERSION >= 26
+  return __system_property_area_serial();
+#else
+  return 0;
+#endif
+}
+
+uint32_t wait_system_property_change(uint32_t serial, std::chrono::milliseconds timeout) {
+#if defined(__ANDROID__) && PLATFORM_SDK_VERSION >= 26
+  struct timespec relative_timeout = {
+    .tv_sec = (time_t)(timeout.count() / 1000),
+    .tv_nsec = (long)(timeout.count() % 1000) * 1000000,
+  };
+  uint32_t new_serial;
+  // Without a property, waits for any of them to change
+  if (__system_property_wait(nullptr, serial, &new_serial, &relative_timeout)) {
+    return new_serial;
+  }
+#endif
+  return serial;
+}
+
+bool read_system_property_types(std::vector<SystemProperty>& properties) {
+#if defined(__ANDROID__) && PLATFORM_SDK_VERSION >= 28
+  android::properties::PropertyInfoAreaFile property_info_area;
+  if (!property_info_area.LoadDefaultPath()) {
+    return false;
+  }
+  for (auto& property : properties) {
+    const char *type = nullptr;
+    property_info_area->GetPropertyInfo(property.name.c_str(), nullptr, &type);
+    property.value = type != nullptr ? type : "string";
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void format_getprop(const std::vector<SystemProperty>& properties, std::string& output) {
+  size_t size = 0;
+  for (const auto& property : properties) {
+    size += property.name.size() + property.value.size() + 7;
+  }
+
+  output.clear();
+  output.reserve(size);
+  for (const auto& property : properties) {
+    output.append("[").append(property.name).append("]: [").append(property.value).append("]\n");
+  }
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace memfault {
+
+struct SystemProperty {
+  std::string name;
+  // The value, or the type for read_system_property_types()
+  std::string value;
+};
+
+/**
+ * Reads every property this process can read from the property areas, without running
+ * getprop. Sorted by name, as getprop lists them.
+ */
+std::vector<SystemProperty> read_system_properties();
+
+// Called with the name, value and serial of a property. Serials are 0 before Android 8.
+using SystemPropertyFunc = std::function<void(const char *name, const char *value, uint32_t serial)>;
+
+/**
+ * Calls func for every property this process can read, in no particular order.
+ */
+void for_each_system_property(const SystemPropertyFunc& func);
+
+/**
+ * The serial of the property areas, which changes with every property update. 0 before
+ * Android 8.
+ */
+uint32_t system_property_area_serial();
+
+/**
+ * Waits for the area serial to move past serial, for up to timeout.
+ *
+ * @return the new area serial, or serial on timeout (and right away before Android 8).
+ */
+uint32_t wait_system_property_change(uint32_t serial, std::chrono::milliseconds timeout);
+
+/**
+ * Replaces the values of properties with their types from the property_info area, as
+ * `getprop -T` does ("string" when unspecified).
+ *
+ * @return false if the property_info area cannot be loaded (or before Android 9, which has
+ * none).
+ */
+bool read_system_property_types(std::vector<SystemProperty>& properties);
+
+/**
+ * Formats properties the way getprop prints them, one "[<name>]: [<value>]" line each.
+ */
+void format_getprop(const std::vector<SystemProperty>& properties, std::string& output);
+
+}
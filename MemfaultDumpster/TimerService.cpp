@@ -0,0 +1,168 @@
+#define LOG_TAG "mflt-timers"
+
+#include "TimerService.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <log/log.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace memfault {
+
+static uint64_t boottime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t deadline_after(const std::chrono::nanoseconds& period) {
+  return boottime_ns() + (uint64_t)std::max<int64_t>(period.count(), 0);
+}
+
+TimerService::TimerService()
+  : timer_fd_(timerfd_create(CLOCK_BOOTTIME, TFD_CLOEXEC | TFD_NONBLOCK)),
+    event_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  if (timer_fd_ < 0 || event_fd_ < 0) {
+    ALOGE("Failed to create timer service fds: %d", errno);
+  }
+  thread_ = std::thread(&TimerService::run, this);
+  pthread_setname_np(thread_.native_handle(), "timers");
+}
+
+TimerService::~TimerService() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+  }
+  notify();
+  thread_.join();
+  close(timer_fd_);
+  close(event_fd_);
+}
+
+TimerService& TimerService::get() {
+  static TimerService service;
+  return service;
+}
+
+uint64_t TimerService::add(PeriodFunc period_func, std::function<void()> func, TimerOptions options) {
+  // Period functions may be slow (e.g. take other locks), call them without holding ours
+  uint64_t deadline_ns = deadline_after(period_func());
+
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    id = next_id_++;
+    timers_.emplace(id, Timer{std::move(period_func), std::move(func), options, deadline_ns});
+  }
+  notify();
+  return id;
+}
+
+void TimerService::remove(uint64_t id) {
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (std::this_thread::get_id() != thread_.get_id()) {
+      callback_done_.wait(lock, [&]() { return running_id_ != id; });
+    }
+    timers_.erase(id);
+  }
+  notify();
+}
+
+void TimerService::notify() {
+  uint64_t one = 1;
+  if (write(event_fd_, &one, sizeof(one)) < 0) {
+    ALOGW("Failed to notify the timer service: %d", errno);
+  }
+}
+
+void TimerService::arm_locked() {
+  uint64_t wake_ns = 0;
+  for (auto& it : timers_) {
+    const Timer& timer = it.second;
+    if (!timer.options.critical) continue;
+    uint64_t latest_ns = timer.deadline_ns + (uint64_t)timer.options.window.count();
+    if (wake_ns == 0 || latest_ns < wake_ns) wake_ns = latest_ns;
+  }
+
+  // An all-zero value disarms the timer
+  struct itimerspec spec = {};
+  if (wake_ns != 0) {
+    spec.it_value.tv_sec = wake_ns / 1000000000ULL;
+    spec.it_value.tv_nsec = wake_ns % 1000000000ULL;
+  }
+  timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void TimerService::run() {
+  struct pollfd pfds[2] = {
+    {timer_fd_, POLLIN, 0},
+    {event_fd_, POLLIN, 0},
+  };
+
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopping_) {
+    arm_locked();
+    lock.unlock();
+    int ret = poll(pfds, 2, -1);
+    lock.lock();
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      ALOGE("Timer service poll failed: %d", errno);
+      break;
+    }
+
+    uint64_t count;
+    bool timer_fired = (pfds[0].revents & POLLIN) && read(timer_fd_, &count, sizeof(count)) > 0;
+    if (pfds[1].revents & POLLIN) {
+      (void)read(event_fd_, &count, sizeof(count));
+    }
+    if (stopping_) break;
+
+    uint64_t now_ns = boottime_ns();
+    std::vector<uint64_t> due;
+    for (auto& it : timers_) {
+      if (it.second.deadline_ns <= now_ns) due.push_back(it.first);
+    }
+
+    // The timer that must fire now pays for the wakeup, the others ride along. Without a
+    // timer expiration, something else woke the service up and they all ride along.
+    if (timer_fired) {
+      wakeups_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!due.empty()) {
+      wakeups_avoided_.fetch_add(due.size() - (timer_fired ? 1 : 0), std::memory_order_relaxed);
+    }
+
+    for (uint64_t id : due) {
+      auto it = timers_.find(id);
+      if (it == timers_.end()) continue;
+
+      // Copied, the callback may remove its own timer
+      std::function<void()> func = it->second.func;
+      PeriodFunc period_func = it->second.period_func;
+      running_id_ = id;
+      lock.unlock();
+      func();
+      uint64_t deadline_ns = deadline_after(period_func());
+      lock.lock();
+      running_id_ = 0;
+      callback_done_.notify_all();
+
+      it = timers_.find(id);
+      if (it != timers_.end()) {
+        it->second.deadline_ns = deadline_ns;
+      }
+    }
+  }
+}
+
+}
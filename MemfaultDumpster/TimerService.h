@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace memfault {
+
+struct TimerOptions {
+  // How late the timer may fire, so that it can share a wakeup with other timers
+  std::chrono::nanoseconds window{0};
+  // Non-critical timers never wake the service up on their own: they fire with the next
+  // wakeup (for a critical timer) at or after their deadline.
+  bool critical = true;
+};
+
+/**
+ * Runs the periodic work of Dumpster from a single thread and a single CLOCK_BOOTTIME
+ * timerfd, coalescing the wakeups of its timers.
+ *
+ * The service sleeps until the earliest time a critical timer must fire (its deadline plus
+ * window), then fires every timer that is due. Waking up as late as the windows allow
+ * gives the other timers the best chance to be due too.
+ *
+ * Callbacks run on the service thread and must not block for long: they delay every other
+ * timer.
+ */
+class TimerService {
+  public:
+    using PeriodFunc = std::function<std::chrono::nanoseconds()>;
+
+    TimerService();
+    ~TimerService();
+
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    /**
+     * The service shared by Dumpster.
+     */
+    static TimerService& get();
+
+    /**
+     * Registers a repeating timer. The period is re-evaluated after each call of func.
+     *
+     * @return an id for remove().
+     */
+    uint64_t add(PeriodFunc period_func, std::function<void()> func, TimerOptions options);
+
+    /**
+     * Unregisters a timer, waiting for its callback to return if it is running (unless
+     * called from that callback).
+     */
+    void remove(uint64_t id);
+
+    // Times the service woke up for a timer
+    inline uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+    // Timer expirations that did not cost a wakeup of their own
+    inline uint64_t wakeups_avoided() const { return wakeups_avoided_.load(std::memory_order_relaxed); }
+
+  private:
+    struct Timer {
+      PeriodFunc period_func;
+      std::function<void()> func;
+      TimerOptions options;
+      uint64_t deadline_ns;
+    };
+
+    void run();
+    void arm_locked();
+    void notify();
+
+    int timer_fd_;
+    int event_fd_;
+
+    std::mutex lock_;
+    std::condition_variable callback_done_;
+    std::map<uint64_t, Timer> timers_;
+    uint64_t next_id_ = 1;
+    // Timer whose callback is running, 0 for none
+    uint64_t running_id_ = 0;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> wakeups_{0};
+    std::atomic<uint64_t> wakeups_avoided_{0};
+    std::thread thread_;
+};
+
+}
@@ -0,0 +1,92 @@
+#define LOG_TAG "mflt-clog"
+
+#include "UidFilter.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <log/log.h>
+
+#include "ClogTier.h"
+
+namespace memfault {
+
+static bool parse_uid(const std::string& value, uint32_t *uid) {
+  if (value.empty() || value.size() > 10 ||
+      value.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  uint64_t number = strtoull(value.c_str(), nullptr, 10);
+  if (number > INT32_MAX) return false;
+  *uid = (uint32_t)number;
+  return true;
+}
+
+static bool parse_uid_range(const std::string& value, uint32_t *first, uint32_t *last) {
+  size_t dash = value.find('-');
+  if (dash == std::string::npos) {
+    if (!parse_uid(value, first)) return false;
+    *last = *first;
+    return true;
+  }
+  return parse_uid(value.substr(0, dash), first) && parse_uid(value.substr(dash + 1), last) &&
+      *first <= *last;
+}
+
+UidFilter::UidFilter(const std::vector<std::string>& rules,
+                     const std::string& packages_list_path) {
+  // Package name -> priorities it is captured at
+  std::multimap<std::string, android_LogPriority> packages;
+
+  for (auto& spec : rules) {
+    size_t first_colon = spec.find(':');
+    size_t last_colon = spec.rfind(':');
+    android_LogPriority priority;
+    if (first_colon == std::string::npos || first_colon == last_colon ||
+        !parse_priority(spec.substr(last_colon + 1), &priority)) {
+      ALOGW("clog: ignoring invalid uid rule: %s", spec.c_str());
+      continue;
+    }
+    std::string kind = spec.substr(0, first_colon);
+    std::string value = spec.substr(first_colon + 1, last_colon - first_colon - 1);
+
+    Rule rule{0, 0, false, priority};
+    if (kind == "uid" && parse_uid_range(value, &rule.first, &rule.last)) {
+      rules_.push_back(rule);
+    } else if (kind == "package" && !value.empty()) {
+      packages.emplace(value, priority);
+    } else {
+      ALOGW("clog: ignoring invalid uid rule: %s", spec.c_str());
+    }
+  }
+  if (packages.empty()) return;
+
+  // <name> <app id> <debuggable> <data dir> <seinfo> <gids>...
+  std::ifstream list(packages_list_path);
+  if (!list) {
+    ALOGW("clog: cannot read %s, ignoring package rules", packages_list_path.c_str());
+    return;
+  }
+  std::string line;
+  size_t resolved = 0;
+  while (resolved < packages.size() && std::getline(list, line)) {
+    std::istringstream fields(line);
+    std::string name, uid_field;
+    uint32_t app_id;
+    if (!(fields >> name >> uid_field) || !parse_uid(uid_field, &app_id)) continue;
+
+    auto range = packages.equal_range(name);
+    for (auto it = range.first; it != range.second; ++it) {
+      rules_.push_back(Rule{app_id % kPerUserUidRange, app_id % kPerUserUidRange, true,
+                            it->second});
+      resolved++;
+    }
+  }
+  if (resolved < packages.size()) {
+    ALOGW("clog: %zu package rule(s) did not resolve to a uid", packages.size() - resolved);
+  }
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <android/log.h>
+
+#define PACKAGES_LIST_FILE "/data/system/packages.list"
+
+namespace memfault {
+
+// Android uids are <user id> * kPerUserUidRange + <app id>
+static constexpr uint32_t kPerUserUidRange = 100000;
+
+/**
+ * Captures lines by the uid that logged them, on top of the tag filter specs: a line is
+ * written if either its tag passes the filter specs or its uid matches a rule and its
+ * priority is at least the rule's.
+ *
+ * Rules:
+ *  - "uid:<uid>:<priority>" or "uid:<first>-<last>:<priority>": uids in the range
+ *  - "package:<name>:<priority>": the uid of a package, for every user
+ *
+ * e.g. "package:com.example.app:D" captures everything from that app at debug level and
+ * above. Packages are resolved once, when the filter is built, from packages.list (see the
+ * packages_list_file rule of sepolicy/common/memfault_dumpster.te).
+ */
+class UidFilter {
+  public:
+    explicit UidFilter(const std::vector<std::string>& rules,
+                       const std::string& packages_list_path = PACKAGES_LIST_FILE);
+
+    inline bool empty() const { return rules_.empty(); }
+
+    /**
+     * Whether a line of uid and priority is captured by a rule. Rules are expected to be few,
+     * they are scanned linearly.
+     */
+    inline bool matches(int32_t uid, android_LogPriority priority) const {
+      if (uid < 0) return false;
+      for (auto& rule : rules_) {
+        uint32_t id = rule.per_user ? (uint32_t)uid % kPerUserUidRange : (uint32_t)uid;
+        if (id >= rule.first && id <= rule.last && priority >= rule.min_priority) return true;
+      }
+      return false;
+    }
+
+  private:
+    struct Rule {
+      uint32_t first;
+      uint32_t last;
+      // Matches the app id of the uid rather than the uid
+      bool per_user;
+      android_LogPriority min_priority;
+    };
+
+    std::vector<Rule> rules_;
+};
+
+}
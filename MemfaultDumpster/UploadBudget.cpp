@@ -0,0 +1,33 @@
+#include "UploadBudget.h"
+
+#include <algorithm>
+
+namespace memfault {
+
+void UploadBudget::configure(uint64_t budget_bytes, uint64_t period_ms, uint64_t now_ms) {
+  if (budget_bytes == 0 || period_ms == 0) {
+    budget_bytes = 0;
+    period_ms = 0;
+  }
+  if (budget_bytes == budget_bytes_ && period_ms == period_ms_) return;
+
+  // Start full: the previous budget, if any, no longer says anything about this one
+  budget_bytes_ = budget_bytes;
+  period_ms_ = period_ms;
+  last_refill_ms_ = now_ms;
+  tokens_ = (double)budget_bytes;
+}
+
+void UploadBudget::refill(uint64_t now_ms) {
+  if (!enabled() || now_ms <= last_refill_ms_) return;
+  double earned = (double)(now_ms - last_refill_ms_) * budget_bytes_ / period_ms_;
+  tokens_ = std::min(tokens_ + earned, (double)budget_bytes_);
+  last_refill_ms_ = now_ms;
+}
+
+uint64_t UploadBudget::used_bytes() const {
+  double used = (double)budget_bytes_ - tokens_;
+  return used <= 0 ? 0 : (uint64_t)used;
+}
+
+}
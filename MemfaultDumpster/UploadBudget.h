@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace memfault {
+
+/**
+ * Token bucket limiting the bytes of continuous log written, and thus uploaded, per period.
+ *
+ * The bucket holds up to budget_bytes and refills at budget_bytes per period_ms. Writes may
+ * overdraw it by a line: the debt is paid back before anything else is written, so that
+ * over any period the output stays within the budget plus one line.
+ */
+class UploadBudget {
+  public:
+    /**
+     * (Re)configures the budget, 0 bytes or period disabling it. A budget that is already
+     * configured the same way keeps its tokens.
+     */
+    void configure(uint64_t budget_bytes, uint64_t period_ms, uint64_t now_ms);
+
+    inline bool enabled() const { return budget_bytes_ != 0; }
+
+    /**
+     * Adds the tokens earned since the last refill.
+     */
+    void refill(uint64_t now_ms);
+
+    /**
+     * Bytes of the bucket currently spent, up to budget_bytes() and beyond when overdrawn.
+     */
+    uint64_t used_bytes() const;
+    inline uint64_t budget_bytes() const { return budget_bytes_; }
+
+    inline void consume(size_t bytes) { tokens_ -= (double)bytes; }
+
+  private:
+    uint64_t budget_bytes_ = 0;
+    uint64_t period_ms_ = 0;
+    uint64_t last_refill_ms_ = 0;
+    double tokens_ = 0;
+};
+
+}
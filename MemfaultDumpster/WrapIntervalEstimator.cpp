@@ -0,0 +1,42 @@
+#include "WrapIntervalEstimator.h"
+
+#include <algorithm>
+
+namespace memfault {
+
+void WrapIntervalEstimator::set_buffer_size(uint32_t log_id, size_t bytes) {
+  if (log_id >= kMaxLogBuffers) return;
+  buffers_[log_id].size = bytes;
+}
+
+void WrapIntervalEstimator::end_batch() {
+  for (auto& buffer : buffers_) {
+    // A single entry, or entries all logged within the same ms, say nothing about the rate
+    uint64_t span_ms = (buffer.newest_ns - buffer.oldest_ns) / 1000000ULL;
+    if (buffer.window_bytes != 0 && span_ms != 0) {
+      double rate = (double)buffer.window_bytes / span_ms;
+      buffer.bytes_per_ms = std::max(rate, buffer.bytes_per_ms / 2);
+    }
+    buffer.window_bytes = 0;
+    buffer.oldest_ns = 0;
+    buffer.newest_ns = 0;
+  }
+}
+
+uint64_t WrapIntervalEstimator::safe_interval_ms() const {
+  uint64_t interval_ms = 0;
+  for (auto& buffer : buffers_) {
+    if (buffer.size == 0 || buffer.bytes_per_ms <= 0) continue;
+    uint64_t turnover_ms = (uint64_t)(buffer.size / buffer.bytes_per_ms * kWrapIntervalSafetyFactor);
+    turnover_ms = std::max<uint64_t>(turnover_ms, 1);
+    interval_ms = interval_ms == 0 ? turnover_ms : std::min(interval_ms, turnover_ms);
+  }
+  return interval_ms;
+}
+
+uint64_t clamp_wrap_interval_ms(uint64_t safe_interval_ms, uint64_t min_ms, uint64_t max_ms) {
+  if (safe_interval_ms == 0 || min_ms >= max_ms) return max_ms;
+  return std::min(std::max(safe_interval_ms, min_ms), max_ms);
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <android/log.h>
+
+namespace memfault {
+
+// Fraction of the turnover time of the busiest buffer used as the wrap interval
+static constexpr double kWrapIntervalSafetyFactor = 0.5;
+static constexpr size_t kMaxLogBuffers = 8;
+
+/**
+ * Estimates how often the reader needs to run for no buffer to turn over (logd pruning
+ * entries that were not read yet) in between, from the entries of each read batch.
+ *
+ * A batch covering [oldest, newest] entry timestamps and holding N bytes of a buffer gives
+ * that buffer's write rate, and with the buffer size, its turnover time. Rates react to
+ * bursts immediately but only decay by half per batch, so that a lull does not stretch the
+ * interval past the next burst.
+ */
+class WrapIntervalEstimator {
+  public:
+    void set_buffer_size(uint32_t log_id, size_t bytes);
+
+    /**
+     * Accounts for an entry of the current batch, bytes including its header.
+     */
+    inline void record(uint32_t log_id, uint32_t sec, uint32_t nsec, size_t bytes) {
+      if (log_id >= kMaxLogBuffers) return;
+      Buffer& buffer = buffers_[log_id];
+      uint64_t ns = (uint64_t)sec * 1000000000ULL + nsec;
+      if (buffer.window_bytes == 0 || ns < buffer.oldest_ns) buffer.oldest_ns = ns;
+      if (ns > buffer.newest_ns) buffer.newest_ns = ns;
+      buffer.window_bytes += bytes;
+    }
+
+    /**
+     * Folds the current batch into the rates.
+     */
+    void end_batch();
+
+    /**
+     * Longest safe interval in ms, 0 until a buffer with a known size has been measured.
+     */
+    uint64_t safe_interval_ms() const;
+
+  private:
+    struct Buffer {
+      size_t size = 0;
+      uint64_t window_bytes = 0;
+      uint64_t oldest_ns = 0;
+      uint64_t newest_ns = 0;
+      double bytes_per_ms = 0;
+    };
+    std::array<Buffer, kMaxLogBuffers> buffers_{};
+};
+
+/**
+ * The wrap interval to use: the estimate clamped to [min_ms, max_ms], max_ms while there is
+ * no estimate.
+ */
+uint64_t clamp_wrap_interval_ms(uint64_t safe_interval_ms, uint64_t min_ms, uint64_t max_ms);
+
+}
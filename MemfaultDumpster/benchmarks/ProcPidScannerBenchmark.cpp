@@ -0,0 +1,194 @@
+/*
+ * Measures CMD_ID_PROC_PID_STAT over a synthetic /proc of 800 processes, the size of a busy
+ * phone, and over the /proc of the host or device. The baseline is the service's previous
+ * implementation: opendir, then a path and a string per file read, and an istringstream
+ * per status line. Also measures the proto variant of the scan, and the size of the deltas
+ * of ProcessSnapshotTracker between consecutive scans against the full output.
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ProcPidScanner.h"
+#include "ProcessSnapshotTracker.h"
+
+using memfault::ProcPidScanner;
+using memfault::ProcessSnapshotTracker;
+
+namespace {
+
+constexpr int kSyntheticPids = 800;
+
+class SyntheticProc {
+  public:
+    SyntheticProc() {
+      char path[] = "/tmp/ProcPidScannerBenchmarkXXXXXX";
+      root_ = mkdtemp(path);
+      for (int pid = 1; pid <= kSyntheticPids; pid++) {
+        std::string dir = root_ + "/" + std::to_string(pid);
+        mkdir(dir.c_str(), 0755);
+        std::ofstream(dir + "/stat")
+            << pid << " (proc" << pid << ") S 1 " << pid
+            << " 0 0 -1 4194560 25367 0 12 0 1203 987 0 0 20 0 31 0 1540 15472640000 28190"
+               " 18446744073709551615 1 1 0 0 0 0 4612 1 1073775864 0 0 0 17 3 0 0 0 0 0"
+               " 0 0 0 0 0 0 0 0\n";
+        // Every other process is an app, the real uid is read from status
+        std::ofstream(dir + "/status")
+            << "Name:\tproc" << pid << "\nUmask:\t0077\nState:\tS (sleeping)\nTgid:\t" << pid
+            << "\nNgid:\t0\nPid:\t" << pid << "\nPPid:\t1\nTracerPid:\t0\nUid:\t"
+            << (pid % 2 ? 0 : 10000 + pid) << "\t" << (pid % 2 ? 0 : 10000 + pid)
+            << "\t0\t0\nGid:\t0\t0\t0\t0\nFDSize:\t64\nGroups:\t3003 9997\nVmPeak:\t15109432 kB\n"
+               "VmSize:\t14821520 kB\nVmRSS:\t112764 kB\nThreads:\t31\n";
+      }
+      for (const char *name : {"self", "sys", "net"}) {
+        mkdir((root_ + "/" + name).c_str(), 0755);
+      }
+    }
+
+    ~SyntheticProc() {
+      std::string command = "rm -rf " + root_;
+      int rv = system(command.c_str());
+      (void)rv;
+    }
+
+    const std::string& root() const { return root_; }
+
+  private:
+    std::string root_;
+};
+
+const SyntheticProc& syntheticProc() {
+  static SyntheticProc proc;
+  return proc;
+}
+
+bool readFileToString(const std::string& path, std::string& contents) {
+  std::ifstream file(path);
+  if (!file) return false;
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+std::string legacyProcPidStats(const std::string& root) {
+  std::vector<int> pids;
+  DIR *dir = opendir(root.c_str());
+  if (dir == nullptr) return "";
+  dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string name = entry->d_name;
+    if (entry->d_type == DT_DIR && name.find_first_not_of("0123456789") == std::string::npos) {
+      pids.push_back(std::stoi(name));
+    }
+  }
+  closedir(dir);
+
+  std::stringstream buffer;
+  for (int pid : pids) {
+    std::string status;
+    if (!readFileToString(root + "/" + std::to_string(pid) + "/status", status)) continue;
+    int uid = -1;
+    std::istringstream statusStream(status);
+    std::string line;
+    while (std::getline(statusStream, line)) {
+      if (line.find("Uid:") == 0) {
+        std::istringstream uidStream(line);
+        std::string uidLabel;
+        uidStream >> uidLabel >> uid;
+        break;
+      }
+    }
+    if (uid == -1) continue;
+    std::string stat;
+    if (readFileToString(root + "/" + std::to_string(pid) + "/stat", stat) && !stat.empty()) {
+      buffer << uid << " " << stat << std::endl;
+    }
+  }
+  return buffer.str();
+}
+
+void BM_LegacySynthetic(benchmark::State& state) {
+  const std::string& root = syntheticProc().root();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(legacyProcPidStats(root));
+  }
+  state.SetItemsProcessed(state.iterations() * kSyntheticPids);
+}
+BENCHMARK(BM_LegacySynthetic)->Unit(benchmark::kMillisecond);
+
+void BM_ScannerSynthetic(benchmark::State& state) {
+  ProcPidScanner scanner(syntheticProc().root().c_str(), state.range(0));
+  std::string output;
+  for (auto _ : state) {
+    scanner.scan(output);
+    benchmark::DoNotOptimize(output);
+  }
+  state.SetItemsProcessed(state.iterations() * kSyntheticPids);
+}
+BENCHMARK(BM_ScannerSynthetic)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_ScannerProtoSynthetic(benchmark::State& state) {
+  ProcPidScanner scanner(syntheticProc().root().c_str(), state.range(0));
+  memfault::ProcPidStatsProto proto;
+  std::string output;
+  for (auto _ : state) {
+    scanner.scan(proto);
+    proto.SerializeToString(&output);
+    benchmark::DoNotOptimize(output);
+  }
+  state.SetItemsProcessed(state.iterations() * kSyntheticPids);
+}
+BENCHMARK(BM_ScannerProtoSynthetic)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_LegacyProc(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(legacyProcPidStats("/proc"));
+  }
+}
+BENCHMARK(BM_LegacyProc)->Unit(benchmark::kMillisecond);
+
+void BM_ScannerProc(benchmark::State& state) {
+  ProcPidScanner scanner("/proc", state.range(0));
+  std::string output;
+  for (auto _ : state) {
+    scanner.scan(output);
+    benchmark::DoNotOptimize(output);
+  }
+}
+BENCHMARK(BM_ScannerProc)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_ProcessChangesProc(benchmark::State& state) {
+  ProcPidScanner scanner("/proc");
+  size_t full_bytes = 0;
+  ProcessSnapshotTracker tracker(1, [&](std::string& output) {
+    bool ok = scanner.scan(output);
+    full_bytes = output.size();
+    return ok;
+  });
+  std::string output;
+  tracker.changes_since(0, output);
+  uint64_t token = std::stoull(output);
+  size_t delta_bytes = 0;
+  for (auto _ : state) {
+    tracker.changes_since(token, output);
+    token = std::stoull(output);
+    delta_bytes = output.size();
+  }
+  state.counters["full_bytes"] = full_bytes;
+  state.counters["delta_bytes"] = delta_bytes;
+}
+BENCHMARK(BM_ProcessChangesProc)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
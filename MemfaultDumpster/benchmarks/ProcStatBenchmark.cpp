@@ -0,0 +1,66 @@
+/*
+ * Measures CMD_ID_PROC_STAT and CMD_ID_PROC_STAT_SUMMARY: reading /proc/stat through the
+ * persistent fd, parsing it and formatting the summary. Running `cat /proc/stat`, as the
+ * service used to, is the baseline. Runs against the /proc/stat of the host or device.
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+
+#include "ProcStat.h"
+
+using memfault::ProcStat;
+using memfault::ProcStatReader;
+
+namespace {
+
+void BM_CatProcStat(benchmark::State& state) {
+  char buffer[4096];
+  for (auto _ : state) {
+    std::string output;
+    FILE *cat = popen("cat /proc/stat", "r");
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), cat)) > 0) output.append(buffer, n);
+    pclose(cat);
+    benchmark::DoNotOptimize(output);
+  }
+}
+BENCHMARK(BM_CatProcStat)->Unit(benchmark::kMicrosecond);
+
+void BM_ReadProcStat(benchmark::State& state) {
+  ProcStatReader reader;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    bytes += reader.read().size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ReadProcStat)->Unit(benchmark::kMicrosecond);
+
+void BM_ParseProcStat(benchmark::State& state) {
+  ProcStatReader reader;
+  std::string text(reader.read());
+  ProcStat stat;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(memfault::parse_proc_stat(text, stat));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ParseProcStat);
+
+void BM_ProcStatSummary(benchmark::State& state) {
+  ProcStatReader reader;
+  ProcStat stat;
+  std::string summary;
+  for (auto _ : state) {
+    memfault::parse_proc_stat(reader.read(), stat);
+    memfault::format_proc_stat_summary(stat, summary);
+    benchmark::DoNotOptimize(summary);
+  }
+}
+BENCHMARK(BM_ProcStatSummary)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
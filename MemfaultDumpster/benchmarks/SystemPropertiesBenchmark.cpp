@@ -0,0 +1,63 @@
+/*
+ * Compares the two ways of serving CMD_ID_GETPROP: running /system/bin/getprop into a
+ * temporary file as the service used to, and enumerating the property areas in-process.
+ * Both include the conversion to the String16 sent back over binder. Device only.
+ */
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <DumpstateUtil.h>
+#include <utils/String16.h>
+
+#include "SystemProperties.h"
+
+using android::os::dumpstate::CommandOptions;
+using android::os::dumpstate::RunCommandToFd;
+
+namespace {
+
+void BM_GetpropExec(benchmark::State& state) {
+  for (auto _ : state) {
+    TemporaryFile tempFile;
+    RunCommandToFd(tempFile.fd, "", {"/system/bin/getprop"},
+                   CommandOptions::WithTimeout(20).Always().Build());
+    std::string output;
+    android::base::ReadFileToString(tempFile.path, &output);
+    android::String16 output16(output.c_str());
+    benchmark::DoNotOptimize(output16);
+  }
+}
+BENCHMARK(BM_GetpropExec)->Unit(benchmark::kMicrosecond);
+
+void BM_GetpropInProcess(benchmark::State& state) {
+  std::string output;
+  for (auto _ : state) {
+    memfault::format_getprop(memfault::read_system_properties(), output);
+    android::String16 output16(output.c_str());
+    benchmark::DoNotOptimize(output16);
+  }
+  state.SetBytesProcessed(state.iterations() * output.size());
+}
+BENCHMARK(BM_GetpropInProcess)->Unit(benchmark::kMicrosecond);
+
+void BM_GetpropTypesInProcess(benchmark::State& state) {
+  std::string output;
+  for (auto _ : state) {
+    auto properties = memfault::read_system_properties();
+    if (!memfault::read_system_property_types(properties)) {
+      state.SkipWithError("No property_info area");
+      break;
+    }
+    memfault::format_getprop(properties, output);
+    android::String16 output16(output.c_str());
+    benchmark::DoNotOptimize(output16);
+  }
+}
+BENCHMARK(BM_GetpropTypesInProcess)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,348 @@
+/*
+ * Host replay harness for the continuous logcat pipeline.
+ *
+ * Runs the real ContinuousLogcat reader against a fake liblog reader (FakeLiblog.cpp) that
+ * replays a recorded (`logcat -B`) or synthetic log_msg stream at a controlled rate, with
+ * optional injected read errors, and reports:
+ *  - lines_per_sec: records processed per second of wall time
+ *  - cpu_ns_per_line: process CPU time per record
+ *  - allocs_per_line: operator new calls per record
+ *  - latency_*_us: time from a record's arrival to the reader being done with it
+ *
+ * With --gate=<file>, exits with an error when a metric is outside the limits listed in
+ * the file (see gate.txt), so that clog performance changes can be checked against it.
+ * MemfaultDumpsterReplayGate runs it as a host test (see run_gate.sh), checking the metrics
+ * that do not depend on the machine. MemfaultDumpsterReplayBenchmark checks the throughput
+ * against benchmark_gate.txt (see run_benchmark.sh), it is opt-in.
+ *
+ * Every run writes its continuous log files to a directory of its own, created under
+ * $TEST_TMPDIR (or /tmp) and deleted on exit.
+ *
+ * Other options:
+ *   --records=N            number of synthetic records (default 100000)
+ *   --capture=FILE         replay a `logcat -B` capture instead
+ *   --rate=N               records per second, 0 for as fast as possible (default 0)
+ *   --wrap-records=N       records pending before a wrap read returns (default 0)
+ *   --buffer-bytes=N       size reported for every log buffer (default 256 kB)
+ *   --fault=AFTER:ERROR    return -ERROR (EAGAIN, EBADF or EINTR) after AFTER records,
+ *                          may be repeated
+ *   --filter=SPEC          filter spec, may be repeated. Defaults to <tag>:V for every tag
+ *                          of the text records. Note that "*:<priority>" specs are
+ *                          overridden by the "*:S" ContinuousLogcat appends.
+ *   --dump-threshold-bytes=N
+ *   --redact               enable all redaction rules
+ *   --process-names        annotate lines with process names
+ *   --tier=SPEC            severity tier spec (see parse_tier_spec), may be repeated
+ *   --upload-budget=BYTES:PERIOD_MS
+ *                          upload budget (see UploadBudget)
+ *   --escalation-trigger=SPEC
+ *                          escalation trigger (see EscalationTriggers), may be repeated
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android/os/DropBoxManager.h>
+
+#include "ContinuousLogcat.h"
+#include "ReplaySource.h"
+
+using memfault::ContinuousLogcat;
+using memfault::ContinuousLogcatConfig;
+using memfault::replay::Fault;
+using memfault::replay::ReplayOptions;
+using memfault::replay::ReplaySource;
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+struct Args {
+  size_t records = 100000;
+  std::string capture;
+  ReplayOptions replay;
+  std::vector<std::string> filters;
+  size_t dump_threshold_bytes = 1024 * 1024;
+  bool redact = false;
+  bool process_names = false;
+  std::vector<std::string> tiers;
+  uint64_t upload_budget_bytes = 0;
+  uint64_t upload_budget_period_ms = 0;
+  std::vector<std::string> escalation_triggers;
+  std::string gate;
+  int timeout_sec = 120;
+};
+
+bool parse_errno(const std::string& name, int *error) {
+  static const std::map<std::string, int> kErrors = {
+    {"EAGAIN", EAGAIN},
+    {"EBADF", EBADF},
+    {"EINTR", EINTR},
+  };
+  auto it = kErrors.find(name);
+  if (it == kErrors.end()) return false;
+  *error = -it->second;
+  return true;
+}
+
+bool parse_args(int argc, char **argv, Args& args) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+    if (key == "--records") {
+      args.records = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--capture") {
+      args.capture = value;
+    } else if (key == "--rate") {
+      args.replay.records_per_sec = strtod(value.c_str(), nullptr);
+    } else if (key == "--wrap-records") {
+      args.replay.wrap_records = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--buffer-bytes") {
+      args.replay.buffer_bytes = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--fault") {
+      size_t colon = value.find(':');
+      Fault fault;
+      if (colon == std::string::npos || !parse_errno(value.substr(colon + 1), &fault.error)) {
+        fprintf(stderr, "Invalid fault: %s\n", value.c_str());
+        return false;
+      }
+      fault.after_records = strtoull(value.substr(0, colon).c_str(), nullptr, 10);
+      args.replay.faults.push_back(fault);
+    } else if (key == "--filter") {
+      args.filters.push_back(value);
+    } else if (key == "--dump-threshold-bytes") {
+      args.dump_threshold_bytes = strtoull(value.c_str(), nullptr, 10);
+    } else if (key == "--redact") {
+      args.redact = true;
+    } else if (key == "--process-names") {
+      args.process_names = true;
+    } else if (key == "--tier") {
+      args.tiers.push_back(value);
+    } else if (key == "--upload-budget") {
+      size_t colon = value.find(':');
+      if (colon == std::string::npos) {
+        fprintf(stderr, "Invalid upload budget: %s\n", value.c_str());
+        return false;
+      }
+      args.upload_budget_bytes = strtoull(value.substr(0, colon).c_str(), nullptr, 10);
+      args.upload_budget_period_ms = strtoull(value.substr(colon + 1).c_str(), nullptr, 10);
+    } else if (key == "--escalation-trigger") {
+      args.escalation_triggers.push_back(value);
+    } else if (key == "--gate") {
+      args.gate = value;
+    } else if (key == "--timeout-sec") {
+      args.timeout_sec = atoi(value.c_str());
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  std::sort(args.replay.faults.begin(), args.replay.faults.end(),
+      [](const Fault& a, const Fault& b) { return a.after_records < b.after_records; });
+  return true;
+}
+
+uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+double percentile_us(std::vector<uint64_t>& sorted_ns, double p) {
+  if (sorted_ns.empty()) return 0;
+  size_t index = std::min(sorted_ns.size() - 1, (size_t)(p * sorted_ns.size()));
+  return sorted_ns[index] / 1000.0;
+}
+
+/**
+ * Gate file lines: "<metric> max|min <value> [<tolerance>%]", '#' starts a comment. With a
+ * tolerance, value is a recorded baseline and the limit is that far below (min) or above
+ * (max) it.
+ */
+bool check_gate(const std::string& path, const std::map<std::string, double>& metrics) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "Cannot open gate file %s\n", path.c_str());
+    return false;
+  }
+
+  bool passed = true;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string metric, bound, tolerance;
+    double limit;
+    if (!(fields >> metric >> bound >> limit)) continue;
+    if (fields >> tolerance) {
+      double percent = strtod(tolerance.c_str(), nullptr);
+      limit *= bound == "max" ? 1 + percent / 100 : 1 - percent / 100;
+    }
+
+    auto it = metrics.find(metric);
+    if (it == metrics.end()) {
+      fprintf(stderr, "gate: unknown metric %s\n", metric.c_str());
+      passed = false;
+      continue;
+    }
+    bool ok = bound == "max" ? it->second <= limit : it->second >= limit;
+    if (!ok) {
+      fprintf(stderr, "gate: %s = %.2f, %s %.2f\n", metric.c_str(), it->second, bound.c_str(), limit);
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+void ignore_signal(int) {}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Args args;
+  if (!parse_args(argc, argv, args)) return 2;
+
+  // Like MemfaultDumpster, SIGALRM interrupts the reader without killing the process. No
+  // SA_RESTART: blocked fake reads must return -EINTR.
+  struct sigaction sa = {};
+  sa.sa_handler = ignore_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGALRM, &sa, nullptr);
+
+  std::vector<std::string> records;
+  if (!args.capture.empty()) {
+    if (!memfault::replay::load_capture(args.capture, records)) return 1;
+  } else {
+    records = memfault::replay::synthetic_records(args.records);
+  }
+  // Resolved before leaving the current directory for the run's
+  if (!args.gate.empty()) {
+    char gate[PATH_MAX];
+    if (realpath(args.gate.c_str(), gate) == nullptr) {
+      fprintf(stderr, "Cannot open gate file %s\n", args.gate.c_str());
+      return 1;
+    }
+    args.gate = gate;
+  }
+  if (args.filters.empty()) {
+    args.filters = memfault::replay::text_tag_filter_specs(records);
+  }
+  size_t total = records.size();
+  ReplaySource& source = ReplaySource::get();
+  source.load(std::move(records), args.replay);
+
+  std::string run_dir = memfault::replay::enter_run_dir();
+  if (run_dir.empty()) return 1;
+  mkdir(CONTINUOUS_LOGCAT_DIR, 0700);
+
+  std::map<std::string, double> metrics;
+  {
+    ContinuousLogcat clog;
+    ContinuousLogcatConfig config;
+    config.set_filter_specs(args.filters);
+    config.set_dump_threshold_bytes(args.dump_threshold_bytes);
+    if (args.redact) {
+      config.set_redaction_rules({"email", "imei", "mac", "ip", "token"});
+    }
+    config.set_process_names(args.process_names);
+    config.set_tier_specs(args.tiers);
+    config.set_upload_budget_bytes(args.upload_budget_bytes);
+    config.set_upload_budget_period_ms(args.upload_budget_period_ms);
+    config.set_escalation_triggers(args.escalation_triggers);
+    clog.reconfigure(config);
+
+    uint64_t allocations_start = allocations.load();
+    uint64_t cpu_start = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+
+    source.start();
+    clog.start();
+    bool completed = source.wait_processed(total, std::chrono::seconds(args.timeout_sec));
+
+    uint64_t wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+    uint64_t cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+    uint64_t allocs = allocations.load() - allocations_start;
+
+    clog.stop();
+    clog.join();
+
+    size_t processed = source.processed();
+    if (!completed) {
+      fprintf(stderr, "Timed out: processed %zu / %zu records\n", processed, total);
+    }
+    if (processed == 0) {
+      memfault::replay::remove_run_dir(run_dir);
+      return 1;
+    }
+
+    std::vector<uint64_t> latencies = source.latencies_ns();
+    std::sort(latencies.begin(), latencies.end());
+
+    metrics["records"] = processed;
+    metrics["lines_per_sec"] = processed / (wall_ns / 1e9);
+    metrics["cpu_ns_per_line"] = (double)cpu_ns / processed;
+    metrics["allocs_per_line"] = (double)allocs / processed;
+    metrics["latency_p50_us"] = percentile_us(latencies, 0.50);
+    metrics["latency_p99_us"] = percentile_us(latencies, 0.99);
+    metrics["latency_max_us"] = latencies.empty() ? 0 : latencies.back() / 1000.0;
+    metrics["dropbox_files"] = android::os::DropBoxManager::files().load();
+    metrics["dropbox_bytes"] = android::os::DropBoxManager::bytes().load();
+    metrics["completed"] = completed ? 1 : 0;
+  }
+  memfault::replay::remove_run_dir(run_dir);
+
+  for (auto& metric : metrics) {
+    printf("%-16s %.2f\n", metric.first.c_str(), metric.second);
+  }
+
+  if (!args.gate.empty() && !check_gate(args.gate, metrics)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Replaces the liblog reader entry points with a reader serving ReplaySource records. The
+ * harness links liblog as a shared library: these definitions in the executable take
+ * precedence over liblog's, while the rest of liblog (logprint, event tag maps) is used
+ * as is.
+ */
+
+#include "ReplaySource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <log/log_read.h>
+
+using memfault::replay::ReplaySource;
+
+// Stands in for liblog's per-buffer handle, only compared against nullptr by callers
+struct logger {
+  log_id_t id;
+};
+
+struct logger_list {
+  int mode;
+  // Only the continuous log reader, which never blocks outside of wrap mode, is measured and
+  // gets the faults. Subscriber readers stream (mode 0).
+  bool measured;
+  size_t cursor;
+  // bitmask of opened log ids
+  uint32_t log_mask = 0;
+  struct logger loggers[LOG_ID_MAX];
+  // wrap mode: set once enough records are pending, until the reader catches up
+  bool wrapped = false;
+  // set by LogdClose(), which also wakes up a blocked read through wake_fd
+  std::atomic<bool> closed{false};
+  int wake_fd;
+};
+
+static uint64_t record_nsec(const std::string& record) {
+  const struct logger_entry *entry = reinterpret_cast<const struct logger_entry *>(record.data());
+  return (uint64_t)entry->sec * 1000000000ULL + entry->nsec;
+}
+
+static log_id_t record_id(const std::string& record) {
+  const struct logger_entry *entry = reinterpret_cast<const struct logger_entry *>(record.data());
+  return (log_id_t)entry->lid;
+}
+
+static struct logger_list *alloc_list(int mode, size_t cursor) {
+  struct logger_list *list = new logger_list();
+  list->mode = mode;
+  list->measured = mode & ANDROID_LOG_NONBLOCK;
+  list->cursor = cursor;
+  list->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  return list;
+}
+
+extern "C" {
+
+struct logger_list *android_logger_list_alloc(int mode, unsigned int tail, pid_t pid) {
+  ReplaySource& source = ReplaySource::get();
+  size_t cursor = tail == 0 ? 0 : source.size() - std::min<size_t>(tail, source.size());
+  return alloc_list(mode, cursor);
+}
+
+struct logger_list *android_logger_list_alloc_time(int mode, log_time start, pid_t pid) {
+  ReplaySource& source = ReplaySource::get();
+  uint64_t start_nsec = (uint64_t)start.tv_sec * 1000000000ULL + start.tv_nsec;
+  // Records that have not arrived yet are logged after start, whatever their timestamp
+  auto now = std::chrono::steady_clock::now();
+  size_t cursor = 0;
+  while (cursor < source.size() && source.arrival(cursor) <= now &&
+         record_nsec(source.record(cursor)) < start_nsec) {
+    cursor++;
+  }
+  return alloc_list(mode, cursor);
+}
+
+struct logger *android_logger_open(struct logger_list *list, log_id_t id) {
+  if (list == nullptr || id >= LOG_ID_MAX) return nullptr;
+  list->log_mask |= 1u << id;
+  list->loggers[id].id = id;
+  return &list->loggers[id];
+}
+
+long android_logger_get_log_size(struct logger *logger) {
+  return (long)ReplaySource::get().options().buffer_bytes;
+}
+
+void android_logger_list_close(struct logger_list *list) {
+  if (list == nullptr) return;
+  close(list->wake_fd);
+  delete list;
+}
+
+void android_logger_list_free(struct logger_list *list) {
+  android_logger_list_close(list);
+}
+
+void LogdClose(struct logger_list *list) {
+  list->closed.store(true);
+  uint64_t one = 1;
+  (void)write(list->wake_fd, &one, sizeof(one));
+}
+
+int android_logger_list_read(struct logger_list *list, struct log_msg *log_msg) {
+  ReplaySource& source = ReplaySource::get();
+  if (list->measured) {
+    source.on_read();
+
+    int fault;
+    if (source.next_fault(&fault)) {
+      return fault;
+    }
+  }
+
+  while (true) {
+    if (list->closed.load()) {
+      return -EBADF;
+    }
+
+    while (list->cursor < source.size() &&
+           !(list->log_mask & (1u << record_id(source.record(list->cursor))))) {
+      list->cursor++;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool available = list->cursor < source.size() && source.arrival(list->cursor) <= now;
+
+    if (available && (list->mode & ANDROID_LOG_WRAP) && !list->wrapped) {
+      size_t pending = 0;
+      size_t wrap_records = source.options().wrap_records;
+      for (size_t i = list->cursor; i < source.size() && pending < wrap_records &&
+           source.arrival(i) <= now; i++) {
+        pending++;
+      }
+      bool all_arrived = source.arrival(source.size() - 1) <= now;
+      list->wrapped = pending >= wrap_records || all_arrived;
+      available = list->wrapped;
+    }
+
+    if (available) {
+      const std::string& record = source.record(list->cursor);
+      size_t len = std::min(record.size(), sizeof(log_msg->buf) - 1);
+      memcpy(log_msg->buf, record.data(), len);
+      if (list->measured) source.on_returned(list->cursor);
+      list->cursor++;
+      return (int)len;
+    }
+    list->wrapped = false;
+
+    if ((list->mode & ANDROID_LOG_NONBLOCK) && !(list->mode & ANDROID_LOG_WRAP)) {
+      return -EAGAIN;
+    }
+
+    // Block until the next arrival, LogdClose() or a signal
+    size_t next = list->cursor;
+    while (next < source.size() && source.arrival(next) <= now) next++;
+    int timeout_ms = -1;
+    if (next < source.size()) {
+      auto wait = source.arrival(next) - now;
+      timeout_ms = std::max<int>(1, std::chrono::duration_cast<std::chrono::milliseconds>(wait).count());
+    }
+    struct pollfd pfd = {list->wake_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) < 0 && errno == EINTR) {
+      return -EINTR;
+    }
+  }
+}
+
+}
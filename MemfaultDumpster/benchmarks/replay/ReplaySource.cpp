@@ -0,0 +1,258 @@
+#include "ReplaySource.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+#include <ftw.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android/log.h>
+#include <log/log_read.h>
+
+namespace memfault {
+namespace replay {
+
+// liblog binary event encoding (see android_log_event_type_t)
+static constexpr uint8_t kEventTypeInt = 0;
+static constexpr uint8_t kEventTypeString = 2;
+static constexpr uint8_t kEventTypeList = 3;
+
+ReplaySource& ReplaySource::get() {
+  static ReplaySource source;
+  return source;
+}
+
+void ReplaySource::load(std::vector<std::string> records, ReplayOptions options) {
+  std::lock_guard<std::mutex> lock(lock_);
+  records_ = std::move(records);
+  options_ = std::move(options);
+  start_ = std::chrono::steady_clock::now();
+  reads_ = 0;
+  next_fault_ = 0;
+  has_returned_ = false;
+  processed_ = 0;
+  latencies_ns_.clear();
+  latencies_ns_.reserve(records_.size());
+}
+
+void ReplaySource::start() {
+  start_ = std::chrono::steady_clock::now();
+}
+
+bool ReplaySource::wait_processed(size_t count, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(lock_);
+  return processed_cv_.wait_for(lock, timeout, [&]() { return processed_ >= count; });
+}
+
+size_t ReplaySource::processed() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return processed_;
+}
+
+std::vector<uint64_t> ReplaySource::latencies_ns() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return latencies_ns_;
+}
+
+std::chrono::steady_clock::time_point ReplaySource::arrival(size_t index) const {
+  if (options_.records_per_sec <= 0) return start_;
+  return start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(index / options_.records_per_sec));
+}
+
+bool ReplaySource::next_fault(int *error) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (next_fault_ < options_.faults.size() &&
+      processed_ >= options_.faults[next_fault_].after_records) {
+    *error = options_.faults[next_fault_++].error;
+    return true;
+  }
+  return false;
+}
+
+void ReplaySource::on_read() {
+  std::lock_guard<std::mutex> lock(lock_);
+  reads_++;
+  if (!has_returned_) return;
+
+  // Coming back for the next record means the previous one went all the way through
+  auto latency = std::chrono::steady_clock::now() - arrival(last_returned_);
+  latencies_ns_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  has_returned_ = false;
+  processed_++;
+  processed_cv_.notify_all();
+}
+
+void ReplaySource::on_returned(size_t index) {
+  std::lock_guard<std::mutex> lock(lock_);
+  has_returned_ = true;
+  last_returned_ = index;
+}
+
+bool load_capture(const std::string& path, std::vector<std::string>& records) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Cannot open %s\n", path.c_str());
+    return false;
+  }
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  size_t pos = 0;
+  while (pos + 4 <= data.size()) {
+    uint16_t len, hdr_size;
+    memcpy(&len, data.data() + pos, sizeof(len));
+    memcpy(&hdr_size, data.data() + pos + 2, sizeof(hdr_size));
+    if (hdr_size == 0) {
+      fprintf(stderr, "%s: v1 records (no hdr_size) are not supported\n", path.c_str());
+      return false;
+    }
+    if (pos + hdr_size + len > data.size()) break;
+
+    // Normalize older (shorter) headers to the current logger_entry layout
+    std::string record(sizeof(struct logger_entry) + len, '\0');
+    memcpy(&record[0], data.data() + pos, std::min<size_t>(hdr_size, sizeof(struct logger_entry)));
+    struct logger_entry *entry = reinterpret_cast<struct logger_entry *>(&record[0]);
+    entry->hdr_size = sizeof(struct logger_entry);
+    memcpy(&record[sizeof(struct logger_entry)], data.data() + pos + hdr_size, len);
+    records.emplace_back(std::move(record));
+
+    pos += hdr_size + len;
+  }
+  return !records.empty();
+}
+
+static std::string make_record(log_id_t id, int32_t pid, uint32_t uid, uint64_t nsec,
+                               const std::string& payload) {
+  std::string record(sizeof(struct logger_entry), '\0');
+  struct logger_entry *entry = reinterpret_cast<struct logger_entry *>(&record[0]);
+  entry->len = payload.size();
+  entry->hdr_size = sizeof(struct logger_entry);
+  entry->pid = pid;
+  entry->tid = pid + 1;
+  entry->sec = nsec / 1000000000ULL;
+  entry->nsec = nsec % 1000000000ULL;
+  entry->lid = id;
+  entry->uid = uid;
+  record.append(payload);
+  return record;
+}
+
+static void append_int(std::string& payload, int32_t value) {
+  payload.push_back(kEventTypeInt);
+  payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void append_string(std::string& payload, const std::string& value) {
+  int32_t len = value.size();
+  payload.push_back(kEventTypeString);
+  payload.append(reinterpret_cast<const char *>(&len), sizeof(len));
+  payload.append(value);
+}
+
+std::vector<std::string> synthetic_records(size_t count) {
+  static const struct {
+    log_id_t id;
+    android_LogPriority priority;
+    const char *tag;
+    const char *message;
+  } kText[] = {
+    {LOG_ID_MAIN, ANDROID_LOG_DEBUG, "WifiStateMachine", "handleMessage: what=131155 arg1=0 arg2=0"},
+    {LOG_ID_MAIN, ANDROID_LOG_VERBOSE, "OpenGLRenderer", "Skipped 31 frames! The application may be doing too much work"},
+    {LOG_ID_MAIN, ANDROID_LOG_INFO, "ActivityManager", "Displayed com.example.app/.MainActivity: +412ms"},
+    {LOG_ID_SYSTEM, ANDROID_LOG_INFO, "ActivityManager", "Start proc 4321:com.example.app/u0a123 for activity {com.example.app/.MainActivity}"},
+    {LOG_ID_SYSTEM, ANDROID_LOG_WARN, "BroadcastQueue", "Background execution not allowed: receiving Intent { act=android.intent.action.PACKAGE_ADDED }"},
+    {LOG_ID_MAIN, ANDROID_LOG_INFO, "AccountManager", "Account added: first.last@example.com"},
+    {LOG_ID_MAIN, ANDROID_LOG_DEBUG, "ConnectivityService", "Connecting to 192.168.1.20:443 via wlan0 a4:5e:60:c2:01:ff"},
+    {LOG_ID_MAIN, ANDROID_LOG_ERROR, "AndroidRuntime", "FATAL EXCEPTION: main Process: com.example.app, PID: 4321"},
+    {LOG_ID_CRASH, ANDROID_LOG_ERROR, "AndroidRuntime", "java.lang.IllegalStateException: Could not execute method for android:onClick"},
+  };
+  static constexpr size_t kTextCount = sizeof(kText) / sizeof(kText[0]);
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t nsec = (uint64_t)now.tv_sec * 1000000000ULL - 3600ULL * 1000000000ULL;
+
+  std::vector<std::string> records;
+  records.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    nsec += 200000;
+    int32_t pid = 1000 + (i % 64);
+    uint32_t uid = 10000 + (i % 64);
+
+    if (i % 10 == 9) {
+      // am_proc_start (30014): [User, PID, UID, Process Name, Type, Component]
+      std::string payload;
+      int32_t tag = 30014;
+      payload.append(reinterpret_cast<const char *>(&tag), sizeof(tag));
+      payload.push_back(kEventTypeList);
+      payload.push_back(6);
+      append_int(payload, 0);
+      append_int(payload, pid);
+      append_int(payload, uid);
+      append_string(payload, "com.example.app");
+      append_string(payload, "activity");
+      append_string(payload, "{com.example.app/com.example.app.MainActivity}");
+      records.emplace_back(make_record(LOG_ID_EVENTS, 1000, 1000, nsec, payload));
+    } else {
+      auto& text = kText[i % kTextCount];
+      std::string payload;
+      payload.push_back(text.priority);
+      payload.append(text.tag).push_back('\0');
+      payload.append(text.message).push_back('\0');
+      records.emplace_back(make_record(text.id, pid, uid, nsec, payload));
+    }
+  }
+  return records;
+}
+
+std::vector<std::string> text_tag_filter_specs(const std::vector<std::string>& records) {
+  std::set<std::string> tags;
+  for (auto& record : records) {
+    const struct logger_entry *entry = reinterpret_cast<const struct logger_entry *>(record.data());
+    if (entry->lid == LOG_ID_EVENTS || entry->lid == LOG_ID_SECURITY || entry->lid == LOG_ID_STATS) {
+      continue;
+    }
+    // <priority><tag>\0<message>\0
+    const char *payload = record.data() + entry->hdr_size;
+    size_t len = record.size() - entry->hdr_size;
+    if (len < 2) continue;
+    const char *tag_end = static_cast<const char *>(memchr(payload + 1, '\0', len - 1));
+    if (tag_end != nullptr) tags.emplace(payload + 1, tag_end);
+  }
+
+  std::vector<std::string> specs;
+  for (auto& tag : tags) {
+    specs.push_back(tag + ":V");
+  }
+  return specs;
+}
+
+std::string enter_run_dir() {
+  const char *base = getenv("TEST_TMPDIR");
+  std::string path = std::string(base != nullptr && base[0] != '\0' ? base : "/tmp") +
+      "/MemfaultDumpsterReplay.XXXXXX";
+  if (mkdtemp(&path[0]) == nullptr || chdir(path.c_str()) != 0) {
+    fprintf(stderr, "Cannot create a run directory in %s: %s\n", path.c_str(), strerror(errno));
+    return "";
+  }
+  return path;
+}
+
+void remove_run_dir(const std::string& dir) {
+  if (dir.empty()) return;
+  std::string parent = dir;
+  (void)chdir(dirname(&parent[0]));
+  nftw(dir.c_str(), [](const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+  }, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace memfault {
+namespace replay {
+
+/**
+ * A read error injected in place of a record, e.g. -EAGAIN, -EBADF or -EINTR.
+ */
+struct Fault {
+  // Returned by the read following this many successful ones
+  uint64_t after_records;
+  int error;
+};
+
+struct ReplayOptions {
+  // Arrival rate of the records, 0 for all at once
+  double records_per_sec = 0;
+  // In wrap mode, reads block until this many records are pending (logd only wakes wrap
+  // readers when its buffer is about to wrap), 0 to stream records as they arrive
+  size_t wrap_records = 0;
+  // Reported as the size of every buffer
+  size_t buffer_bytes = 256 * 1024;
+  std::vector<Fault> faults;
+};
+
+/**
+ * Recorded log_msg stream served by the fake liblog reader (FakeLiblog.cpp) in place of
+ * logd. Records are raw logger_entry headers followed by their payload, as written by
+ * `logcat -B`.
+ *
+ * A record counts as processed when the reader comes back for the next one, its latency is
+ * the time between its arrival and that point.
+ */
+class ReplaySource {
+  public:
+    static ReplaySource& get();
+
+    void load(std::vector<std::string> records, ReplayOptions options);
+    // Starts the arrival clock
+    void start();
+
+    bool wait_processed(size_t count, std::chrono::milliseconds timeout);
+    size_t processed();
+    std::vector<uint64_t> latencies_ns();
+
+    inline size_t size() const { return records_.size(); }
+    inline const std::string& record(size_t index) const { return records_[index]; }
+    inline const ReplayOptions& options() const { return options_; }
+
+    // Used by the fake liblog reader
+    std::chrono::steady_clock::time_point arrival(size_t index) const;
+    bool next_fault(int *error);
+    void on_read();
+    void on_returned(size_t index);
+
+  private:
+    std::vector<std::string> records_;
+    ReplayOptions options_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::mutex lock_;
+    std::condition_variable processed_cv_;
+    uint64_t reads_ = 0;
+    size_t next_fault_ = 0;
+    bool has_returned_ = false;
+    size_t last_returned_ = 0;
+    size_t processed_ = 0;
+    std::vector<uint64_t> latencies_ns_;
+};
+
+/**
+ * Parses a `logcat -B` capture into records.
+ */
+bool load_capture(const std::string& path, std::vector<std::string>& records);
+
+/**
+ * Generates a mix of text (main, system, crash) and binary (events) records with
+ * increasing timestamps.
+ */
+std::vector<std::string> synthetic_records(size_t count);
+
+/**
+ * "<tag>:V" for every distinct tag of the text (non binary) records.
+ */
+std::vector<std::string> text_tag_filter_specs(const std::vector<std::string>& records);
+
+/**
+ * Creates a directory unique to this run under $TEST_TMPDIR (or /tmp) and makes it the
+ * working directory. CONTINUOUS_LOGCAT_DIR is relative in the replay builds, so concurrent
+ * runs do not share their continuous log files. Returns the directory, empty on errors.
+ */
+std::string enter_run_dir();
+
+/**
+ * Leaves the run directory and deletes it along with its contents.
+ */
+void remove_run_dir(const std::string& dir);
+
+}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+ * Host replacement for libservices' DropBoxManager: records what would have been added to
+ * DropBox instead of calling into system_server.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <utils/String16.h>
+
+namespace android {
+namespace os {
+
+// Visible through ContinuousLogcat's `using namespace android::os`, as with the real header
+using ::android::String16;
+
+class Status {
+  public:
+    static Status ok() { return Status(); }
+    bool isOk() const { return true; }
+};
+
+class DropBoxManager {
+  public:
+    enum {
+      IS_EMPTY = 1,
+      IS_TEXT = 2,
+      IS_GZIPPED = 4,
+    };
+
+    Status addFile(const String16& tag, const std::string& file, int flags) {
+      struct stat st;
+      if (stat(file.c_str(), &st) == 0) {
+        bytes().fetch_add(st.st_size);
+      }
+      {
+        std::string line;
+        std::getline(std::ifstream(file), line);
+        std::lock_guard<std::mutex> lock(headers_lock());
+        first_lines().push_back(line);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms().load()));
+      files().fetch_add(1);
+      return Status::ok();
+    }
+
+    // Time each addFile() takes, as system_server copying a large file
+    static std::atomic<uint64_t>& delay_ms() {
+      static std::atomic<uint64_t> delay_ms{0};
+      return delay_ms;
+    }
+
+    // First line of each file added, i.e. the segment headers
+    static std::vector<std::string> headers() {
+      std::lock_guard<std::mutex> lock(headers_lock());
+      return first_lines();
+    }
+
+    static std::atomic<uint64_t>& files() {
+      static std::atomic<uint64_t> files{0};
+      return files;
+    }
+
+    static std::atomic<uint64_t>& bytes() {
+      static std::atomic<uint64_t> bytes{0};
+      return bytes;
+    }
+
+  private:
+    static std::mutex& headers_lock() {
+      static std::mutex lock;
+      return lock;
+    }
+
+    static std::vector<std::string>& first_lines() {
+      static std::vector<std::string> lines;
+      return lines;
+    }
+};
+
+}
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+#
+# Host benchmark: replays synthetic records through the continuous logcat reader as fast as
+# it takes them and checks the throughput against benchmark_gate.txt, see
+# MemfaultDumpsterReplayBenchmark in Android.bp.
+
+set -e
+
+dir="$(cd "$(dirname "$0")" && pwd)"
+exec "$dir/MemfaultDumpsterReplay" --records=20000 --rate=0 \
+    --gate="$dir/benchmarks/replay/benchmark_gate.txt"
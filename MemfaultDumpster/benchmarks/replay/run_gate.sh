@@ -0,0 +1,10 @@
+#!/bin/bash
+#
+# Host test: replays synthetic records through the continuous logcat reader and checks the
+# metrics against gate.txt, see MemfaultDumpsterReplayGate in Android.bp.
+
+set -e
+
+dir="$(cd "$(dirname "$0")" && pwd)"
+exec "$dir/MemfaultDumpsterReplay" --records=20000 --rate=0 \
+    --gate="$dir/benchmarks/replay/gate.txt"
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AtomicSnapshot.h"
+
+using memfault::AtomicSnapshot;
+
+namespace {
+
+std::atomic<int> live_configs{0};
+
+// Stand-in for the reader configuration: the fields must always be observed together.
+struct TestConfig {
+  explicit TestConfig(uint64_t version)
+    : version(version),
+      threshold_bytes(version * 2),
+      filter_specs({"tag:" + std::to_string(version)}) {
+    live_configs++;
+  }
+  ~TestConfig() { live_configs--; }
+
+  uint64_t version;
+  uint64_t threshold_bytes;
+  std::vector<std::string> filter_specs;
+};
+
+TEST(AtomicSnapshotTest, RefreshOnlyReloadsWhenPublished) {
+  AtomicSnapshot<TestConfig> snapshot(std::make_shared<const TestConfig>(1));
+
+  std::shared_ptr<const TestConfig> local;
+  uint64_t generation = 0;
+  EXPECT_TRUE(snapshot.refresh(local, generation));
+  EXPECT_EQ(1u, local->version);
+  EXPECT_FALSE(snapshot.refresh(local, generation));
+
+  snapshot.publish(std::make_shared<const TestConfig>(2));
+  EXPECT_TRUE(snapshot.refresh(local, generation));
+  EXPECT_EQ(2u, local->version);
+}
+
+TEST(AtomicSnapshotTest, RetiredSnapshotOutlivesReader) {
+  {
+    AtomicSnapshot<TestConfig> snapshot(std::make_shared<const TestConfig>(1));
+    auto held = snapshot.load();
+    snapshot.publish(std::make_shared<const TestConfig>(2));
+
+    // The replaced snapshot is still valid for the reader holding it
+    EXPECT_EQ(2, live_configs.load());
+    EXPECT_EQ(1u, held->version);
+    held.reset();
+    EXPECT_EQ(1, live_configs.load());
+  }
+  EXPECT_EQ(0, live_configs.load());
+}
+
+// Meant to be run under TSAN: reconfigures in a loop while readers refresh and use
+// their snapshot, mirroring reconfigure() against the clog reader thread.
+TEST(AtomicSnapshotTest, ReconfigureStress) {
+  constexpr uint64_t kIterations = 20000;
+  constexpr int kReaders = 4;
+
+  {
+    AtomicSnapshot<TestConfig> snapshot(std::make_shared<const TestConfig>(0));
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> inconsistent{0};
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; i++) {
+      readers.emplace_back([&]() {
+        std::shared_ptr<const TestConfig> local;
+        uint64_t generation = 0;
+        uint64_t last_version = 0;
+        while (!done.load()) {
+          snapshot.refresh(local, generation);
+          if (local->threshold_bytes != local->version * 2 ||
+              local->filter_specs.size() != 1 ||
+              local->filter_specs[0] != "tag:" + std::to_string(local->version) ||
+              local->version < last_version) {
+            inconsistent++;
+          }
+          last_version = local->version;
+        }
+      });
+    }
+
+    for (uint64_t version = 1; version <= kIterations; version++) {
+      snapshot.publish(std::make_shared<const TestConfig>(version));
+    }
+    done = true;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+
+    EXPECT_EQ(0u, inconsistent.load());
+    EXPECT_EQ(kIterations, snapshot.load()->version);
+    // Every retired snapshot has been freed
+    EXPECT_EQ(1, live_configs.load());
+  }
+  EXPECT_EQ(0, live_configs.load());
+}
+
+}  // namespace
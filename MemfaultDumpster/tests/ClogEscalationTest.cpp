@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "ClogEscalation.h"
+
+using memfault::EscalationTriggers;
+using memfault::EscalationWindow;
+
+namespace {
+
+const std::string *match(const EscalationTriggers& triggers, const char *tag, const char *msg) {
+  return triggers.match(tag, strlen(tag), msg, strlen(msg));
+}
+
+TEST(ClogEscalationTest, MatchesTagsAndPatterns) {
+  EscalationTriggers triggers({"tag:am_crash", "pattern:WATCHDOG KILLING", "bogus", "tag:"});
+  EXPECT_FALSE(triggers.empty());
+
+  const std::string *spec = match(triggers, "am_crash", "[1234,0,com.example.app]");
+  ASSERT_NE(nullptr, spec);
+  EXPECT_EQ("tag:am_crash", *spec);
+
+  spec = match(triggers, "Watchdog", "*** WATCHDOG KILLING SYSTEM PROCESS: Blocked");
+  ASSERT_NE(nullptr, spec);
+  EXPECT_EQ("pattern:WATCHDOG KILLING", *spec);
+
+  // Tags match exactly
+  EXPECT_EQ(nullptr, match(triggers, "am_crash_recovery", "x"));
+  EXPECT_EQ(nullptr, match(triggers, "am_cras", "x"));
+  EXPECT_EQ(nullptr, match(triggers, "ActivityManager", "Start proc"));
+}
+
+TEST(ClogEscalationTest, EmptyWithoutValidSpecs) {
+  EXPECT_TRUE(EscalationTriggers({}).empty());
+  EXPECT_TRUE(EscalationTriggers({"tag:", "pattern:", "priority:F"}).empty());
+}
+
+TEST(ClogEscalationTest, WindowExpiresWithTime) {
+  EscalationWindow window;
+  EXPECT_EQ(0u, window.id());
+  EXPECT_FALSE(window.active(1000));
+
+  EXPECT_TRUE(window.trigger(1000, 500, 100000));
+  EXPECT_EQ(1u, window.id());
+  EXPECT_FALSE(window.active(999));
+  EXPECT_TRUE(window.active(1000));
+  EXPECT_TRUE(window.active(1499));
+  EXPECT_FALSE(window.active(1500));
+}
+
+TEST(ClogEscalationTest, TriggersExtendWithoutAddingBudget) {
+  EscalationWindow window;
+  EXPECT_TRUE(window.trigger(1000, 500, 100));
+  window.consume(60);
+
+  EXPECT_FALSE(window.trigger(1400, 500, 100));
+  EXPECT_EQ(1u, window.id());
+  EXPECT_TRUE(window.active(1800));
+
+  window.consume(60);
+  EXPECT_FALSE(window.active(1800));
+
+  // A new window once the previous one closed
+  EXPECT_TRUE(window.trigger(1850, 500, 100));
+  EXPECT_EQ(2u, window.id());
+  EXPECT_TRUE(window.active(1900));
+}
+
+}
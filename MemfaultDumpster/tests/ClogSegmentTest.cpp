@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "ClogSegment.h"
+
+using memfault::kSegmentHeaderSize;
+using memfault::SegmentMetadata;
+
+namespace {
+
+TEST(ClogSegmentTest, EmptyHeader) {
+  SegmentMetadata metadata;
+  std::string header = metadata.to_header();
+
+  ASSERT_EQ(kSegmentHeaderSize, header.size());
+  EXPECT_EQ('\n', header.back());
+  EXPECT_EQ(0u, header.find(CONTINUOUS_LOGCAT_HEADER_PREFIX " complete=0 lines=0 bytes=0 "));
+  EXPECT_NE(std::string::npos, header.find(" compression=none "));
+  EXPECT_NE(std::string::npos, header.find(" buffers= "));
+}
+
+TEST(ClogSegmentTest, HeaderDescribesBuffers) {
+  SegmentMetadata metadata;
+  metadata.complete = true;
+  metadata.bytes = 350;
+  metadata.filters_hash = 0x1234abcd;
+  metadata.config_hash = 0xdeadbeef;
+  metadata.redaction = true;
+  metadata.record_line(LOG_ID_MAIN, 100, 500, 100);
+  // Out of order, e.g. interleaved kernel records
+  metadata.record_line(LOG_ID_MAIN, 99, 5, 100);
+  metadata.record_line(LOG_ID_MAIN, 101, 0, 100);
+  metadata.record_line(LOG_ID_SYSTEM, 100, 0, 50);
+  // Not a buffer
+  metadata.record_line(100, 100, 0, 50);
+
+  EXPECT_EQ(4u, metadata.lines());
+  std::string header = metadata.to_header();
+  EXPECT_EQ(0u, header.find(CONTINUOUS_LOGCAT_HEADER_PREFIX " complete=1 lines=4 bytes=350 "
+                            "filters=1234abcd config=deadbeef redaction=1 "));
+  EXPECT_NE(std::string::npos, header.find(
+      " buffers=main:99.000000005-101.000000000:3:300,system:100.000000000-100.000000000:1:50 "));
+}
+
+TEST(ClogSegmentTest, HeaderFitsWithEveryBuffer) {
+  SegmentMetadata metadata;
+  metadata.tier = std::string(32, 'x');
+  metadata.shed_lines = UINT64_MAX;
+  metadata.redacted_lines = UINT64_MAX;
+  metadata.escalated_lines = UINT64_MAX - 1;
+  metadata.record_escalated_line(1, UINT32_MAX, 999999999);
+  for (uint32_t log_id = 0; log_id < memfault::kSegmentMaxBuffers; log_id++) {
+    metadata.record_line(log_id, UINT32_MAX, 999999999, 1000000);
+  }
+
+  std::string header = metadata.to_header();
+  ASSERT_EQ(kSegmentHeaderSize, header.size());
+  // Not truncated: padded after the last buffer
+  EXPECT_EQ(' ', header[kSegmentHeaderSize - 2]);
+}
+
+}
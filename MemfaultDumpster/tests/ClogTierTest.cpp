@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "ClogTier.h"
+
+using memfault::build_tiers;
+using memfault::ClogTierConfig;
+using memfault::parse_tier_spec;
+using memfault::route_to_tier;
+
+namespace {
+
+ClogTierConfig base_config() {
+  ClogTierConfig base;
+  base.dump_threshold_bytes = 1000;
+  base.dump_threshold_time_ms = 60000;
+  return base;
+}
+
+TEST(ClogTierTest, ParsesFullSpec) {
+  ClogTierConfig tier;
+  ASSERT_TRUE(parse_tier_spec("errors:W,bytes=4096,time_ms=500,quota=8192,priority=1", tier));
+  EXPECT_EQ("errors", tier.name);
+  EXPECT_EQ(ANDROID_LOG_WARN, tier.min_priority);
+  EXPECT_EQ(4096u, tier.dump_threshold_bytes);
+  EXPECT_EQ(500u, tier.dump_threshold_time_ms);
+  EXPECT_EQ(8192u, tier.storage_quota_bytes);
+  EXPECT_EQ(1, tier.upload_priority);
+}
+
+TEST(ClogTierTest, OmittedFieldsAreKept) {
+  ClogTierConfig tier = base_config();
+  ASSERT_TRUE(parse_tier_spec("info:I", tier));
+  EXPECT_EQ(ANDROID_LOG_INFO, tier.min_priority);
+  EXPECT_EQ(1000u, tier.dump_threshold_bytes);
+  EXPECT_EQ(60000u, tier.dump_threshold_time_ms);
+}
+
+TEST(ClogTierTest, RejectsInvalidSpecs) {
+  for (const char *spec : {"", "errors", ":W", "errors:", "errors:X", "errors:WE", "Errors:W",
+                           "base:W", "errors:W,bytes", "errors:W,bytes=-1", "errors:W,size=1",
+                           "errors:W,priority=256", "../errors:W"}) {
+    ClogTierConfig tier;
+    EXPECT_FALSE(parse_tier_spec(spec, tier)) << spec;
+  }
+}
+
+TEST(ClogTierTest, RejectsNamesThatWouldBreakTheSegmentHeader) {
+  // Names are written unescaped in the space separated key=value segment header
+  for (const char *spec : {"my errors:W", "errors=1:W", "errors,x:W", "errors\t:W", "errors\n:W",
+                           "\xc3\xa9rrors:W", "errors_with_a_name_longer_than_32:W"}) {
+    ClogTierConfig tier;
+    EXPECT_FALSE(parse_tier_spec(spec, tier)) << spec;
+  }
+  ClogTierConfig tier;
+  EXPECT_TRUE(parse_tier_spec("errors_2:W", tier));
+  EXPECT_EQ("errors_2", tier.name);
+}
+
+TEST(ClogTierTest, WithoutSpecsEverythingGoesToBase) {
+  auto tiers = build_tiers({}, base_config());
+  ASSERT_EQ(1u, tiers.size());
+  EXPECT_EQ("", tiers[0].name);
+  EXPECT_EQ(2000u, tiers[0].storage_quota_bytes);
+  EXPECT_EQ(0u, route_to_tier(tiers, ANDROID_LOG_VERBOSE));
+  EXPECT_EQ(0u, route_to_tier(tiers, ANDROID_LOG_FATAL));
+}
+
+TEST(ClogTierTest, RoutesToMostSevereMatchingTier) {
+  auto tiers = build_tiers({"warnings:W,bytes=100", "errors:E,bytes=10", "errors:I", "bad"},
+                           base_config());
+  ASSERT_EQ(3u, tiers.size());
+  EXPECT_EQ("errors", tiers[0].name);
+  EXPECT_EQ(20u, tiers[0].storage_quota_bytes);
+  EXPECT_EQ("warnings", tiers[1].name);
+  EXPECT_EQ(60000u, tiers[1].dump_threshold_time_ms);
+  EXPECT_EQ("", tiers[2].name);
+
+  EXPECT_EQ(0u, route_to_tier(tiers, ANDROID_LOG_FATAL));
+  EXPECT_EQ(0u, route_to_tier(tiers, ANDROID_LOG_ERROR));
+  EXPECT_EQ(1u, route_to_tier(tiers, ANDROID_LOG_WARN));
+  EXPECT_EQ(2u, route_to_tier(tiers, ANDROID_LOG_INFO));
+  EXPECT_EQ(2u, route_to_tier(tiers, ANDROID_LOG_VERBOSE));
+}
+
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "CommandExecutor.h"
+
+using memfault::CommandExecutor;
+using memfault::CommandLane;
+using memfault::CommandTask;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr size_t kQuick = 0;
+static constexpr size_t kSlow = 1;
+// Of single lane executors
+static constexpr size_t kOnly = 0;
+
+// Blocks tasks until released
+class Gate {
+  public:
+    void wait() {
+      std::unique_lock<std::mutex> lock(lock_);
+      waiting_++;
+      changed_.notify_all();
+      changed_.wait(lock, [&]() { return open_; });
+    }
+    void wait_for_waiters(int count) {
+      std::unique_lock<std::mutex> lock(lock_);
+      changed_.wait(lock, [&]() { return waiting_ >= count; });
+    }
+    void open() {
+      std::lock_guard<std::mutex> lock(lock_);
+      open_ = true;
+      changed_.notify_all();
+    }
+
+  private:
+    std::mutex lock_;
+    std::condition_variable changed_;
+    int waiting_ = 0;
+    bool open_ = false;
+};
+
+// Records the outcome of a task
+struct Outcome {
+  std::atomic<int> finished{0};
+  std::atomic<int> error{0};
+
+  CommandTask task(std::function<void()> run) {
+    return CommandTask{std::move(run), [this]() { finished++; }, [this](int e) { error = e; }};
+  }
+};
+
+template <typename Predicate>
+bool eventually(Predicate predicate) {
+  for (int i = 0; i < 200 && !predicate(); i++) {
+    std::this_thread::sleep_for(5ms);
+  }
+  return predicate();
+}
+
+TEST(CommandExecutorTest, QuickCommandsDoNotWaitBehindSlowOnes) {
+  Gate gate;
+  CommandExecutor executor({{"quick", 2, 8}, {"slow", 1, 8}});
+
+  Outcome slow1, slow2, quick;
+  executor.submit(kSlow, 0ms, slow1.task([&]() { gate.wait(); }));
+  executor.submit(kSlow, 0ms, slow2.task([&]() { gate.wait(); }));
+  gate.wait_for_waiters(1);
+
+  executor.submit(kQuick, 0ms, quick.task([]() {}));
+  EXPECT_TRUE(eventually([&]() { return quick.finished == 1; }));
+  EXPECT_EQ(0, slow1.finished);
+  EXPECT_EQ(0, slow2.finished);
+
+  gate.open();
+  EXPECT_TRUE(eventually([&]() { return slow1.finished == 1 && slow2.finished == 1; }));
+}
+
+TEST(CommandExecutorTest, LimitsConcurrencyPerLane) {
+  Gate gate;
+  CommandExecutor executor({{"quick", 2, 8}});
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+
+  Outcome outcomes[5];
+  for (auto& outcome : outcomes) {
+    executor.submit(kOnly, 0ms, outcome.task([&]() {
+      int now = ++running;
+      int max = max_running.load();
+      while (now > max && !max_running.compare_exchange_weak(max, now)) {}
+      gate.wait();
+      running--;
+    }));
+  }
+  gate.wait_for_waiters(2);
+  std::this_thread::sleep_for(20ms);
+  EXPECT_EQ(2, running.load());
+
+  gate.open();
+  for (auto& outcome : outcomes) {
+    EXPECT_TRUE(eventually([&]() { return outcome.finished == 1; }));
+  }
+  EXPECT_EQ(2, max_running.load());
+}
+
+TEST(CommandExecutorTest, TimesOutQueuedAndRunningTasks) {
+  Gate gate;
+  CommandExecutor executor({{"slow", 1, 8}});
+
+  Outcome running, queued;
+  executor.submit(kOnly, 50ms, running.task([&]() { gate.wait(); }));
+  executor.submit(kOnly, 50ms, queued.task([]() {}));
+
+  EXPECT_TRUE(eventually([&]() { return running.error == -ETIMEDOUT; }));
+  EXPECT_TRUE(eventually([&]() { return queued.error == -ETIMEDOUT; }));
+  EXPECT_EQ(2u, executor.timeouts());
+
+  // The running command still completes, but is only reported once
+  Outcome next;
+  gate.open();
+  executor.submit(kOnly, 0ms, next.task([]() {}));
+  EXPECT_TRUE(eventually([&]() { return next.finished == 1; }));
+  EXPECT_EQ(0, running.finished);
+  EXPECT_EQ(0, queued.finished);
+}
+
+TEST(CommandExecutorTest, RejectsWhenQueueIsFull) {
+  Gate gate;
+  std::vector<size_t> depths;
+  std::mutex depths_lock;
+  CommandExecutor executor({{"slow", 1, 1}}, [&](size_t lane, size_t depth) {
+    std::lock_guard<std::mutex> lock(depths_lock);
+    depths.push_back(depth);
+  });
+
+  Outcome running, queued, rejected;
+  executor.submit(kOnly, 0ms, running.task([&]() { gate.wait(); }));
+  gate.wait_for_waiters(1);
+  executor.submit(kOnly, 0ms, queued.task([]() {}));
+  executor.submit(kOnly, 0ms, rejected.task([]() {}));
+
+  EXPECT_EQ(-EBUSY, rejected.error);
+  EXPECT_EQ(1u, executor.rejections());
+  {
+    std::lock_guard<std::mutex> lock(depths_lock);
+    EXPECT_EQ((std::vector<size_t>{0, 0, 1}), depths);
+  }
+
+  gate.open();
+  EXPECT_TRUE(eventually([&]() { return queued.finished == 1; }));
+  EXPECT_EQ(0, rejected.finished);
+}
+
+TEST(CommandExecutorTest, CancelsQueuedTasksOnDestruction) {
+  Gate gate;
+  Outcome running, queued;
+  std::thread opener;
+  {
+    CommandExecutor executor({{"slow", 1, 8}});
+    executor.submit(kOnly, 0ms, running.task([&]() { gate.wait(); }));
+    gate.wait_for_waiters(1);
+    executor.submit(kOnly, 0ms, queued.task([]() {}));
+    // Waits for the running task
+    opener = std::thread([&]() {
+      std::this_thread::sleep_for(20ms);
+      gate.open();
+    });
+  }
+  opener.join();
+  EXPECT_EQ(1, running.finished);
+  EXPECT_EQ(-ECANCELED, queued.error);
+  EXPECT_EQ(0, queued.finished);
+}
+
+}
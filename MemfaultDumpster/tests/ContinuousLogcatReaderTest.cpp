@@ -0,0 +1,304 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android/os/DropBoxManager.h>
+
+#include "ContinuousLogcat.h"
+#include "ReplaySource.h"
+
+using memfault::ContinuousLogcat;
+using memfault::ContinuousLogcatConfig;
+using android::os::DropBoxManager;
+using memfault::replay::ReplayOptions;
+using memfault::replay::ReplaySource;
+
+namespace {
+
+void ignore_signal(int) {}
+
+/**
+ * Runs the ContinuousLogcat reader against the fake liblog reader of the replay harness
+ * (benchmarks/replay/FakeLiblog.cpp).
+ */
+class ContinuousLogcatReaderTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      // As in MemfaultDumpster: SIGALRM interrupts the reader on older platforms
+      struct sigaction sa = {};
+      sa.sa_handler = ignore_signal;
+      sigemptyset(&sa.sa_mask);
+      sigaction(SIGALRM, &sa, nullptr);
+      signal(SIGPIPE, SIG_IGN);
+
+      run_dir = memfault::replay::enter_run_dir();
+      ASSERT_FALSE(run_dir.empty());
+      mkdir(CONTINUOUS_LOGCAT_DIR, 0700);
+    }
+
+    void TearDown() override {
+      memfault::replay::remove_run_dir(run_dir);
+    }
+
+    std::vector<std::string> load(size_t count, double records_per_sec, size_t wrap_records) {
+      auto records = memfault::replay::synthetic_records(count);
+      auto filters = memfault::replay::text_tag_filter_specs(records);
+      ReplayOptions options;
+      options.records_per_sec = records_per_sec;
+      options.wrap_records = wrap_records;
+      ReplaySource::get().load(std::move(records), options);
+      return filters;
+    }
+
+    std::string run_dir;
+};
+
+TEST_F(ContinuousLogcatReaderTest, ReconfigureWakesReaderWhenNeeded) {
+  // logd would not wrap for the duration of the test
+  auto filters = load(100000, 1000, 1000000);
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  clog.reconfigure(config);
+  ReplaySource::get().start();
+  clog.start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_EQ(0u, ReplaySource::get().processed());
+
+  // Filters, thresholds and redaction apply to the entries read once logd wraps
+  config.set_filter_specs({filters.front()});
+  config.set_dump_threshold_bytes(config.dump_threshold_bytes() / 2);
+  config.set_redaction_rules({"email"});
+  clog.reconfigure(config);
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_EQ(0u, ReplaySource::get().processed());
+
+  // /dev/kmsg is only opened or closed between read batches
+  config.set_kernel_logs(!config.kernel_logs());
+  clog.reconfigure(config);
+  EXPECT_TRUE(ReplaySource::get().wait_processed(100, std::chrono::seconds(5)));
+
+  clog.stop();
+  clog.join();
+}
+
+TEST_F(ContinuousLogcatReaderTest, SubscribersDoNotDefeatWrap) {
+  // logd would not wrap for the duration of the test
+  auto filters = load(100000, 1000, 1000000);
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  clog.reconfigure(config);
+  ReplaySource::get().start();
+  clog.start();
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_CLOEXEC | O_NONBLOCK));
+  android::base::unique_fd read_fd(fds[0]);
+  int32_t id = clog.add_subscriber({"*:V"}, {}, android::base::unique_fd(fds[1]));
+  ASSERT_GT(id, 0);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  // Streamed to the subscriber as they are logged...
+  char buf[4096];
+  EXPECT_GT(read(read_fd.get(), buf, sizeof(buf)), 0);
+  // ...while the continuous log reader still waits for logd to wrap
+  EXPECT_EQ(0u, ReplaySource::get().processed());
+  struct stat st;
+  EXPECT_TRUE(stat(CONTINUOUS_LOGCAT_FILE, &st) != 0 || st.st_size == 0);
+
+  EXPECT_TRUE(clog.remove_subscriber(id));
+  clog.stop();
+  clog.join();
+}
+
+TEST_F(ContinuousLogcatReaderTest, SubscribersGetRedactedLines) {
+  auto filters = load(100000, 1000, 1000000);
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  config.set_redaction_rules({"email"});
+  clog.reconfigure(config);
+  ReplaySource::get().start();
+  clog.start();
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_CLOEXEC | O_NONBLOCK));
+  android::base::unique_fd read_fd(fds[0]);
+  int32_t id = clog.add_subscriber({"AccountManager:I"}, {}, android::base::unique_fd(fds[1]));
+  ASSERT_GT(id, 0);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  std::string output;
+  char buf[4096];
+  ssize_t len;
+  while ((len = read(read_fd.get(), buf, sizeof(buf))) > 0) {
+    output.append(buf, len);
+  }
+  EXPECT_NE(std::string::npos, output.find("Account added: "));
+  EXPECT_EQ(std::string::npos, output.find("first.last@example.com"));
+
+  EXPECT_TRUE(clog.remove_subscriber(id));
+  clog.stop();
+  clog.join();
+}
+
+// Meant to be run under TSAN: reconfigures in a loop while the reader reads, formats and
+// writes entries, and while subscribers come and go.
+TEST_F(ContinuousLogcatReaderTest, ReconfigureStress) {
+  constexpr int kIterations = 200;
+  auto filters = load(200000, 20000, 500);
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  clog.reconfigure(config);
+  ReplaySource::get().start();
+  clog.start();
+
+  std::atomic<bool> done{false};
+  std::thread subscribers([&]() {
+    while (!done.load()) {
+      int fds[2];
+      ASSERT_EQ(0, pipe2(fds, O_CLOEXEC | O_NONBLOCK));
+      android::base::unique_fd read_fd(fds[0]);
+      int32_t id = clog.add_subscriber({"*:I"}, {}, android::base::unique_fd(fds[1]));
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      char buf[4096];
+      while (read(read_fd.get(), buf, sizeof(buf)) > 0) {}
+      clog.remove_subscriber(id);
+    }
+  });
+
+  for (int i = 0; i < kIterations; i++) {
+    std::vector<std::string> specs(filters.begin(), filters.begin() + 1 + i % filters.size());
+    config.set_filter_specs(specs);
+    config.set_dump_threshold_bytes(64 * 1024 * (1 + i % 4));
+    if (i % 2) {
+      config.set_redaction_rules({"email", "ip"});
+    } else {
+      config.set_redaction_rules({});
+    }
+    config.set_tier_specs(i % 3 ? std::vector<std::string>{"crash:E,bytes=16384"}
+                                : std::vector<std::string>{});
+    clog.reconfigure(config);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  done = true;
+  subscribers.join();
+
+  size_t processed = ReplaySource::get().processed();
+  EXPECT_GT(processed, 0u);
+  // Still reading after the last reconfiguration
+  EXPECT_TRUE(ReplaySource::get().wait_processed(processed + 100, std::chrono::seconds(5)));
+
+  clog.stop();
+  clog.join();
+}
+
+TEST_F(ContinuousLogcatReaderTest, StartDumpsLeftovers) {
+  auto filters = load(1000, 1000, 1000000);
+  const std::string stale = CONTINUOUS_LOGCAT_DIR "/pending.0.crash";
+  const std::string tier = CONTINUOUS_LOGCAT_FILE ".crash";
+  std::ofstream(CONTINUOUS_LOGCAT_FILE) << std::string(1000, 'c');
+  std::ofstream(tier) << std::string(100, 't');
+  // Claimed by a previous process, which did not get to dump it
+  std::ofstream(stale) << std::string(10, 'p');
+  uint64_t files = DropBoxManager::files().load();
+  uint64_t bytes = DropBoxManager::bytes().load();
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  clog.reconfigure(config);
+  clog.start();
+
+  EXPECT_EQ(files + 3, DropBoxManager::files().load());
+  EXPECT_EQ(bytes + 1110, DropBoxManager::bytes().load());
+  struct stat st;
+  EXPECT_NE(0, stat(tier.c_str(), &st));
+  EXPECT_NE(0, stat(stale.c_str(), &st));
+  EXPECT_NE(0, stat(CONTINUOUS_LOGCAT_DIR "/pending.1", &st));
+
+  clog.stop();
+  clog.join();
+}
+
+TEST_F(ContinuousLogcatReaderTest, LeftoversCountAgainstQuota) {
+  auto filters = load(100000, 2000, 500);
+  // 90% of the quota is left over from the previous run, and takes a while to dump
+  std::ofstream(CONTINUOUS_LOGCAT_FILE) << std::string(92 * 100 * 1024, 'c');
+  DropBoxManager::delay_ms() = 2000;
+  size_t dumped = DropBoxManager::headers().size();
+
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_filter_specs(filters);
+  // Segments alone never get close to the quota
+  config.set_storage_quota_bytes(100 * 100 * 1024);
+  clog.reconfigure(config);
+  ReplaySource::get().start();
+  std::thread start([&]() { clog.start(); });
+  EXPECT_TRUE(ReplaySource::get().wait_processed(500, std::chrono::seconds(5)));
+  start.join();
+  DropBoxManager::delay_ms() = 0;
+  clog.stop();
+  clog.join();
+
+  // Info and below were shed while the leftover was pending
+  auto headers = DropBoxManager::headers();
+  int max_shed_level = 0;
+  for (size_t i = dumped; i < headers.size(); i++) {
+    size_t shed_level = headers[i].find(" shed_level=");
+    if (shed_level == std::string::npos) continue;
+    max_shed_level = std::max(max_shed_level,
+                              std::stoi(headers[i].substr(shed_level + strlen(" shed_level="))));
+  }
+  EXPECT_EQ(2, max_shed_level);
+}
+
+TEST_F(ContinuousLogcatReaderTest, UploadBudgetIsKeptAcrossRuns) {
+  ContinuousLogcat clog;
+  ContinuousLogcatConfig config;
+  config.set_upload_budget_bytes(16 * 1024);
+  config.set_upload_budget_period_ms(24 * 60 * 60 * 1000);
+
+  // The first run spends the budget
+  config.set_filter_specs(load(2000, 0, 0));
+  clog.reconfigure(config);
+  uint64_t bytes = DropBoxManager::bytes().load();
+  ReplaySource::get().start();
+  clog.start();
+  EXPECT_TRUE(ReplaySource::get().wait_processed(2000, std::chrono::seconds(5)));
+  clog.stop();
+  clog.join();
+  EXPECT_GT(DropBoxManager::bytes().load(), bytes);
+
+  // Nothing is left for the second one
+  load(2000, 0, 0);
+  bytes = DropBoxManager::bytes().load();
+  ReplaySource::get().start();
+  clog.start();
+  EXPECT_TRUE(ReplaySource::get().wait_processed(2000, std::chrono::seconds(5)));
+  clog.stop();
+  clog.join();
+  EXPECT_EQ(bytes, DropBoxManager::bytes().load());
+}
+
+}  // namespace
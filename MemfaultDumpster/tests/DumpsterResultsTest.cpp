@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DumpsterResults.h"
+
+namespace {
+
+// /proc/<pid>/stat of an app (name with spaces and parentheses)
+const char *kAppStat =
+    "1234 (com.app (main)) S 610 610 0 0 -1 1077952832 58042 2 1088 0 1547 822 3 1 10 -10 38 0 "
+    "2641 15519080448 40562 18446744073709551615 1 1 0 0 0 0 4612 1 1073775864 0 0 0 17 5 0 0 "
+    "0 0 0\n";
+
+TEST(DumpsterResultsTest, ProcPidStat) {
+  memfault::ProcPidStatsProto::ProcessProto app;
+  std::vector<std::string_view> fields;
+  ASSERT_TRUE(memfault::proc_pid_stat_to_proto(10057, kAppStat, fields, app));
+
+  EXPECT_EQ(10057u, app.uid());
+  EXPECT_EQ(1234, app.pid());
+  EXPECT_EQ("com.app (main)", app.comm());
+  EXPECT_EQ("S", app.state());
+  EXPECT_EQ(610, app.ppid());
+  EXPECT_EQ(58042u, app.minflt());
+  EXPECT_EQ(1088u, app.majflt());
+  EXPECT_EQ(1547u, app.utime());
+  EXPECT_EQ(822u, app.stime());
+  EXPECT_EQ(3u, app.cutime());
+  EXPECT_EQ(1u, app.cstime());
+  EXPECT_EQ(10, app.priority());
+  EXPECT_EQ(-10, app.nice());
+  EXPECT_EQ(38, app.num_threads());
+  EXPECT_EQ(2641u, app.starttime());
+  EXPECT_EQ(15519080448u, app.vsize());
+  EXPECT_EQ(40562, app.rss());
+  // Last field, before the newline
+  EXPECT_EQ(5, app.processor());
+
+  // Smaller than the text
+  EXPECT_LT(app.ByteSizeLong(), strlen(kAppStat) / 2);
+
+  // Fields are reused
+  memfault::ProcPidStatsProto::ProcessProto kthreadd;
+  ASSERT_TRUE(memfault::proc_pid_stat_to_proto(
+      0,
+      "2 (kthreadd) S 0 0 0 0 -1 2129984 0 0 0 0 0 1 0 0 20 0 1 0 2 0 0 18446744073709551615 0 "
+      "0 0 0 0 0 0 2147483647 0 0 0 0 0 1 0 0 0 0 0\n",
+      fields, kthreadd));
+  EXPECT_EQ(0u, kthreadd.uid());
+  EXPECT_EQ(2, kthreadd.pid());
+  EXPECT_EQ("kthreadd", kthreadd.comm());
+  EXPECT_EQ(1u, kthreadd.stime());
+  EXPECT_EQ(1, kthreadd.processor());
+}
+
+TEST(DumpsterResultsTest, ProcPidStatRejectsGarbage) {
+  std::vector<std::string_view> fields;
+  for (const char *stat : {"", "garbage\n", "3 (truncated) S 1 1\n", "x (name) S 1 1 0 0 -1"}) {
+    memfault::ProcPidStatsProto::ProcessProto process;
+    EXPECT_FALSE(memfault::proc_pid_stat_to_proto(1000, stat, fields, process)) << stat;
+  }
+}
+
+TEST(DumpsterResultsTest, ProcStat) {
+  memfault::ProcStat stat;
+  ASSERT_TRUE(memfault::parse_proc_stat(
+      "cpu  71430 1942 53368 1273474 12084 3 701 0\n"
+      "cpu1 32498 879 22555 645358 5467 0 165 0\n"
+      "intr 3564912 0 0 41 0\n"
+      "ctxt 7125542\n"
+      "btime 1417080402\n"
+      "processes 8823\n"
+      "procs_running 1\n"
+      "procs_blocked 0\n",
+      stat));
+
+  memfault::ProcStatProto proto;
+  memfault::proc_stat_to_proto(stat, proto);
+  EXPECT_FALSE(proto.total().has_cpu());
+  EXPECT_EQ(71430u, proto.total().user());
+  EXPECT_EQ(701u, proto.total().softirq());
+  EXPECT_EQ(0u, proto.total().guest_nice());
+  ASSERT_EQ(1, proto.cpus_size());
+  EXPECT_EQ(1, proto.cpus(0).cpu());
+  EXPECT_EQ(645358u, proto.cpus(0).idle());
+  EXPECT_EQ(3564912u, proto.interrupts());
+  EXPECT_EQ(7125542u, proto.context_switches());
+  EXPECT_EQ(1417080402u, proto.boot_time());
+  EXPECT_EQ(8823u, proto.processes());
+  EXPECT_EQ(1u, proto.procs_running());
+  EXPECT_EQ(0u, proto.procs_blocked());
+}
+
+}
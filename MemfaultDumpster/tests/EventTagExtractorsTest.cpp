@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "EventTagExtractors.h"
+
+using memfault::EventMetricsSink;
+using memfault::EventTagExtractors;
+using memfault::EventValue;
+
+namespace {
+
+// Builds binary event payloads the way liblog's android_log_event_list does
+class Payload {
+  public:
+    explicit Payload(uint32_t tag) { append(&tag, sizeof(tag)); }
+
+    Payload& list(uint8_t count) {
+      bytes_.push_back(memfault::kEventTypeList);
+      bytes_.push_back(count);
+      return *this;
+    }
+    Payload& i(int32_t value) {
+      bytes_.push_back(memfault::kEventTypeInt);
+      append(&value, sizeof(value));
+      return *this;
+    }
+    Payload& l(int64_t value) {
+      bytes_.push_back(memfault::kEventTypeLong);
+      append(&value, sizeof(value));
+      return *this;
+    }
+    Payload& s(const std::string& value) {
+      bytes_.push_back(memfault::kEventTypeString);
+      int32_t len = value.size();
+      append(&len, sizeof(len));
+      append(value.data(), value.size());
+      return *this;
+    }
+
+    const uint8_t *data() const { return bytes_.data(); }
+    size_t size() const { return bytes_.size(); }
+
+  private:
+    void append(const void *data, size_t len) {
+      const uint8_t *bytes = static_cast<const uint8_t *>(data);
+      bytes_.insert(bytes_.end(), bytes, bytes + len);
+    }
+
+    std::vector<uint8_t> bytes_;
+};
+
+class RecordingSink : public EventMetricsSink {
+  public:
+    void on_anr(uint64_t ts, const std::string& package) override {
+      events.push_back("anr " + package + " " + std::to_string(ts));
+    }
+    void on_crash(uint64_t, const std::string& process) override {
+      events.push_back("crash " + process);
+    }
+    void on_process_died(uint64_t, const std::string& process) override {
+      events.push_back("died " + process);
+    }
+    void on_low_memory(uint64_t, int64_t num_processes) override {
+      events.push_back("low_memory " + std::to_string(num_processes));
+    }
+    void on_lmk_kill(uint64_t, int64_t uid, int64_t oom_adj) override {
+      events.push_back("lmk " + std::to_string(uid) + " " + std::to_string(oom_adj));
+    }
+    void on_activity_launch(uint64_t, const std::string& component, int64_t ms) override {
+      events.push_back("launch " + component + " " + std::to_string(ms));
+    }
+    void on_boot_progress(uint64_t, const std::string& stage, int64_t uptime_ms) override {
+      events.push_back(stage + " " + std::to_string(uptime_ms));
+    }
+
+    std::vector<std::string> events;
+};
+
+void process(EventTagExtractors& extractors, const Payload& payload, const char *tag) {
+  extractors.process(payload.data(), payload.size(), tag, tag ? strlen(tag) : 0, 1000);
+}
+
+TEST(EventTagExtractorsTest, DecodesValues) {
+  Payload payload(0);
+  payload.list(3).i(-5).l(1LL << 40).s("hello");
+  EventValue values[memfault::kMaxEventValues];
+
+  int count = memfault::decode_event_values(payload.data() + 4, payload.size() - 4, values,
+                                            memfault::kMaxEventValues);
+  ASSERT_EQ(3, count);
+  EXPECT_EQ(-5, values[0].number);
+  EXPECT_EQ(1LL << 40, values[1].number);
+  ASSERT_TRUE(values[2].is_string());
+  EXPECT_EQ("hello", std::string(values[2].str, values[2].str_len));
+
+  // Only as many as asked for
+  EXPECT_EQ(2, memfault::decode_event_values(payload.data() + 4, payload.size() - 4, values, 2));
+
+  // Truncated
+  EXPECT_EQ(-1, memfault::decode_event_values(payload.data() + 4, payload.size() - 5, values,
+                                              memfault::kMaxEventValues));
+}
+
+TEST(EventTagExtractorsTest, ExtractsWellKnownTags) {
+  RecordingSink sink;
+  EventTagExtractors extractors(sink);
+
+  Payload anr(30008);
+  anr.list(5).i(0).i(1234).s("com.example.app").i(0).s("Input dispatching timed out");
+  process(extractors, anr, "am_anr");
+
+  Payload crash(30039);
+  crash.list(8).i(0).i(1234).s("com.example.app").i(0).s("java.lang.NullPointerException")
+      .s("oops").s("Main.java").i(42);
+  process(extractors, crash, "am_crash");
+
+  Payload died(30011);
+  died.list(5).i(0).i(1234).s("com.example.app").i(900).i(19);
+  process(extractors, died, "am_proc_died");
+
+  Payload low_memory(30017);
+  low_memory.i(12);
+  process(extractors, low_memory, "am_low_memory");
+
+  Payload killinfo(10195355);
+  killinfo.list(7).i(1234).i(10057).i(900).i(800).i(4096).i(2).i(100);
+  process(extractors, killinfo, "killinfo");
+
+  Payload launch(30009);
+  launch.list(4).i(0).i(99).s("com.example.app/.MainActivity").l(350);
+  process(extractors, launch, "am_activity_launch_time");
+
+  Payload boot(3000);
+  boot.l(4321);
+  process(extractors, boot, "boot_progress_start");
+
+  std::vector<std::string> expected = {
+    "anr com.example.app 1000",
+    "crash com.example.app",
+    "died com.example.app",
+    "low_memory 12",
+    "lmk 10057 900",
+    "launch com.example.app/.MainActivity 350",
+    "boot_progress_start 4321",
+  };
+  EXPECT_EQ(expected, sink.events);
+}
+
+TEST(EventTagExtractorsTest, ResolvesTagIdsOnce) {
+  RecordingSink sink;
+  EventTagExtractors extractors(sink);
+
+  Payload crash(30039);
+  crash.list(3).i(0).i(1234).s("com.example.app");
+  process(extractors, crash, "am_crash");
+  // Known by id from now on, whatever the name passed
+  process(extractors, crash, nullptr);
+
+  Payload other(30040);
+  other.list(3).i(0).i(1234).s("com.example.app");
+  process(extractors, other, "am_other");
+  process(extractors, other, "am_crash");
+
+  EXPECT_EQ(2u, sink.events.size());
+}
+
+TEST(EventTagExtractorsTest, IgnoresUnexpectedLayouts) {
+  RecordingSink sink;
+  EventTagExtractors extractors(sink);
+
+  // Process name is not a string
+  Payload crash(30039);
+  crash.list(3).i(0).i(1234).i(5);
+  process(extractors, crash, "am_crash");
+
+  // Truncated
+  Payload launch(30009);
+  launch.list(4).i(0).i(99).s("com.example.app/.MainActivity");
+  process(extractors, launch, "am_activity_launch_time");
+
+  // No payload at all
+  uint8_t tag_only[2] = {0, 0};
+  extractors.process(tag_only, sizeof(tag_only), "am_crash", 8, 1000);
+
+  EXPECT_TRUE(sink.events.empty());
+}
+
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+
+#include <stdlib.h>
+
+#include "EventWatermark.h"
+
+using memfault::EventWatermark;
+
+namespace {
+
+class EventWatermarkTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char dir[] = "/tmp/mflt-watermark-XXXXXX";
+      ASSERT_NE(nullptr, mkdtemp(dir));
+      dir_ = dir;
+      path_ = dir_ + "/clog_events";
+    }
+
+    void TearDown() override {
+      system(("rm -rf " + dir_).c_str());
+    }
+
+    std::string dir_;
+    std::string path_;
+};
+
+TEST_F(EventWatermarkTest, OnlyNewerEventsAdvance) {
+  EventWatermark watermark(path_);
+  watermark.load(1000);
+  EXPECT_EQ(0u, watermark.timestamp_ns());
+
+  EXPECT_TRUE(watermark.advance(100));
+  EXPECT_FALSE(watermark.advance(100));
+  EXPECT_FALSE(watermark.advance(50));
+  EXPECT_TRUE(watermark.advance(101));
+  EXPECT_EQ(101u, watermark.timestamp_ns());
+}
+
+TEST_F(EventWatermarkTest, BacklogIsSkippedAfterRestart) {
+  {
+    EventWatermark watermark(path_);
+    watermark.load(1000);
+    watermark.advance(100);
+    watermark.advance(200);
+    watermark.persist(0);
+  }
+
+  EventWatermark restarted(path_);
+  restarted.load(1000);
+  EXPECT_FALSE(restarted.advance(100));
+  EXPECT_FALSE(restarted.advance(200));
+  EXPECT_TRUE(restarted.advance(300));
+}
+
+TEST_F(EventWatermarkTest, PersistsAtMostEveryInterval) {
+  EventWatermark watermark(path_);
+  watermark.advance(100);
+  watermark.persist(10000, 5000);
+  watermark.advance(200);
+  watermark.persist(12000, 5000);
+
+  EventWatermark restored(path_);
+  restored.load(1000);
+  EXPECT_EQ(100u, restored.timestamp_ns());
+
+  // Regardless of the interval when it is 0, e.g. at the end of a read batch
+  watermark.persist(12000);
+  restored.load(1000);
+  EXPECT_EQ(200u, restored.timestamp_ns());
+}
+
+TEST_F(EventWatermarkTest, WatermarkAheadOfTheClockIsDropped) {
+  std::ofstream(path_) << "5000\n";
+  EventWatermark watermark(path_);
+  watermark.load(1000);
+  EXPECT_EQ(0u, watermark.timestamp_ns());
+  EXPECT_TRUE(watermark.advance(500));
+}
+
+TEST_F(EventWatermarkTest, MalformedFileIsIgnored) {
+  std::ofstream(path_) << "garbage\n";
+  EventWatermark watermark(path_);
+  watermark.load(1000);
+  EXPECT_EQ(0u, watermark.timestamp_ns());
+}
+
+}  // namespace
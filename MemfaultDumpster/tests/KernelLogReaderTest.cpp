@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "KernelLogReader.h"
+
+using memfault::KernelLogReader;
+
+namespace {
+
+class KernelLogReaderTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char dir[] = "/tmp/mflt-kmsg-XXXXXX";
+      ASSERT_NE(nullptr, mkdtemp(dir));
+      dir_ = dir;
+      path_ = dir_ + "/kmsg";
+      std::ofstream(path_).close();
+    }
+
+    void TearDown() override {
+      system(("rm -rf " + dir_).c_str());
+    }
+
+    // Appends to the fake device, as /dev/kmsg formats records
+    void append(const std::string& records) {
+      std::ofstream(path_, std::ios::app) << records;
+    }
+
+    static std::string record(int level, uint64_t seq, uint64_t timestamp_us,
+                              const std::string& message) {
+      return std::to_string(level) + "," + std::to_string(seq) + "," +
+          std::to_string(timestamp_us) + ",-;" + message + "\n";
+    }
+
+    static int64_t realtime_offset_ns() {
+      struct timespec realtime, monotonic;
+      clock_gettime(CLOCK_REALTIME, &realtime);
+      clock_gettime(CLOCK_MONOTONIC, &monotonic);
+      return (realtime.tv_sec - monotonic.tv_sec) * 1000000000LL +
+          (realtime.tv_nsec - monotonic.tv_nsec);
+    }
+
+    static std::string message(const AndroidLogEntry *entry) {
+      return std::string(entry->message, entry->messageLen);
+    }
+
+    std::string dir_;
+    std::string path_;
+};
+
+TEST_F(KernelLogReaderTest, ParsesRecords) {
+  append(record(6, 1, 1000000, "info") +
+         // Continuation lines are not part of the message
+         record(3, 2, 2500000, "usb 1-1: error") + " SUBSYSTEM=usb\n DEVICE=c189:1\n" +
+         // Facility 1 (user), level 4
+         record(12, 3, 3000000, "warning"));
+
+  KernelLogReader reader(path_);
+  ASSERT_TRUE(reader.open());
+  reader.drain();
+
+  const AndroidLogEntry *entry = reader.peek();
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ("kernel", std::string(entry->tag, entry->tagLen));
+  EXPECT_EQ(ANDROID_LOG_INFO, entry->priority);
+  EXPECT_EQ("info", message(entry));
+  // Monotonic timestamps converted to realtime
+  int64_t realtime_ns = entry->tv_sec * 1000000000LL + entry->tv_nsec;
+  EXPECT_NEAR(1000000000LL + realtime_offset_ns(), realtime_ns, 100000000LL);
+  time_t first_sec = entry->tv_sec;
+  long first_nsec = entry->tv_nsec;
+  // The same entry until popped
+  EXPECT_EQ(entry, reader.peek());
+  reader.pop();
+
+  entry = reader.peek();
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(ANDROID_LOG_ERROR, entry->priority);
+  EXPECT_EQ("usb 1-1: error", message(entry));
+  EXPECT_EQ(1500000000LL, (entry->tv_sec - first_sec) * 1000000000LL +
+                          (entry->tv_nsec - first_nsec));
+  reader.pop();
+
+  entry = reader.peek();
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(ANDROID_LOG_WARN, entry->priority);
+  EXPECT_EQ("warning", message(entry));
+  EXPECT_TRUE(reader.next_is_before(entry->tv_sec, entry->tv_nsec));
+  EXPECT_FALSE(reader.next_is_before(first_sec, first_nsec));
+  reader.pop();
+
+  EXPECT_EQ(nullptr, reader.peek());
+  EXPECT_EQ(0u, reader.lost_records());
+}
+
+TEST_F(KernelLogReaderTest, SequenceGapsCountLostRecords) {
+  append(record(6, 10, 1, "a") + record(6, 11, 2, "b") + record(6, 14, 3, "c"));
+  KernelLogReader reader(path_);
+  ASSERT_TRUE(reader.open());
+  reader.drain();
+  EXPECT_EQ(2u, reader.lost_records());
+
+  append(record(6, 15, 4, "d") + record(6, 20, 5, "e"));
+  reader.drain();
+  EXPECT_EQ(6u, reader.lost_records());
+
+  int count = 0;
+  for (; reader.peek() != nullptr; reader.pop()) count++;
+  EXPECT_EQ(5, count);
+}
+
+TEST_F(KernelLogReaderTest, PartialRecordsWaitForTheirEnd) {
+  KernelLogReader reader(path_);
+  ASSERT_TRUE(reader.open());
+
+  append("6,1,1000,-;first half");
+  reader.drain();
+  EXPECT_EQ(nullptr, reader.peek());
+
+  append(" and second half\n SUBSYSTEM=usb\n" + record(6, 2, 2000, "next"));
+  reader.drain();
+  ASSERT_NE(nullptr, reader.peek());
+  EXPECT_EQ("first half and second half", message(reader.peek()));
+  reader.pop();
+  ASSERT_NE(nullptr, reader.peek());
+  EXPECT_EQ("next", message(reader.peek()));
+  reader.pop();
+  EXPECT_EQ(0u, reader.lost_records());
+}
+
+TEST_F(KernelLogReaderTest, SkipsRecordsReadBeforeReopening) {
+  append(record(6, 1, 1000, "a") + record(6, 2, 2000, "b"));
+  KernelLogReader reader(path_);
+  ASSERT_TRUE(reader.open());
+  reader.drain();
+  reader.close();
+  EXPECT_EQ(nullptr, reader.peek());
+
+  append(record(6, 3, 3000, "c"));
+  ASSERT_TRUE(reader.open());
+  reader.drain();
+  ASSERT_NE(nullptr, reader.peek());
+  EXPECT_EQ("c", message(reader.peek()));
+  reader.pop();
+  EXPECT_EQ(nullptr, reader.peek());
+  EXPECT_EQ(0u, reader.lost_records());
+}
+
+TEST_F(KernelLogReaderTest, FullQueueDropsOldestRecords) {
+  std::string records;
+  const std::string payload(1000, 'x');
+  for (int seq = 1; seq <= 1000; seq++) {
+    records += record(6, seq, seq * 1000, std::to_string(seq) + " " + payload);
+  }
+  append(records);
+
+  KernelLogReader reader(path_);
+  ASSERT_TRUE(reader.open());
+  reader.drain();
+  EXPECT_GT(reader.lost_records(), 0u);
+
+  uint64_t count = 0;
+  std::string last;
+  for (; reader.peek() != nullptr; reader.pop()) {
+    count++;
+    last = message(reader.peek());
+  }
+  EXPECT_EQ(1000u, count + reader.lost_records());
+  EXPECT_EQ("1000 " + payload, last);
+}
+
+TEST_F(KernelLogReaderTest, DrainsInBackground) {
+  // A FIFO stands in for the device: it is only readable when records are written
+  std::string fifo = dir_ + "/fifo";
+  ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+  android::base::unique_fd writer(open(fifo.c_str(), O_RDWR | O_CLOEXEC));
+  ASSERT_GE(writer.get(), 0);
+
+  KernelLogReader reader(fifo);
+  ASSERT_TRUE(reader.open());
+  std::atomic<int> backlogs{0};
+  reader.start_draining([&]() { backlogs++; });
+
+  std::string first = record(6, 1, 1000, "first");
+  ASSERT_EQ((ssize_t)first.size(), write(writer.get(), first.data(), first.size()));
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (reader.peek() == nullptr && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_NE(nullptr, reader.peek());
+  EXPECT_EQ("first", message(reader.peek()));
+  reader.pop();
+
+  // Past half the queue, the owner is asked to consume it
+  const std::string payload(1000, 'x');
+  for (int seq = 2; seq < 200 && backlogs.load() == 0; seq++) {
+    std::string next = record(6, seq, seq * 1000, payload);
+    ASSERT_EQ((ssize_t)next.size(), write(writer.get(), next.data(), next.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (backlogs.load() == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1, backlogs.load());
+
+  reader.close();
+  EXPECT_FALSE(reader.is_open());
+}
+
+}  // namespace
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "LogSubscriber.h"
+
+using memfault::LogSubscriber;
+
+namespace {
+
+constexpr const char *kEnd = "<end>";
+
+class LogSubscriberTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      signal(SIGPIPE, SIG_IGN);
+      int fds[2];
+      ASSERT_EQ(0, pipe2(fds, O_CLOEXEC));
+      read_fd_.reset(fds[0]);
+      write_fd_ = fds[1];
+    }
+
+    std::unique_ptr<LogSubscriber> subscriber(const std::vector<std::string>& filter_specs) {
+      std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format(
+          android_log_format_new(), android_log_format_free);
+      android_log_setPrintFormat(format.get(), FORMAT_THREADTIME);
+      for (auto& spec : filter_specs) {
+        android_log_addFilterRule(format.get(), spec.c_str());
+      }
+      android_log_addFilterRule(format.get(), "*:S");
+      return std::make_unique<LogSubscriber>(1, std::move(format),
+                                             android::base::unique_fd(write_fd_));
+    }
+
+    static AndroidLogEntry entry(const char *tag, const std::string& message,
+                                 android_LogPriority priority = ANDROID_LOG_INFO) {
+      AndroidLogEntry entry = {};
+      entry.tv_sec = 1700000000;
+      entry.priority = priority;
+      entry.uid = 10001;
+      entry.pid = 123;
+      entry.tid = 124;
+      entry.tag = tag;
+      entry.tagLen = strlen(tag);
+      entry.message = message.c_str();
+      entry.messageLen = message.size();
+      return entry;
+    }
+
+    std::string drain() {
+      int flags = fcntl(read_fd_.get(), F_GETFL);
+      fcntl(read_fd_.get(), F_SETFL, flags | O_NONBLOCK);
+      std::string output;
+      char buf[4096];
+      ssize_t len;
+      while ((len = read(read_fd_.get(), buf, sizeof(buf))) > 0) {
+        output.append(buf, len);
+      }
+      fcntl(read_fd_.get(), F_SETFL, flags);
+      return output;
+    }
+
+    static std::vector<std::string> lines(const std::string& output) {
+      std::vector<std::string> lines;
+      std::istringstream stream(output);
+      std::string line;
+      while (std::getline(stream, line)) lines.push_back(line);
+      return lines;
+    }
+
+    static bool ends_with(const std::string& value, const std::string& suffix) {
+      return value.size() >= suffix.size() &&
+          value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    android::base::unique_fd read_fd_;
+    // Owned by the subscriber
+    int write_fd_ = -1;
+};
+
+TEST_F(LogSubscriberTest, FiltersAndDividers) {
+  auto sink = subscriber({"Keep:I"});
+  std::string first = "first", dropped = "dropped", second = "second", third = "third";
+
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", first)));
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Other", dropped)));
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", dropped, ANDROID_LOG_DEBUG)));
+  EXPECT_TRUE(sink->write(LOG_ID_SYSTEM, "system", entry("Keep", second)));
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", third)));
+
+  auto output = lines(drain());
+  ASSERT_EQ(6u, output.size());
+  EXPECT_EQ("--------- beginning of main", output[0]);
+  EXPECT_TRUE(ends_with(output[1], ": first")) << output[1];
+  EXPECT_EQ("--------- beginning of system", output[2]);
+  EXPECT_TRUE(ends_with(output[3], ": second")) << output[3];
+  EXPECT_EQ("--------- switch to main", output[4]);
+  EXPECT_TRUE(ends_with(output[5], ": third")) << output[5];
+  EXPECT_EQ(0u, sink->dropped_lines());
+}
+
+TEST_F(LogSubscriberTest, FullPipeDropsWholeLines) {
+  ASSERT_GT(fcntl(write_fd_, F_SETPIPE_SZ, 4096), 0);
+  auto sink = subscriber({"Keep:V"});
+
+  // Lines straddling the end of the pipe, and lines longer than the pipe itself
+  std::vector<std::string> messages;
+  for (int i = 0; i < 100; i++) {
+    messages.push_back("line " + std::to_string(i) + " " +
+                       std::string(i % 10 == 0 ? 6000 : 150, 'x') + kEnd);
+  }
+
+  std::string output;
+  for (size_t i = 0; i < messages.size(); i++) {
+    EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", messages[i])));
+    // The client reads from time to time
+    if (i % 25 == 24) output += drain();
+  }
+  EXPECT_GT(sink->dropped_lines(), 0u);
+
+  // The sink is not made non-blocking for the client
+  EXPECT_EQ(0, fcntl(write_fd_, F_GETFL) & O_NONBLOCK);
+
+  // The end of a partially written line is written before the next line
+  for (int i = 0; i < 3; i++) {
+    output += drain();
+    std::string last = std::string("last ") + std::to_string(i) + kEnd;
+    EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", last)));
+  }
+  output += drain();
+
+  auto written = lines(output);
+  ASSERT_FALSE(written.empty());
+  EXPECT_EQ("--------- beginning of main", written[0]);
+  for (size_t i = 1; i < written.size(); i++) {
+    EXPECT_TRUE(ends_with(written[i], kEnd)) << written[i].substr(0, 80);
+  }
+  EXPECT_EQ(messages.size() + 3, written.size() - 1 + sink->dropped_lines());
+  EXPECT_TRUE(ends_with(written.back(), std::string("last 2") + kEnd));
+}
+
+TEST_F(LogSubscriberTest, ClosedPipeFails) {
+  auto sink = subscriber({"Keep:V"});
+  std::string message = "message";
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", message)));
+
+  read_fd_.reset();
+  EXPECT_FALSE(sink->write(LOG_ID_MAIN, "main", entry("Keep", message)));
+  EXPECT_TRUE(sink->closed());
+  EXPECT_FALSE(sink->write(LOG_ID_MAIN, "main", entry("Keep", message)));
+}
+
+TEST_F(LogSubscriberTest, CloseReleasesSink) {
+  auto sink = subscriber({"Keep:V"});
+  std::string message = "message";
+  EXPECT_TRUE(sink->write(LOG_ID_MAIN, "main", entry("Keep", message)));
+
+  sink->close();
+  EXPECT_TRUE(sink->closed());
+  EXPECT_FALSE(sink->write(LOG_ID_MAIN, "main", entry("Keep", message)));
+
+  // The write end is gone: the client reads what was written, then the end of the pipe
+  EXPECT_EQ(2u, lines(drain()).size());
+  char buf[1];
+  EXPECT_EQ(0, read(read_fd_.get(), buf, sizeof(buf)));
+}
+
+TEST(LogSubscriberSocketTest, FullSocketDropsWholeLines) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds));
+  android::base::unique_fd client(fds[0]);
+  int size = 4096;
+  setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format(
+      android_log_format_new(), android_log_format_free);
+  android_log_addFilterRule(format.get(), "*:V");
+  LogSubscriber sink(1, std::move(format), android::base::unique_fd(fds[1]));
+
+  std::string message = std::string(300, 'x') + kEnd;
+  AndroidLogEntry entry = {};
+  entry.priority = ANDROID_LOG_INFO;
+  entry.tag = "Tag";
+  entry.tagLen = 3;
+  entry.message = message.c_str();
+  entry.messageLen = message.size();
+  for (int i = 0; i < 500; i++) {
+    EXPECT_TRUE(sink.write(LOG_ID_MAIN, nullptr, entry));
+  }
+  EXPECT_GT(sink.dropped_lines(), 0u);
+  EXPECT_EQ(0, fcntl(fds[1], F_GETFL) & O_NONBLOCK);
+}
+
+}  // namespace
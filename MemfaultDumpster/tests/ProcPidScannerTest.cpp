@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ProcPidScanner.h"
+
+using memfault::ProcPidScanner;
+
+namespace {
+
+// Unlike /proc, the directories of the synthetic tree are not listed in pid order
+std::vector<std::string> sortedLines(const std::string& text) {
+  std::vector<std::string> lines;
+  std::istringstream stream(text);
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (!line.empty()) lines.push_back(line);
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+// A synthetic /proc: pid directories with stat and status files, and a few distractors
+class ProcPidScannerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char path[] = "/tmp/ProcPidScannerTestXXXXXX";
+      ASSERT_NE(nullptr, mkdtemp(path));
+      root_ = path;
+      writeFile("stat", "cpu  1 2 3\n");
+      mkdir((root_ + "/self").c_str(), 0755);
+      mkdir((root_ + "/sys").c_str(), 0755);
+    }
+
+    void TearDown() override {
+      std::string command = "rm -rf " + root_;
+      int rv = system(command.c_str());
+      (void)rv;
+    }
+
+    void writeFile(const std::string& name, const std::string& contents) {
+      int fd = open((root_ + "/" + name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      ASSERT_GE(fd, 0);
+      ASSERT_EQ((ssize_t)contents.size(), write(fd, contents.data(), contents.size()));
+      close(fd);
+    }
+
+    // effective_uid defaults to the real one
+    void addPid(int pid, int uid, const std::string& stat, int effective_uid = -1) {
+      std::string dir = std::to_string(pid);
+      ASSERT_EQ(0, mkdir((root_ + "/" + dir).c_str(), 0755));
+      writeFile(dir + "/stat", stat);
+      writeFile(dir + "/status",
+                "Name:\tproc\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t" + dir +
+                "\nPid:\t" + dir + "\nPPid:\t1\nTracerPid:\t0\nUid:\t" + std::to_string(uid) +
+                "\t" + std::to_string(effective_uid < 0 ? uid : effective_uid) +
+                "\t0\t0\nGid:\t0\t0\t0\t0\n");
+    }
+
+    std::string statFor(int pid, size_t padding = 0) {
+      return std::to_string(pid) + " (proc) S 1 " + std::string(padding, '0') +
+             " 0 0 0 -1 4194560 52 0 0 0 3 7 0 0 20 0 1 0 120 1000 100\n";
+    }
+
+    std::string lineFor(int uid, const std::string& stat) {
+      return std::to_string(uid) + " " + stat + "\n";
+    }
+
+    std::string root_;
+};
+
+TEST_F(ProcPidScannerTest, ListsEveryPid) {
+  std::string expected;
+  for (int pid = 1; pid <= 300; pid++) {
+    int uid = pid % 2 == 0 ? 10000 + pid : 1000;
+    std::string stat = statFor(pid);
+    addPid(pid, uid, stat);
+    expected += lineFor(uid, stat);
+  }
+
+  // Order and contents do not depend on how many threads share the scan
+  std::string single;
+  ProcPidScanner one(root_.c_str(), 1);
+  ASSERT_TRUE(one.scan(single));
+  std::string multiple;
+  ProcPidScanner four(root_.c_str(), 4);
+  ASSERT_TRUE(four.scan(multiple));
+  EXPECT_EQ(single, multiple);
+  EXPECT_EQ(sortedLines(expected), sortedLines(single));
+
+  // Buffers are reused, a second scan returns the same
+  std::string again;
+  ASSERT_TRUE(four.scan(again));
+  EXPECT_EQ(multiple, again);
+}
+
+TEST_F(ProcPidScannerTest, FormatsAsBefore) {
+  std::string stat = statFor(42);
+  addPid(42, 10057, stat);
+
+  std::string output;
+  ProcPidScanner scanner(root_.c_str());
+  ASSERT_TRUE(scanner.scan(output));
+  EXPECT_EQ(lineFor(10057, stat), output);
+}
+
+TEST_F(ProcPidScannerTest, UidIsTheRealUid) {
+  // e.g. an app running a setuid binary: /proc/<pid> is owned by the effective uid
+  std::string stat = statFor(7);
+  addPid(7, 10123, stat, 1000);
+  if (geteuid() == 0) {
+    ASSERT_EQ(0, chown((root_ + "/7").c_str(), 1000, 1000));
+  }
+
+  std::string output;
+  ProcPidScanner scanner(root_.c_str());
+  ASSERT_TRUE(scanner.scan(output));
+  EXPECT_EQ("10123 " + stat + "\n", output);
+}
+
+TEST_F(ProcPidScannerTest, FillsProtoSortedByPid) {
+  for (int pid = 300; pid >= 1; pid--) {
+    addPid(pid, 10000 + pid, statFor(pid));
+  }
+  // No status, uid unknown
+  ASSERT_EQ(0, mkdir((root_ + "/301").c_str(), 0755));
+  writeFile("301/stat", statFor(301));
+
+  memfault::ProcPidStatsProto proto;
+  ProcPidScanner scanner(root_.c_str(), 4);
+  for (int scan = 0; scan < 2; scan++) {
+    ASSERT_TRUE(scanner.scan(proto));
+    ASSERT_EQ(300, proto.processes_size());
+    for (int i = 0; i < proto.processes_size(); i++) {
+      const auto& process = proto.processes(i);
+      EXPECT_EQ(i + 1, process.pid());
+      EXPECT_EQ(10000u + i + 1, process.uid());
+      EXPECT_EQ("proc", process.comm());
+      EXPECT_EQ(120u, process.starttime());
+      EXPECT_EQ(100, process.rss());
+    }
+  }
+}
+
+TEST_F(ProcPidScannerTest, SkipsVanishedAndLargeEntries) {
+  // stat files larger than the initial buffer are read whole
+  std::string large = statFor(5, 10000);
+  addPid(5, 1000, large);
+  // Exited between listing and reading: no stat file
+  ASSERT_EQ(0, mkdir((root_ + "/6").c_str(), 0755));
+  writeFile("6/status", "Name:\tgone\nUid:\t0\t0\t0\t0\n");
+  // No status, uid unknown
+  ASSERT_EQ(0, mkdir((root_ + "/8").c_str(), 0755));
+  writeFile("8/stat", statFor(8));
+
+  std::string output;
+  ProcPidScanner scanner(root_.c_str());
+  ASSERT_TRUE(scanner.scan(output));
+  EXPECT_EQ(sortedLines(lineFor(1000, large)), sortedLines(output));
+}
+
+TEST(ProcPidScannerMissingTest, FailsWithoutProc) {
+  std::string output = "stale";
+  ProcPidScanner scanner("/nonexistent/proc");
+  EXPECT_FALSE(scanner.scan(output));
+  EXPECT_TRUE(output.empty());
+
+  memfault::ProcPidStatsProto proto;
+  proto.add_processes();
+  EXPECT_FALSE(scanner.scan(proto));
+  EXPECT_EQ(0, proto.processes_size());
+}
+
+}
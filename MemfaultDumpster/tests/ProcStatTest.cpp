@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "ProcStat.h"
+
+using memfault::ProcStat;
+using memfault::ProcStatReader;
+
+namespace {
+
+// Captured on an 8 core arm64 phone (5.10), with cpu5 offline. Per interrupt counts trimmed.
+const char *kPhoneSample =
+    "cpu  2255098 94616 1614330 37004861 47254 277123 95407 0 0 0\n"
+    "cpu0 413339 14985 357744 4284361 10859 96453 40071 0 0 0\n"
+    "cpu1 376062 15722 264102 4466745 8662 34817 14005 0 0 0\n"
+    "cpu2 365587 16127 251632 4496349 8484 32168 11914 0 0 0\n"
+    "cpu3 355106 15875 243069 4528048 8356 31018 11077 0 0 0\n"
+    "cpu4 232311 12302 159458 4842025 4271 27372 6142 0 0 0\n"
+    "cpu6 259047 10007 183027 5072130 3321 29004 6371 0 0 0\n"
+    "cpu7 253646 9598 155298 9315203 3301 26291 5827 0 0 0\n"
+    "intr 181926440 0 0 0 0 30785398 0 2906443 0 54001 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+    "ctxt 330873929\n"
+    "btime 1712044112\n"
+    "processes 403275\n"
+    "procs_running 3\n"
+    "procs_blocked 1\n"
+    "softirq 78815430 2231 16838093 4151 4297025 0 0 4530871 30093573 0 23045486\n";
+
+const char *kPhoneSummary =
+    "cpu  2255098 94616 1614330 37004861 47254 277123 95407 0 0 0\n"
+    "cpu0 413339 14985 357744 4284361 10859 96453 40071 0 0 0\n"
+    "cpu1 376062 15722 264102 4466745 8662 34817 14005 0 0 0\n"
+    "cpu2 365587 16127 251632 4496349 8484 32168 11914 0 0 0\n"
+    "cpu3 355106 15875 243069 4528048 8356 31018 11077 0 0 0\n"
+    "cpu4 232311 12302 159458 4842025 4271 27372 6142 0 0 0\n"
+    "cpu6 259047 10007 183027 5072130 3321 29004 6371 0 0 0\n"
+    "cpu7 253646 9598 155298 9315203 3301 26291 5827 0 0 0\n"
+    "intr 181926440\n"
+    "ctxt 330873929\n"
+    "btime 1712044112\n"
+    "processes 403275\n"
+    "procs_running 3\n"
+    "procs_blocked 1\n"
+    "softirq 78815430\n";
+
+// Captured on a 2 core 3.10 device: 8 columns, no softirq line
+const char *kOldKernelSample =
+    "cpu  71430 1942 53368 1273474 12084 3 701 0\n"
+    "cpu0 38932 1063 30813 628116 6617 3 536 0\n"
+    "cpu1 32498 879 22555 645358 5467 0 165 0\n"
+    "intr 3564912 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 41 0\n"
+    "ctxt 7125542\n"
+    "btime 1417080402\n"
+    "processes 8823\n"
+    "procs_running 1\n"
+    "procs_blocked 0\n";
+
+const char *kOldKernelSummary =
+    "cpu  71430 1942 53368 1273474 12084 3 701 0 0 0\n"
+    "cpu0 38932 1063 30813 628116 6617 3 536 0 0 0\n"
+    "cpu1 32498 879 22555 645358 5467 0 165 0 0 0\n"
+    "intr 3564912\n"
+    "ctxt 7125542\n"
+    "btime 1417080402\n"
+    "processes 8823\n"
+    "procs_running 1\n"
+    "procs_blocked 0\n"
+    "softirq 0\n";
+
+TEST(ProcStatTest, ParsesPhoneSample) {
+  ProcStat stat;
+  ASSERT_TRUE(memfault::parse_proc_stat(kPhoneSample, stat));
+
+  EXPECT_EQ(-1, stat.total.cpu);
+  EXPECT_EQ(2255098u, stat.total.jiffies[memfault::CPU_USER]);
+  EXPECT_EQ(37004861u, stat.total.jiffies[memfault::CPU_IDLE]);
+  EXPECT_EQ(95407u, stat.total.jiffies[memfault::CPU_SOFTIRQ]);
+  ASSERT_EQ(7u, stat.cpus.size());
+  EXPECT_EQ(0, stat.cpus[0].cpu);
+  EXPECT_EQ(6, stat.cpus[5].cpu);
+  EXPECT_EQ(9315203u, stat.cpus[6].jiffies[memfault::CPU_IDLE]);
+  EXPECT_EQ(181926440u, stat.interrupts);
+  EXPECT_EQ(330873929u, stat.context_switches);
+  EXPECT_EQ(1712044112u, stat.boot_time);
+  EXPECT_EQ(403275u, stat.processes);
+  EXPECT_EQ(3u, stat.procs_running);
+  EXPECT_EQ(1u, stat.procs_blocked);
+  EXPECT_EQ(78815430u, stat.softirqs);
+
+  std::string summary;
+  memfault::format_proc_stat_summary(stat, summary);
+  EXPECT_EQ(kPhoneSummary, summary);
+}
+
+TEST(ProcStatTest, ParsesOldKernelSample) {
+  ProcStat stat;
+  ASSERT_TRUE(memfault::parse_proc_stat(kOldKernelSample, stat));
+  ASSERT_EQ(2u, stat.cpus.size());
+  EXPECT_EQ(0u, stat.total.jiffies[memfault::CPU_GUEST]);
+
+  std::string summary;
+  memfault::format_proc_stat_summary(stat, summary);
+  EXPECT_EQ(kOldKernelSummary, summary);
+}
+
+TEST(ProcStatTest, RejectsGarbage) {
+  ProcStat stat;
+  EXPECT_FALSE(memfault::parse_proc_stat("", stat));
+  EXPECT_FALSE(memfault::parse_proc_stat("cpu0 1 2 3\nctxt 5\n", stat));
+  // Truncated mid-line
+  EXPECT_TRUE(memfault::parse_proc_stat("cpu  1 2 3\nctxt 4", stat));
+  EXPECT_EQ(4u, stat.context_switches);
+}
+
+TEST(ProcStatTest, ReaderRereadsFromStart) {
+  char path[] = "/tmp/ProcStatTestXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  // Larger than the initial buffer
+  std::string contents(kPhoneSample);
+  while (contents.size() < 40000) contents += "intr 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18\n";
+  ASSERT_EQ((ssize_t)contents.size(), write(fd, contents.data(), contents.size()));
+
+  ProcStatReader reader(path);
+  EXPECT_EQ(contents, reader.read());
+  EXPECT_EQ(contents, reader.read());
+
+  close(fd);
+  unlink(path);
+  EXPECT_EQ(contents, reader.read());
+
+  ProcStatReader missing("/nonexistent/stat");
+  EXPECT_TRUE(missing.read().empty());
+}
+
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ProcessNameCache.h"
+
+using memfault::ProcessNameCache;
+
+namespace {
+
+class ProcessNameCacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char dir[] = "/tmp/mflt-proc-XXXXXX";
+      ASSERT_NE(nullptr, mkdtemp(dir));
+      root_ = dir;
+      now_ = time(nullptr);
+    }
+
+    void TearDown() override {
+      system(("rm -rf " + root_).c_str());
+    }
+
+    // Fakes /proc/<pid> for a process started seconds_ago
+    void add_process(int32_t pid, const std::string& comm, const std::string& cmdline,
+                     time_t seconds_ago) {
+      struct timespec boottime;
+      clock_gettime(CLOCK_BOOTTIME, &boottime);
+      long ticks = (boottime.tv_sec - seconds_ago) * sysconf(_SC_CLK_TCK);
+
+      std::string dir = root_ + "/" + std::to_string(pid);
+      mkdir(dir.c_str(), 0755);
+      std::ofstream(dir + "/stat") << pid << " (" << comm << ") S 1 1 0 0 -1 4194560 100 0 0 0 "
+          << "5 3 0 0 20 0 12 0 " << ticks << " 1000000 500 18446744073709551615\n";
+      std::ofstream(dir + "/cmdline") << cmdline << '\0' << "--flag" << '\0';
+    }
+
+    void remove_process(int32_t pid) {
+      system(("rm -rf " + root_ + "/" + std::to_string(pid)).c_str());
+    }
+
+    std::string root_;
+    time_t now_;
+};
+
+}  // namespace
+
+TEST_F(ProcessNameCacheTest, ReadsProcOncePerProcess) {
+  add_process(100, "app_process", "com.example.app", 60);
+  ProcessNameCache cache(8, root_);
+
+  for (int i = 0; i < 10; i++) {
+    const std::string *name = cache.lookup(100, 10001, now_);
+    ASSERT_NE(nullptr, name);
+    EXPECT_EQ("com.example.app", *name);
+  }
+  EXPECT_EQ(1u, cache.fills());
+}
+
+TEST_F(ProcessNameCacheTest, FallsBackToCommWithoutCmdline) {
+  add_process(2, "kworker/0:1 (x)", "", 60);
+  ProcessNameCache cache(8, root_);
+
+  const std::string *name = cache.lookup(2, 0, now_);
+  ASSERT_NE(nullptr, name);
+  EXPECT_EQ("kworker/0:1 (x)", *name);
+}
+
+TEST_F(ProcessNameCacheTest, PidReusedByAnotherUid) {
+  add_process(100, "app_process", "com.example.first", 60);
+  ProcessNameCache cache(8, root_);
+  EXPECT_EQ("com.example.first", *cache.lookup(100, 10001, now_));
+
+  remove_process(100);
+  add_process(100, "app_process", "com.example.second", 5);
+  EXPECT_EQ("com.example.second", *cache.lookup(100, 10002, now_));
+  EXPECT_EQ(2u, cache.fills());
+}
+
+TEST_F(ProcessNameCacheTest, PidReusedBySameUid) {
+  add_process(100, "app_process", "com.example.first", 60);
+  ProcessNameCache cache(8, root_);
+  EXPECT_EQ("com.example.first", *cache.lookup(100, 10001, now_));
+
+  // Lines newer than the fill check the start time, the process is the same
+  EXPECT_EQ("com.example.first", *cache.lookup(100, 10001, now_ + 2));
+  EXPECT_EQ(1u, cache.revalidations());
+  EXPECT_EQ(1u, cache.fills());
+
+  remove_process(100);
+  add_process(100, "app_process", "com.example.second", 0);
+  EXPECT_EQ("com.example.second", *cache.lookup(100, 10001, now_ + 4));
+  EXPECT_EQ(2u, cache.fills());
+}
+
+TEST_F(ProcessNameCacheTest, LinesOlderThanTheProcessAreUnknown) {
+  // The process that logged the line exited and its pid was reused before the reader
+  // got to the line
+  add_process(100, "app_process", "com.example.app", 5);
+  ProcessNameCache cache(8, root_);
+
+  EXPECT_EQ(nullptr, cache.lookup(100, 10001, now_ - 60));
+  EXPECT_NE(nullptr, cache.lookup(100, 10001, now_));
+  EXPECT_EQ(1u, cache.fills());
+}
+
+TEST_F(ProcessNameCacheTest, ExitedProcessIsOnlyLookedUpAgainForNewerLines) {
+  ProcessNameCache cache(8, root_);
+  EXPECT_EQ(nullptr, cache.lookup(100, 10001, now_ - 10));
+  EXPECT_EQ(nullptr, cache.lookup(100, 10001, now_ - 5));
+  EXPECT_EQ(1u, cache.fills());
+
+  add_process(100, "app_process", "com.example.app", 0);
+  const std::string *name = cache.lookup(100, 10001, now_ + 2);
+  ASSERT_NE(nullptr, name);
+  EXPECT_EQ("com.example.app", *name);
+  EXPECT_EQ(2u, cache.fills());
+}
+
+TEST_F(ProcessNameCacheTest, EvictsLeastRecentlyUsed) {
+  for (int32_t pid = 1; pid <= 3; pid++) {
+    add_process(pid, "proc", "proc" + std::to_string(pid), 60);
+  }
+  ProcessNameCache cache(2, root_);
+
+  cache.lookup(1, 0, now_);
+  cache.lookup(2, 0, now_);
+  cache.lookup(1, 0, now_);
+  cache.lookup(3, 0, now_);  // evicts 2
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(3u, cache.fills());
+
+  cache.lookup(1, 0, now_);
+  EXPECT_EQ(3u, cache.fills());
+  cache.lookup(2, 0, now_);
+  EXPECT_EQ(4u, cache.fills());
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "ProcessSnapshotTracker.h"
+
+using memfault::ProcessSnapshotTracker;
+
+namespace {
+
+constexpr uint32_t kEpoch = 7;
+
+std::string stat(int pid, const char *name, int utime, int stime, int start_time = 100) {
+  return std::to_string(pid) + " (" + name + ") S 1 " + std::to_string(pid) +
+         " 0 0 -1 4194560 10 0 0 0 " + std::to_string(utime) + " " + std::to_string(stime) +
+         " 0 0 20 0 1 0 " + std::to_string(start_time) + " 1000 100\n";
+}
+
+// As ProcPidScanner formats them
+std::string line(int uid, const std::string& stat) {
+  return std::to_string(uid) + " " + stat + "\n";
+}
+
+std::string header(uint64_t generation, const char *kind) {
+  return std::to_string(((uint64_t)kEpoch << 32) | generation) + " " + kind + "\n";
+}
+
+class ProcessSnapshotTrackerTest : public ::testing::Test {
+  protected:
+    ProcessSnapshotTrackerTest()
+      : tracker(kEpoch, [this](std::string& output) {
+          output = processes;
+          return scanOk;
+        }, 2) {}
+
+    std::string processes;
+    bool scanOk = true;
+    ProcessSnapshotTracker tracker;
+};
+
+TEST_F(ProcessSnapshotTrackerTest, FullThenDeltas) {
+  processes = line(0, stat(1, "init", 5, 7)) + line(10057, stat(30, "com.app (main)", 100, 50)) +
+              line(1000, stat(12, "system_server", 900, 400));
+  std::string output;
+  ASSERT_TRUE(tracker.changes_since(0, output));
+  // Sorted by pid
+  EXPECT_EQ(header(1, "full") + "+0 " + stat(1, "init", 5, 7) +
+            "+1000 " + stat(12, "system_server", 900, 400) +
+            "+10057 " + stat(30, "com.app (main)", 100, 50), output);
+
+  // init is unchanged, system_server used more CPU, the app exited and another started
+  processes = line(0, stat(1, "init", 5, 7)) + line(1000, stat(12, "system_server", 950, 401)) +
+              line(10060, stat(31, "com.other", 1, 1));
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 1, output));
+  EXPECT_EQ(header(2, "delta") + "~12 14=950 15=401\n" + "-30\n" +
+            "+10060 " + stat(31, "com.other", 1, 1), output);
+
+  // Nothing changed
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 2, output));
+  EXPECT_EQ(header(3, "delta"), output);
+}
+
+TEST_F(ProcessSnapshotTrackerTest, ReusedPidIsNewProcess) {
+  processes = line(10057, stat(30, "com.app", 100, 50, 200));
+  std::string output;
+  ASSERT_TRUE(tracker.changes_since(0, output));
+
+  // Same name and uid, started later
+  processes = line(10057, stat(30, "com.app", 1, 1, 900));
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 1, output));
+  EXPECT_EQ(header(2, "delta") + "+10057 " + stat(30, "com.app", 1, 1, 900), output);
+
+  // Another uid
+  processes = line(10058, stat(30, "com.app", 1, 1, 900));
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 2, output));
+  EXPECT_EQ(header(3, "delta") + "+10058 " + stat(30, "com.app", 1, 1, 900), output);
+}
+
+TEST_F(ProcessSnapshotTrackerTest, UnknownTokensGetFullSnapshot) {
+  processes = line(0, stat(1, "init", 5, 7));
+  std::string output;
+  ASSERT_TRUE(tracker.changes_since(0, output));
+  ASSERT_TRUE(tracker.changes_since(0, output));
+  ASSERT_TRUE(tracker.changes_since(0, output));
+
+  std::string full = "+0 " + stat(1, "init", 5, 7);
+  // Another epoch
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)(kEpoch + 1) << 32) | 3, output));
+  EXPECT_EQ(header(4, "full") + full, output);
+  // Evicted: only the last 2 snapshots are kept
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 1, output));
+  EXPECT_EQ(header(5, "full") + full, output);
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 4, output));
+  EXPECT_EQ(header(6, "delta"), output);
+  // Not issued yet
+  ASSERT_TRUE(tracker.changes_since(((uint64_t)kEpoch << 32) | 60, output));
+  EXPECT_EQ(header(7, "full") + full, output);
+}
+
+TEST_F(ProcessSnapshotTrackerTest, ScanFailure) {
+  scanOk = false;
+  std::string output = "stale";
+  EXPECT_FALSE(tracker.changes_since(0, output));
+  EXPECT_TRUE(output.empty());
+}
+
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include "PropertyTracker.h"
+
+using memfault::PropertyDelta;
+using memfault::PropertySource;
+using memfault::PropertyTracker;
+using memfault::SystemProperty;
+
+namespace {
+
+// Property areas as the tracker sees them: every set bumps the property and area serials
+class FakeProperties {
+  public:
+    void set(const std::string& name, const std::string& value) {
+      auto& property = properties_[name];
+      property.first = value;
+      property.second = ++area_serial_;
+    }
+
+    PropertySource source() {
+      return PropertySource{
+        [this]() { return area_serial_; },
+        [this](const memfault::SystemPropertyFunc& func) {
+          enumerations++;
+          for (const auto& it : properties_) {
+            func(it.first.c_str(), it.second.first.c_str(), it.second.second);
+          }
+        },
+      };
+    }
+
+    int enumerations = 0;
+
+  private:
+    // By name: value, serial
+    std::map<std::string, std::pair<std::string, uint32_t>> properties_;
+    uint32_t area_serial_ = 0;
+};
+
+std::string names(const PropertyDelta& delta) {
+  std::string names;
+  for (const auto& property : delta.properties) {
+    names += property.name + "=" + property.value + " ";
+  }
+  return names;
+}
+
+TEST(PropertyTrackerTest, UnknownTokensGetEverything) {
+  FakeProperties properties;
+  properties.set("b", "2");
+  properties.set("a", "1");
+  PropertyTracker tracker(42, properties.source());
+
+  PropertyDelta delta = tracker.changes_since(0);
+  EXPECT_TRUE(delta.full);
+  EXPECT_EQ("a=1 b=2 ", names(delta));
+
+  // From another tracker, e.g. before a restart
+  PropertyTracker other(43, properties.source());
+  delta = tracker.changes_since(other.current_token());
+  EXPECT_TRUE(delta.full);
+  EXPECT_EQ("a=1 b=2 ", names(delta));
+}
+
+TEST(PropertyTrackerTest, ReturnsOnlyChanges) {
+  FakeProperties properties;
+  properties.set("a", "1");
+  properties.set("b", "2");
+  PropertyTracker tracker(42, properties.source());
+  uint64_t token = tracker.changes_since(0).token;
+
+  PropertyDelta delta = tracker.changes_since(token);
+  EXPECT_FALSE(delta.full);
+  EXPECT_EQ("", names(delta));
+  EXPECT_EQ(token, delta.token);
+
+  properties.set("b", "3");
+  properties.set("c", "4");
+  // Set to the value it had
+  properties.set("a", "1");
+  delta = tracker.changes_since(token);
+  EXPECT_FALSE(delta.full);
+  EXPECT_EQ("b=3 c=4 ", names(delta));
+  EXPECT_NE(token, delta.token);
+
+  // Older tokens still work
+  properties.set("a", "5");
+  EXPECT_EQ("a=5 ", names(tracker.changes_since(delta.token)));
+  EXPECT_EQ("a=5 b=3 c=4 ", names(tracker.changes_since(token)));
+}
+
+TEST(PropertyTrackerTest, OnlyEnumeratesAfterChanges) {
+  FakeProperties properties;
+  properties.set("a", "1");
+  PropertyTracker tracker(42, properties.source());
+
+  uint64_t token = tracker.current_token();
+  tracker.changes_since(token);
+  tracker.changes_since(token);
+  EXPECT_EQ(1, properties.enumerations);
+
+  properties.set("a", "2");
+  tracker.changes_since(token);
+  EXPECT_EQ(2, properties.enumerations);
+}
+
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ResultCache.h"
+
+using memfault::ResultCache;
+
+namespace {
+
+constexpr int kKey = 6;
+constexpr uint64_t kTtlMs = 1000;
+
+TEST(ResultCacheTest, ServesUntilTtl) {
+  ResultCache cache;
+  int computations = 0;
+  auto compute = [&](std::string& output) {
+    output = "result " + std::to_string(++computations);
+    return 0;
+  };
+
+  std::string output;
+  EXPECT_EQ(0, cache.get(kKey, kTtlMs, 0, 100, compute, output));
+  EXPECT_EQ("result 1", output);
+  EXPECT_EQ(0, cache.get(kKey, kTtlMs, 0, 1099, compute, output));
+  EXPECT_EQ("result 1", output);
+  // Other keys are cached separately
+  EXPECT_EQ(0, cache.get(kKey + 1, kTtlMs, 0, 1099, compute, output));
+  EXPECT_EQ("result 2", output);
+
+  EXPECT_EQ(0, cache.get(kKey, kTtlMs, 0, 1100, compute, output));
+  EXPECT_EQ("result 3", output);
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(3u, cache.misses());
+}
+
+TEST(ResultCacheTest, VersionAndInvalidation) {
+  ResultCache cache;
+  int computations = 0;
+  auto compute = [&](std::string& output) {
+    output = std::to_string(++computations);
+    return 0;
+  };
+
+  std::string output;
+  cache.get(kKey, kTtlMs, 5, 0, compute, output);
+  cache.get(kKey, kTtlMs, 5, 0, compute, output);
+  EXPECT_EQ("1", output);
+  cache.get(kKey, kTtlMs, 6, 0, compute, output);
+  EXPECT_EQ("2", output);
+
+  cache.invalidate(kKey);
+  cache.get(kKey, kTtlMs, 6, 0, compute, output);
+  EXPECT_EQ("3", output);
+
+  cache.invalidate_all();
+  cache.get(kKey, kTtlMs, 6, 0, compute, output);
+  EXPECT_EQ("4", output);
+  EXPECT_EQ(1u, cache.hits());
+}
+
+TEST(ResultCacheTest, FailuresAreNotCached) {
+  ResultCache cache;
+  int rv = -5;
+  int computations = 0;
+  auto compute = [&](std::string& output) {
+    computations++;
+    output = "partial";
+    return rv;
+  };
+
+  std::string output;
+  EXPECT_EQ(-5, cache.get(kKey, kTtlMs, 0, 0, compute, output));
+  EXPECT_EQ("partial", output);
+  rv = 0;
+  EXPECT_EQ(0, cache.get(kKey, kTtlMs, 0, 0, compute, output));
+  EXPECT_EQ(0, cache.get(kKey, kTtlMs, 0, 0, compute, output));
+  EXPECT_EQ(2, computations);
+}
+
+TEST(ResultCacheTest, ConcurrentCallersShareOneComputation) {
+  ResultCache cache;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool release = false;
+  std::atomic<int> computations{0};
+  auto compute = [&](std::string& output) {
+    computations++;
+    std::unique_lock<std::mutex> guard(lock);
+    cv.wait(guard, [&]() { return release; });
+    output = "shared";
+    return 0;
+  };
+
+  constexpr int kCallers = 4;
+  std::vector<std::string> outputs(kCallers);
+  std::vector<std::thread> callers;
+  for (int i = 0; i < kCallers; i++) {
+    callers.emplace_back([&, i]() { cache.get(kKey, kTtlMs, 0, 0, compute, outputs[i]); });
+  }
+  // Every caller but the computing one is waiting
+  while (cache.hits() + cache.misses() < kCallers) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    release = true;
+  }
+  cv.notify_all();
+  for (auto& caller : callers) caller.join();
+
+  EXPECT_EQ(1, computations);
+  EXPECT_EQ(1u, cache.misses());
+  for (const auto& output : outputs) EXPECT_EQ("shared", output);
+}
+
+TEST(ResultCacheTest, InvalidatedDuringComputationIsNotCached) {
+  ResultCache cache;
+  int computations = 0;
+  std::string output;
+  cache.get(kKey, kTtlMs, 0, 0, [&](std::string& out) {
+    computations++;
+    cache.invalidate(kKey);
+    out = "stale";
+    return 0;
+  }, output);
+  EXPECT_EQ("stale", output);
+
+  cache.get(kKey, kTtlMs, 0, 0, [&](std::string& out) {
+    computations++;
+    out = "fresh";
+    return 0;
+  }, output);
+  EXPECT_EQ("fresh", output);
+  EXPECT_EQ(2, computations);
+}
+
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "SystemProperties.h"
+
+using memfault::SystemProperty;
+
+namespace {
+
+TEST(SystemPropertiesTest, FormatsLikeGetprop) {
+  std::vector<SystemProperty> properties = {
+    {"persist.sys.timezone", "Europe/Paris"},
+    {"ro.build.fingerprint", "google/raven/raven:14/UQ1A.240205.004/11269751:user/release-keys"},
+    {"sys.empty", ""},
+  };
+
+  std::string output = "stale";
+  memfault::format_getprop(properties, output);
+  EXPECT_EQ("[persist.sys.timezone]: [Europe/Paris]\n"
+            "[ro.build.fingerprint]: [google/raven/raven:14/UQ1A.240205.004/11269751:user/release-keys]\n"
+            "[sys.empty]: []\n",
+            output);
+
+  memfault::format_getprop({}, output);
+  EXPECT_EQ("", output);
+}
+
+#ifdef __ANDROID__
+TEST(SystemPropertiesTest, ReadsSortedProperties) {
+  auto properties = memfault::read_system_properties();
+  ASSERT_FALSE(properties.empty());
+  EXPECT_TRUE(std::is_sorted(properties.begin(), properties.end(),
+                             [](const SystemProperty& a, const SystemProperty& b) {
+                               return a.name < b.name;
+                             }));
+
+  auto sdk = std::find_if(properties.begin(), properties.end(), [](const SystemProperty& p) {
+    return p.name == "ro.build.version.sdk";
+  });
+  ASSERT_NE(properties.end(), sdk);
+  EXPECT_EQ(std::to_string(PLATFORM_SDK_VERSION), sdk->value);
+
+#if PLATFORM_SDK_VERSION >= 28
+  ASSERT_TRUE(memfault::read_system_property_types(properties));
+  EXPECT_EQ("int", sdk->value);
+#endif
+}
+#endif
+
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "TimerService.h"
+
+using memfault::TimerOptions;
+using memfault::TimerService;
+using namespace std::chrono_literals;
+
+namespace {
+
+TimerService::PeriodFunc every(std::chrono::milliseconds period) {
+  return [period]() { return std::chrono::nanoseconds(period); };
+}
+
+TEST(TimerServiceTest, FiresRepeatedly) {
+  TimerService service;
+  std::atomic<int> fired{0};
+  uint64_t id = service.add(every(10ms), [&]() { fired++; }, TimerOptions());
+
+  std::this_thread::sleep_for(200ms);
+  service.remove(id);
+  EXPECT_GE(fired.load(), 3);
+  EXPECT_GE(service.wakeups(), 3u);
+}
+
+TEST(TimerServiceTest, CoalescesWithinWindow) {
+  TimerService service;
+  std::atomic<int> fast{0};
+  std::atomic<int> slow{0};
+  // The fast timer may wait until the slow one is due: they share every wakeup
+  uint64_t fast_id = service.add(every(50ms), [&]() { fast++; }, TimerOptions{100ms, true});
+  uint64_t slow_id = service.add(every(100ms), [&]() { slow++; }, TimerOptions{0ms, true});
+
+  std::this_thread::sleep_for(550ms);
+  service.remove(fast_id);
+  service.remove(slow_id);
+
+  EXPECT_GE(slow.load(), 3);
+  EXPECT_GE(fast.load(), slow.load() - 1);
+  EXPECT_GE(service.wakeups_avoided(), 2u);
+  EXPECT_LE(service.wakeups(), (uint64_t)slow.load() + 1);
+}
+
+TEST(TimerServiceTest, NonCriticalTimerRidesAlong) {
+  TimerService service;
+  std::atomic<int> lazy{0};
+  uint64_t lazy_id = service.add(every(10ms), [&]() { lazy++; }, TimerOptions{0ms, false});
+
+  // Nothing wakes the service up
+  std::this_thread::sleep_for(100ms);
+  EXPECT_EQ(0, lazy.load());
+  EXPECT_EQ(0u, service.wakeups());
+
+  std::atomic<int> critical{0};
+  uint64_t critical_id = service.add(every(50ms), [&]() { critical++; }, TimerOptions());
+  std::this_thread::sleep_for(175ms);
+  service.remove(critical_id);
+  service.remove(lazy_id);
+
+  EXPECT_GE(critical.load(), 2);
+  EXPECT_GE(lazy.load(), 2);
+  EXPECT_LE(lazy.load(), critical.load() + 1);
+  EXPECT_GE(service.wakeups_avoided(), 2u);
+}
+
+TEST(TimerServiceTest, RemoveFromCallback) {
+  TimerService service;
+  std::atomic<int> fired{0};
+  std::atomic<uint64_t> id{0};
+  id = service.add(every(10ms), [&]() {
+    fired++;
+    service.remove(id);
+  }, TimerOptions());
+
+  std::this_thread::sleep_for(100ms);
+  EXPECT_EQ(1, fired.load());
+}
+
+TEST(TimerServiceTest, RemoveWaitsForRunningCallback) {
+  TimerService service;
+  std::atomic<bool> running{false};
+  std::atomic<bool> done{false};
+  uint64_t id = service.add(every(1ms), [&]() {
+    running = true;
+    std::this_thread::sleep_for(50ms);
+    done = true;
+  }, TimerOptions());
+
+  while (!running) std::this_thread::sleep_for(1ms);
+  service.remove(id);
+  EXPECT_TRUE(done.load());
+}
+
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "UidFilter.h"
+
+using memfault::UidFilter;
+
+namespace {
+
+class UidFilterTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char path[] = "/tmp/mflt-packages-XXXXXX";
+      int fd = mkstemp(path);
+      ASSERT_GE(fd, 0);
+      close(fd);
+      packages_list_ = path;
+      std::ofstream(packages_list_)
+          << "com.example.app 10057 0 /data/user/0/com.example.app default:targetSdkVersion=33 3003\n"
+          << "com.example.other 10058 1 /data/user/0/com.example.other platform 3003,3002\n"
+          << "android 1000 0 /data/system platform:privapp none\n";
+    }
+
+    void TearDown() override {
+      unlink(packages_list_.c_str());
+    }
+
+    std::string packages_list_;
+};
+
+}  // namespace
+
+TEST_F(UidFilterTest, EmptyWithoutRules) {
+  UidFilter filter({}, packages_list_);
+  EXPECT_TRUE(filter.empty());
+  EXPECT_FALSE(filter.matches(10057, ANDROID_LOG_FATAL));
+}
+
+TEST_F(UidFilterTest, UidsAndRanges) {
+  UidFilter filter({"uid:1000:I", "uid:10100-10199:D"}, packages_list_);
+  EXPECT_FALSE(filter.empty());
+
+  EXPECT_TRUE(filter.matches(1000, ANDROID_LOG_INFO));
+  EXPECT_FALSE(filter.matches(1000, ANDROID_LOG_DEBUG));
+  EXPECT_TRUE(filter.matches(10100, ANDROID_LOG_DEBUG));
+  EXPECT_TRUE(filter.matches(10199, ANDROID_LOG_ERROR));
+  EXPECT_FALSE(filter.matches(10200, ANDROID_LOG_ERROR));
+  EXPECT_FALSE(filter.matches(10099, ANDROID_LOG_ERROR));
+  // Raw uids: a secondary user's app is another uid
+  EXPECT_FALSE(filter.matches(1010100, ANDROID_LOG_ERROR));
+  EXPECT_FALSE(filter.matches(-1, ANDROID_LOG_ERROR));
+}
+
+TEST_F(UidFilterTest, PackagesResolveForEveryUser) {
+  UidFilter filter({"package:com.example.app:D"}, packages_list_);
+
+  EXPECT_TRUE(filter.matches(10057, ANDROID_LOG_DEBUG));
+  EXPECT_FALSE(filter.matches(10057, ANDROID_LOG_VERBOSE));
+  EXPECT_TRUE(filter.matches(1010057, ANDROID_LOG_DEBUG));
+  EXPECT_FALSE(filter.matches(10058, ANDROID_LOG_ERROR));
+}
+
+TEST_F(UidFilterTest, IgnoresInvalidAndUnknownRules) {
+  UidFilter filter({"uid:abc:D", "uid:200-100:D", "uid:1000", "pid:1:D", "uid:1000:X",
+                    "package:com.example.missing:V", "package:com.example.other:W"},
+                   packages_list_);
+  EXPECT_FALSE(filter.empty());
+  EXPECT_FALSE(filter.matches(1000, ANDROID_LOG_FATAL));
+  EXPECT_TRUE(filter.matches(10058, ANDROID_LOG_WARN));
+  EXPECT_FALSE(filter.matches(10058, ANDROID_LOG_INFO));
+}
+
+TEST_F(UidFilterTest, MissingPackagesList) {
+  UidFilter filter({"package:com.example.app:D", "uid:2000:V"}, packages_list_ + ".missing");
+  EXPECT_FALSE(filter.matches(10057, ANDROID_LOG_ERROR));
+  EXPECT_TRUE(filter.matches(2000, ANDROID_LOG_VERBOSE));
+}
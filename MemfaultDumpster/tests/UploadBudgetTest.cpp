@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include "UploadBudget.h"
+
+using memfault::UploadBudget;
+
+namespace {
+
+TEST(UploadBudgetTest, DisabledByDefault) {
+  UploadBudget budget;
+  EXPECT_FALSE(budget.enabled());
+  EXPECT_EQ(0u, budget.used_bytes());
+
+  budget.configure(1000, 0, 0);
+  EXPECT_FALSE(budget.enabled());
+  budget.configure(0, 1000, 0);
+  EXPECT_FALSE(budget.enabled());
+}
+
+TEST(UploadBudgetTest, StartsFullAndRefillsOverThePeriod) {
+  UploadBudget budget;
+  budget.configure(1000, 10000, 0);
+  EXPECT_TRUE(budget.enabled());
+  EXPECT_EQ(0u, budget.used_bytes());
+
+  budget.consume(800);
+  EXPECT_EQ(800u, budget.used_bytes());
+
+  // 100 bytes per s
+  budget.refill(5000);
+  EXPECT_EQ(300u, budget.used_bytes());
+
+  // Never more than a full bucket
+  budget.refill(100000);
+  EXPECT_EQ(0u, budget.used_bytes());
+
+  // Time going backwards earns nothing
+  budget.consume(500);
+  budget.refill(50000);
+  EXPECT_EQ(500u, budget.used_bytes());
+}
+
+TEST(UploadBudgetTest, OverdraftIsPaidBack) {
+  UploadBudget budget;
+  budget.configure(1000, 1000, 0);
+
+  budget.consume(1500);
+  EXPECT_EQ(1500u, budget.used_bytes());
+  budget.refill(400);
+  EXPECT_EQ(1100u, budget.used_bytes());
+  budget.refill(1000);
+  EXPECT_EQ(500u, budget.used_bytes());
+}
+
+TEST(UploadBudgetTest, ReconfiguringOnlyResetsOnChange) {
+  UploadBudget budget;
+  budget.configure(1000, 1000, 0);
+  budget.consume(600);
+
+  budget.configure(1000, 1000, 0);
+  EXPECT_EQ(600u, budget.used_bytes());
+
+  budget.configure(2000, 1000, 0);
+  EXPECT_EQ(0u, budget.used_bytes());
+  EXPECT_EQ(2000u, budget.budget_bytes());
+}
+
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include "WrapIntervalEstimator.h"
+
+using memfault::clamp_wrap_interval_ms;
+using memfault::WrapIntervalEstimator;
+
+namespace {
+
+// Records count entries of bytes each, evenly spread over span_ms
+void record_batch(WrapIntervalEstimator& estimator, uint32_t log_id, size_t count, size_t bytes,
+                  uint64_t span_ms) {
+  for (size_t i = 0; i < count; i++) {
+    uint64_t ns = 1000000000000ULL + span_ms * 1000000ULL * i / (count - 1);
+    estimator.record(log_id, ns / 1000000000ULL, ns % 1000000000ULL, bytes);
+  }
+  estimator.end_batch();
+}
+
+TEST(WrapIntervalEstimatorTest, UnknownUntilMeasured) {
+  WrapIntervalEstimator estimator;
+  EXPECT_EQ(0u, estimator.safe_interval_ms());
+
+  // Without a buffer size there is no turnover time
+  record_batch(estimator, 0, 100, 100, 1000);
+  EXPECT_EQ(0u, estimator.safe_interval_ms());
+}
+
+TEST(WrapIntervalEstimatorTest, HalfTheTurnoverOfTheBusiestBuffer) {
+  WrapIntervalEstimator estimator;
+  estimator.set_buffer_size(0, 1000000);
+  estimator.set_buffer_size(3, 1000000);
+
+  // main: 10 bytes/ms -> 100 s turnover, system: 1 byte/ms -> 1000 s turnover
+  record_batch(estimator, 0, 100, 100, 1000);
+  EXPECT_EQ(50000u, estimator.safe_interval_ms());
+  record_batch(estimator, 3, 10, 100, 1000);
+  EXPECT_EQ(50000u, estimator.safe_interval_ms());
+}
+
+TEST(WrapIntervalEstimatorTest, BurstsApplyImmediatelyLullsDecay) {
+  WrapIntervalEstimator estimator;
+  estimator.set_buffer_size(0, 1000000);
+
+  record_batch(estimator, 0, 100, 100, 1000);
+  EXPECT_EQ(50000u, estimator.safe_interval_ms());
+
+  // 10x burst
+  record_batch(estimator, 0, 1000, 100, 1000);
+  EXPECT_EQ(5000u, estimator.safe_interval_ms());
+
+  // Quiet again, the rate halves per batch
+  record_batch(estimator, 0, 2, 1, 1000);
+  EXPECT_EQ(10000u, estimator.safe_interval_ms());
+  record_batch(estimator, 0, 2, 1, 1000);
+  EXPECT_EQ(20000u, estimator.safe_interval_ms());
+
+  // An empty batch keeps the rate
+  estimator.end_batch();
+  EXPECT_EQ(20000u, estimator.safe_interval_ms());
+}
+
+TEST(WrapIntervalEstimatorTest, ClampsToBounds) {
+  EXPECT_EQ(900000u, clamp_wrap_interval_ms(0, 60000, 900000));
+  EXPECT_EQ(60000u, clamp_wrap_interval_ms(1000, 60000, 900000));
+  EXPECT_EQ(300000u, clamp_wrap_interval_ms(300000, 60000, 900000));
+  EXPECT_EQ(900000u, clamp_wrap_interval_ms(5000000, 60000, 900000));
+  // Fixed interval
+  EXPECT_EQ(900000u, clamp_wrap_interval_ms(1000, 900000, 900000));
+}
+
+}
@@ -8,6 +8,7 @@ import com.memfault.bort.settings.LogcatSettings
 import com.memfault.bort.shared.LogcatCommand
 import com.memfault.bort.shared.LogcatFormat
 import com.memfault.bort.shared.LogcatFormatModifier
+import com.memfault.bort.shared.Logger
 import com.memfault.bort.tokenbucket.ContinuousLogFile
 import com.memfault.bort.tokenbucket.TokenBucketStore
 import com.squareup.anvil.annotations.ContributesMultibinding
@@ -53,8 +54,20 @@ class ContinuousLogcatEntryProcessor @Inject constructor(
                     return@withContext
                 }
 
+                val input = stream.buffered()
+                val header = ContinuousLogcatHeader.read(input)
+                if (header != null) {
+                    if (header.complete && header.lines == 0L) {
+                        Logger.d("continuous log segment is empty, ignoring")
+                        return@withContext
+                    }
+                    if (header.shedLines > 0) {
+                        Logger.i("continuous log segment (${header.tier}) shed ${header.shedLines} lines")
+                    }
+                }
+
                 logcatProcessor.process(
-                    inputStream = stream,
+                    inputStream = input,
                     command = continuousLogcatCommand,
                     collectionMode = CONTINUOUS,
                 )
@@ -0,0 +1,62 @@
+package com.memfault.bort.dropbox
+
+import java.io.BufferedInputStream
+
+private const val HEADER_PREFIX = "#memfault_clog "
+
+// MemfaultDumpster pads headers to 1024 bytes, leave room for later versions
+private const val MAX_HEADER_SIZE = 4096
+
+/**
+ * Metadata MemfaultDumpster writes as the first line of each continuous log segment
+ * (see ClogSegment.h in MemfaultDumpster): space separated key=value fields, padded with
+ * spaces. It is not a logcat line and must be consumed before the segment is parsed.
+ */
+data class ContinuousLogcatHeader(
+    val version: String,
+    val fields: Map<String, String>,
+) {
+    // Whether the header was rewritten when the segment was finalized, false if left over by a crash
+    val complete: Boolean get() = fields["complete"] == "1"
+    val lines: Long? get() = fields["lines"]?.toLongOrNull()
+    val shedLines: Long get() = fields["shed_lines"]?.toLongOrNull() ?: 0
+    val tier: String? get() = fields["tier"]
+
+    companion object {
+        /**
+         * Consumes the header at the start of [input], if there is one. Otherwise nothing is
+         * consumed.
+         */
+        fun read(input: BufferedInputStream): ContinuousLogcatHeader? {
+            input.mark(MAX_HEADER_SIZE)
+            val line = ByteArray(MAX_HEADER_SIZE)
+            var length = 0
+            var terminated = false
+            while (length < MAX_HEADER_SIZE) {
+                val byte = input.read()
+                if (byte == -1) break
+                if (byte == '\n'.code) {
+                    terminated = true
+                    break
+                }
+                line[length++] = byte.toByte()
+            }
+            val text = String(line, 0, length, Charsets.UTF_8)
+            if (!terminated || !text.startsWith(HEADER_PREFIX)) {
+                input.reset()
+                return null
+            }
+            return parse(text)
+        }
+
+        internal fun parse(line: String): ContinuousLogcatHeader {
+            val tokens = line.removePrefix(HEADER_PREFIX).trim().split(' ').filter { it.isNotEmpty() }
+            return ContinuousLogcatHeader(
+                version = tokens.firstOrNull() ?: "",
+                fields = tokens.drop(1)
+                    .filter { '=' in it }
+                    .associate { it.substringBefore('=') to it.substringAfter('=') },
+            )
+        }
+    }
+}
@@ -1,5 +1,7 @@
 package com.memfault.bort.dropbox
 
+import assertk.assertThat
+import assertk.assertions.isEqualTo
 import com.memfault.bort.logcat.LogcatProcessor
 import com.memfault.bort.logcat.LogcatProcessorResult
 import com.memfault.bort.settings.LogcatCollectionMode
@@ -18,6 +20,7 @@ import kotlinx.coroutines.test.runTest
 import kotlinx.serialization.json.JsonObject
 import org.junit.Before
 import org.junit.Test
+import java.io.InputStream
 import java.time.Instant
 import kotlin.time.Duration
 import kotlin.time.Duration.Companion.minutes
@@ -26,8 +29,10 @@ import kotlin.time.Duration.Companion.seconds
 class ContinuousLogcatEntryProcessorTest {
     private lateinit var processor: ContinuousLogcatEntryProcessor
     private var logcatDataSourceEnabled: Boolean = true
+    private var processedText: String? = null
     private val logcatProcessor: LogcatProcessor = mockk {
         coEvery { process(any(), any(), any()) } coAnswers {
+            processedText = firstArg<InputStream>().bufferedReader().readText()
             LogcatProcessorResult(timeStart = Instant.ofEpochMilli(1235), timeEnd = Instant.ofEpochMilli(1610973242000))
         }
     }
@@ -37,6 +42,7 @@ class ContinuousLogcatEntryProcessorTest {
     @Before
     fun setup() {
         logcatDataSourceEnabled = true
+        processedText = null
 
         val logcatSettings = object : LogcatSettings {
             override val dataSourceEnabled: Boolean get() = logcatDataSourceEnabled
@@ -71,6 +77,22 @@ class ContinuousLogcatEntryProcessorTest {
         coVerify(exactly = 1) { logcatProcessor.process(any(), any(), CONTINUOUS) }
     }
 
+    @Test
+    fun `strips the segment header`() = runTest {
+        val logLine = "2023-10-11 16:00:00.000000000 +0000  1000  1234  1234 I Tag: message\n"
+        val header = "#memfault_clog v2 complete=1 lines=1 bytes=70 tier=base".padEnd(1023, ' ') + "\n"
+        processor.process(mockEntry(text = header + logLine))
+        coVerify(exactly = 1) { logcatProcessor.process(any(), any(), CONTINUOUS) }
+        assertThat(processedText).isEqualTo(logLine)
+    }
+
+    @Test
+    fun `ignores empty segments`() = runTest {
+        val header = "#memfault_clog v2 complete=1 lines=0 bytes=0 tier=base".padEnd(1023, ' ') + "\n"
+        processor.process(mockEntry(text = header))
+        coVerify(exactly = 0) { logcatProcessor.process(any(), any(), any()) }
+    }
+
     @Test
     fun `disabled data source`() = runTest {
         logcatDataSourceEnabled = false
@@ -0,0 +1,56 @@
+package com.memfault.bort.dropbox
+
+import assertk.assertThat
+import assertk.assertions.isEqualTo
+import assertk.assertions.isFalse
+import assertk.assertions.isNotNull
+import assertk.assertions.isNull
+import assertk.assertions.isTrue
+import org.junit.Test
+
+class ContinuousLogcatHeaderTest {
+    private val headerLine = "#memfault_clog v2 complete=1 lines=2 bytes=256 filters=9c1e4a0b config=5d02f7e1 " +
+        "redaction=0 compression=none shed_level=2 shed_lines=1234 tier=errors upload_priority=0 " +
+        "buffers=main:1697040000.000000000-1697040900.500000000:2:256"
+    private val logLine = "2023-10-11 16:00:00.000000000 +0000  1000  1234  1234 I Tag: message\n"
+
+    @Test
+    fun `consumes the padded header`() {
+        val input = (headerLine.padEnd(1023, ' ') + "\n" + logLine).byteInputStream().buffered()
+
+        val header = ContinuousLogcatHeader.read(input)
+
+        assertThat(header).isNotNull()
+        assertThat(header!!.version).isEqualTo("v2")
+        assertThat(header.complete).isTrue()
+        assertThat(header.lines).isEqualTo(2L)
+        assertThat(header.shedLines).isEqualTo(1234L)
+        assertThat(header.tier).isEqualTo("errors")
+        assertThat(header.fields["buffers"]).isEqualTo("main:1697040000.000000000-1697040900.500000000:2:256")
+        assertThat(input.bufferedReader().readText()).isEqualTo(logLine)
+    }
+
+    @Test
+    fun `segment left over by a crash`() {
+        val header = ContinuousLogcatHeader.parse("#memfault_clog v2 complete=0 lines=1 tier=base")
+
+        assertThat(header.complete).isFalse()
+        assertThat(header.shedLines).isEqualTo(0L)
+    }
+
+    @Test
+    fun `leaves logs without a header untouched`() {
+        val input = logLine.byteInputStream().buffered()
+
+        assertThat(ContinuousLogcatHeader.read(input)).isNull()
+        assertThat(input.bufferedReader().readText()).isEqualTo(logLine)
+    }
+
+    @Test
+    fun `leaves unterminated headers untouched`() {
+        val input = headerLine.byteInputStream().buffered()
+
+        assertThat(ContinuousLogcatHeader.read(input)).isNull()
+        assertThat(input.bufferedReader().readText()).isEqualTo(headerLine)
+    }
+}